@@ -0,0 +1,330 @@
+#include <Python.h>
+#include <sys/wait.h>
+#include <torch/torch.h>
+#include <torch_monitor.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <new>
+#include <string>
+
+// Measure the per-event overhead of torch_monitor on CPU op loops.
+// Each <configuration, workload> pair runs in a forked process so that callbacks
+// registered by one configuration never leak into another.
+// The bench is not built by default, build it with `make torch_monitor_bench`.
+// Results are printed as a JSON array to stdout:
+//   ns_per_event: extra time per delivered event compared with the "none" configuration
+//   events_per_s: delivered events per second
+//   allocs_per_event: extra heap allocations per delivered event
+
+#define TORCH_MONITOR_CALL(func, args)                              \
+  do {                                                              \
+    torch_monitor_status status = func args;                        \
+    if (status != TORCH_MONITOR_STATUS_SUCCESS) {                   \
+      std::cerr << "Torch monitor status: " << status << std::endl; \
+      exit(1);                                                      \
+    }                                                               \
+  } while (0)
+
+static std::atomic<uint64_t> num_allocs{0};
+
+void *operator new(size_t size) {
+  num_allocs.fetch_add(1, std::memory_order_relaxed);
+  if (void *ptr = std::malloc(size == 0 ? 1 : size)) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept { std::free(ptr); }
+
+void operator delete(void *ptr, size_t) noexcept { std::free(ptr); }
+
+typedef enum bench_config {
+  BENCH_CONFIG_NONE = 0,
+  BENCH_CONFIG_SUBSCRIBER = 1,
+  BENCH_CONFIG_MEMORY = 2,
+  BENCH_CONFIG_PYTHON_STATE = 3,
+  BENCH_CONFIG_ASYNC = 4,
+  BENCH_CONFIG_TRACE = 5,
+  BENCH_CONFIG_MEMORY_COALESCE = 6,
+  BENCH_CONFIG_COUNT = 7
+} bench_config_t;
+
+static const char *bench_config_names[BENCH_CONFIG_COUNT] = {
+    "none", "subscriber", "memory", "python_state", "async", "trace", "memory_coalesce"};
+
+typedef enum bench_workload {
+  BENCH_WORKLOAD_ADD = 0,
+  BENCH_WORKLOAD_MM = 1,
+  BENCH_WORKLOAD_BACKWARD = 2,
+  BENCH_WORKLOAD_COUNT = 3
+} bench_workload_t;
+
+static const char *bench_workload_names[BENCH_WORKLOAD_COUNT] = {"add", "mm", "backward"};
+
+struct BenchResult {
+  uint64_t ns;
+  uint64_t events;
+  uint64_t allocs;
+};
+
+const static size_t MAX_NUM_STATES = 30;
+
+static std::atomic<uint64_t> num_events{0};
+
+static std::string trace_path;
+
+// Subscribers only count events, async events are counted by the consumer thread
+static void empty_callback([[maybe_unused]] torch_monitor_callback_site_t callback_site,
+                           [[maybe_unused]] torch_monitor_callback_data_t *callback_data) {
+  num_events.fetch_add(1, std::memory_order_relaxed);
+}
+
+static void python_state_callback(torch_monitor_callback_site_t callback_site,
+                                  torch_monitor_callback_data_t *callback_data) {
+  num_events.fetch_add(1, std::memory_order_relaxed);
+  if (callback_site == TORCH_MONITOR_CALLBACK_ENTER &&
+      callback_data->domain != TORCH_MONITOR_DOMAIN_MEMORY) {
+    thread_local static torch_monitor_python_state_t python_states[MAX_NUM_STATES];
+    size_t num_states = 0;
+    torch_monitor_python_state_get(MAX_NUM_STATES, python_states, &num_states);
+  }
+}
+
+// Ops of the python_state configuration run under python frames, so that each
+// torch_monitor_python_state_get walks bench_inner, bench_outer and the module frame
+static const char *BENCH_PYTHON_DRIVER =
+    "def bench_inner(run):\n"
+    "    run()\n"
+    "def bench_outer(run):\n"
+    "    bench_inner(run)\n"
+    "bench_outer(bench_run)\n";
+
+static std::function<void()> bench_steps;
+
+static PyObject *bench_python_run([[maybe_unused]] PyObject *self,
+                                  [[maybe_unused]] PyObject *args) {
+  bench_steps();
+  Py_RETURN_NONE;
+}
+
+static PyMethodDef bench_python_method = {"bench_run", bench_python_run, METH_NOARGS, nullptr};
+
+// Run steps from a python function, Py_Initialize must have been called
+static void bench_python_call() {
+  auto *main_module = PyImport_AddModule("__main__");
+  auto *func = PyCFunction_New(&bench_python_method, nullptr);
+  PyObject_SetAttrString(main_module, "bench_run", func);
+  Py_DECREF(func);
+  if (PyRun_SimpleString(BENCH_PYTHON_DRIVER) != 0) {
+    std::cerr << "Python driver failed" << std::endl;
+    exit(1);
+  }
+}
+
+static void bench_config_init(bench_config_t config) {
+  if (config == BENCH_CONFIG_NONE) {
+    return;
+  }
+
+  TORCH_MONITOR_CALL(torch_monitor_domain_enable, (TORCH_MONITOR_DOMAIN_FUNCTION));
+  TORCH_MONITOR_CALL(torch_monitor_domain_enable, (TORCH_MONITOR_DOMAIN_BACKWARD_FUNCTION));
+  switch (config) {
+    case BENCH_CONFIG_MEMORY:
+      TORCH_MONITOR_CALL(torch_monitor_domain_enable, (TORCH_MONITOR_DOMAIN_MEMORY));
+      break;
+    case BENCH_CONFIG_MEMORY_COALESCE:
+      TORCH_MONITOR_CALL(torch_monitor_domain_enable, (TORCH_MONITOR_DOMAIN_MEMORY));
+      TORCH_MONITOR_CALL(torch_monitor_memory_coalesce_enable, ());
+      break;
+    case BENCH_CONFIG_PYTHON_STATE:
+      // Ops run with the GIL held as they do under a python interpreter
+      Py_Initialize();
+      break;
+    case BENCH_CONFIG_ASYNC:
+      TORCH_MONITOR_CALL(torch_monitor_record_mode_set, (TORCH_MONITOR_RECORD_MODE_ASYNC, 0));
+      break;
+    case BENCH_CONFIG_TRACE: {
+      trace_path = "/tmp/torch_monitor_bench." + std::to_string(getpid());
+      TORCH_MONITOR_CALL(torch_monitor_trace_enable, (trace_path.c_str()));
+      break;
+    }
+    default:
+      break;
+  }
+  if (config == BENCH_CONFIG_PYTHON_STATE) {
+    TORCH_MONITOR_CALL(torch_monitor_callback_subscribe, (python_state_callback));
+  } else {
+    TORCH_MONITOR_CALL(torch_monitor_callback_subscribe, (empty_callback));
+  }
+  TORCH_MONITOR_CALL(torch_monitor_init, ());
+}
+
+static BenchResult bench_run(bench_config_t config, bench_workload_t workload,
+                             size_t iterations) {
+  // Compare with a single intra-op thread
+  torch::set_num_threads(1);
+
+  auto left = torch::rand({16, 16});
+  auto right = torch::rand({16, 16});
+  auto grad = torch::zeros({16, 16});
+
+  auto step = [&]() {
+    switch (workload) {
+      case BENCH_WORKLOAD_ADD:
+        torch::add(left, right);
+        break;
+      case BENCH_WORKLOAD_MM:
+        torch::mm(left, right);
+        break;
+      case BENCH_WORKLOAD_BACKWARD:
+        torch::add(left, right).backward(grad);
+        break;
+      default:
+        break;
+    }
+  };
+
+  if (workload == BENCH_WORKLOAD_BACKWARD) {
+    left.set_requires_grad(true);
+    right.set_requires_grad(true);
+  }
+
+  // Warm up allocator caches and lazily initialized dispatcher states
+  {
+    torch::AutoGradMode grad_mode(workload == BENCH_WORKLOAD_BACKWARD);
+    for (size_t i = 0; i < iterations / 10 + 1; ++i) {
+      step();
+    }
+  }
+
+  bench_config_init(config);
+
+  torch::AutoGradMode grad_mode(workload == BENCH_WORKLOAD_BACKWARD);
+  std::chrono::steady_clock::time_point start;
+  bench_steps = [&]() {
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; ++i) {
+      step();
+    }
+  };
+  num_events.store(0, std::memory_order_relaxed);
+  auto allocs = num_allocs.load(std::memory_order_relaxed);
+  if (config == BENCH_CONFIG_PYTHON_STATE) {
+    bench_python_call();
+  } else {
+    bench_steps();
+  }
+  if (config != BENCH_CONFIG_NONE) {
+    // Include draining the async buffers and closing the trace
+    TORCH_MONITOR_CALL(torch_monitor_finalize, ());
+  }
+  auto end = std::chrono::steady_clock::now();
+  if (config == BENCH_CONFIG_TRACE) {
+    unlink(trace_path.c_str());
+  }
+
+  BenchResult result;
+  result.ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+  result.events = num_events.load(std::memory_order_relaxed);
+  result.allocs = num_allocs.load(std::memory_order_relaxed) - allocs;
+  return result;
+}
+
+// Run a benchmark in a child process and read back its result
+static bool bench_fork(bench_config_t config, bench_workload_t workload, size_t iterations,
+                       BenchResult &result) {
+  int fds[2];
+  if (pipe(fds) != 0) {
+    return false;
+  }
+
+  pid_t pid = fork();
+  if (pid < 0) {
+    close(fds[0]);
+    close(fds[1]);
+    return false;
+  }
+
+  if (pid == 0) {
+    close(fds[0]);
+    auto child_result = bench_run(config, workload, iterations);
+    auto size = write(fds[1], &child_result, sizeof(child_result));
+    close(fds[1]);
+    // Skip atexit handlers of torch and python
+    _exit(size == sizeof(child_result) ? 0 : 1);
+  }
+
+  close(fds[1]);
+  auto size = read(fds[0], &result, sizeof(result));
+  close(fds[0]);
+
+  int status = 0;
+  waitpid(pid, &status, 0);
+  return size == sizeof(result) && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+int main(int argc, char *argv[]) {
+  size_t iterations = 10000;
+  if (argc > 1) {
+    iterations = std::strtoull(argv[1], nullptr, 10);
+  }
+  if (iterations == 0) {
+    std::cerr << "Usage: " << argv[0] << " [iterations]" << std::endl;
+    return 1;
+  }
+
+  bool success = true;
+  bool first = true;
+  std::printf("[");
+  for (int workload = 0; workload < BENCH_WORKLOAD_COUNT; ++workload) {
+    BenchResult baseline;
+    if (!bench_fork(BENCH_CONFIG_NONE, static_cast<bench_workload_t>(workload), iterations,
+                    baseline)) {
+      std::cerr << "Baseline of " << bench_workload_names[workload] << " failed" << std::endl;
+      return 1;
+    }
+
+    for (int config = 0; config < BENCH_CONFIG_COUNT; ++config) {
+      BenchResult result = baseline;
+      if (config != BENCH_CONFIG_NONE &&
+          !bench_fork(static_cast<bench_config_t>(config), static_cast<bench_workload_t>(workload),
+                      iterations, result)) {
+        std::cerr << "Config " << bench_config_names[config] << " failed" << std::endl;
+        success = false;
+        continue;
+      }
+
+      double ns_per_event = 0.0;
+      double events_per_s = 0.0;
+      double allocs_per_event = 0.0;
+      if (result.events != 0) {
+        ns_per_event = (static_cast<double>(result.ns) - static_cast<double>(baseline.ns)) /
+                       result.events;
+        allocs_per_event =
+            (static_cast<double>(result.allocs) - static_cast<double>(baseline.allocs)) /
+            result.events;
+        events_per_s = result.events * 1e9 / result.ns;
+      }
+
+      std::printf(
+          "%s\n  {\"workload\": \"%s\", \"config\": \"%s\", \"iterations\": %zu, "
+          "\"ns_per_iteration\": %.1f, \"events\": %llu, \"ns_per_event\": %.1f, "
+          "\"events_per_s\": %.1f, \"allocs_per_event\": %.3f}",
+          first ? "" : ",", bench_workload_names[workload], bench_config_names[config], iterations,
+          static_cast<double>(result.ns) / iterations,
+          static_cast<unsigned long long>(result.events), ns_per_event, events_per_s,
+          allocs_per_event);
+      first = false;
+    }
+  }
+  std::printf("\n]\n");
+
+  return success ? 0 : 1;
+}
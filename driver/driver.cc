@@ -1,6 +1,5 @@
 #include <torch_monitor.h>
 
-#include <chrono>
 #include <cstdlib>
 #include <iostream>
 #include <string>
@@ -22,12 +21,69 @@ volatile static bool timestamp_enable = false;
 volatile static bool driver_debug = false;
 // If callback data are printed out
 volatile static bool verbose = true;
+// If callbacks are delivered by a background thread
+volatile static bool async_enable = false;
+// Binary trace path
+static const char* trace_path = nullptr;
+// If repeated iterations of the trace are stored once
+volatile static bool trace_dedup_enable = false;
+// Sampling rate of all domains
+static double sample_rate = 1.0;
+// Number of ops of each <op, level> delivered before adaptive sampling, 0 disables it
+static uint64_t adaptive_threshold = 0;
+// Number of warm-up steps before the step window
+static uint64_t step_skip = 0;
+// Number of steps in the step window, 0 records until exit
+static uint64_t step_record = 0;
+// If the step window is set
+volatile static bool step_window_enable = false;
+// Glob pattern of ops ending steps
+static const char* step_marker = "Optimizer.step*";
+// If per-op latency statistics are reported at exit
+volatile static bool op_stats_enable = false;
+// If per-op memory counters are reported at exit
+volatile static bool op_memory_enable = false;
+// If transient allocations are folded into per-op counters
+volatile static bool memory_coalesce_enable = false;
+// If the allocator summary of CPU is reported at exit
+volatile static bool memory_analyzer_enable = false;
+// Maximum number of reported timeline samples
+const static size_t MAX_NUM_MEMORY_SAMPLES = 1024;
+// CPU time samples per second of op stacks, 0 delivers op callbacks instead
+static uint64_t stack_sampling_frequency = 0;
+// Maximum number of reported op stacks
+const static size_t MAX_NUM_STACK_SAMPLES = 4096;
+// Collapsed stack path of the flame graph
+static const char* flame_graph_path = nullptr;
+// Comma separated glob patterns of delivered and filtered op names
+static const char* op_allow_patterns = nullptr;
+static const char* op_deny_patterns = nullptr;
+// If backward ops are attributed to forward ops
+volatile static bool correlation_enable = false;
+// If achieved throughput is reported at exit
+volatile static bool cost_model_enable = false;
+// If allocations live at the peak are reported at exit
+volatile static bool allocation_tracking_enable = false;
+// Maximum number of reported peak allocations
+const static size_t MAX_NUM_ALLOCATIONS = 16;
+// If input shapes are captured
+volatile static bool input_capture_enable = false;
+// Maximum number of reported inputs
+const static size_t MAX_NUM_INPUTS = 16;
+// Number of events per batch, 0 disables the batch callback
+static size_t batch_size = 0;
+// Maximum number of reported ops
+const static size_t MAX_NUM_OP_STATS = 4096;
 // Maximum number of call path frames
 const static size_t MAX_NUM_STATES = 30;
 // Call path buffer
 thread_local static torch_monitor_python_state_t python_states[MAX_NUM_STATES];
 
 static void python_state_report() {
+  uint64_t callpath_id = 0;
+  torch_monitor_python_callpath_get(MAX_NUM_STATES, &callpath_id);
+  std::cout << "Call path id: " << callpath_id << std::endl;
+
   size_t num_states = 0;
   // Allow empty states
   torch_monitor_python_state_get(MAX_NUM_STATES, python_states, &num_states);
@@ -40,6 +96,31 @@ static void python_state_report() {
   }
 }
 
+static void input_report(uint32_t signature_id) {
+  torch_monitor_input_t inputs[MAX_NUM_INPUTS];
+  size_t num_inputs = 0;
+  TORCH_MONITOR_CALL(torch_monitor_op_signature_lookup,
+                     (signature_id, MAX_NUM_INPUTS, inputs, &num_inputs));
+  for (size_t i = 0; i < num_inputs; ++i) {
+    std::cout << "Input: ";
+    if (inputs[i].type == TORCH_MONITOR_INPUT_TYPE_TENSOR) {
+      std::cout << "tensor dtype " << inputs[i].dtype << " [";
+      for (uint32_t j = 0; j < inputs[i].dim; ++j) {
+        std::cout << (j == 0 ? "" : ", ") << inputs[i].sizes[j];
+      }
+      std::cout << "]";
+    } else if (inputs[i].type == TORCH_MONITOR_INPUT_TYPE_INT ||
+               inputs[i].type == TORCH_MONITOR_INPUT_TYPE_BOOL) {
+      std::cout << inputs[i].value.int_value;
+    } else if (inputs[i].type == TORCH_MONITOR_INPUT_TYPE_DOUBLE) {
+      std::cout << inputs[i].value.double_value;
+    } else {
+      std::cout << "type " << inputs[i].type;
+    }
+    std::cout << std::endl;
+  }
+}
+
 static void driver_callback(torch_monitor_callback_site_t callback_site,
                             torch_monitor_callback_data_t* callback_data) {
   // If debug is enabled, hanging there and invoke GDB
@@ -54,17 +135,29 @@ static void driver_callback(torch_monitor_callback_site_t callback_site,
 
   if (callback_site == TORCH_MONITOR_CALLBACK_ENTER) {
     std::cout << "Domain: " << callback_data->domain << std::endl;
+    if (callback_data->weight != 1.0) {
+      std::cout << "Weight: " << callback_data->weight << std::endl;
+    }
     if (callback_data->domain != TORCH_MONITOR_DOMAIN_MEMORY) {
       std::cout << "Current thread id: " << callback_data->current_thread_id << std::endl;
       std::cout << "Forward thread id: " << callback_data->data.op_data.forward_thread_id
                 << std::endl;
       std::cout << "Sequence number: " << callback_data->data.op_data.sequence_number << std::endl;
       std::cout << "Name: " << std::string(callback_data->data.op_data.name) << std::endl;
+      if (callback_data->data.op_data.forward_op.correlation_id != 0) {
+        const char* forward_name = nullptr;
+        TORCH_MONITOR_CALL(torch_monitor_op_name_lookup,
+                           (callback_data->data.op_data.forward_op.name_id, &forward_name));
+        std::cout << "Forward op: " << callback_data->data.op_data.forward_op.correlation_id << " "
+                  << forward_name << std::endl;
+      }
+      if (input_capture_enable) {
+        input_report(callback_data->data.op_data.signature_id);
+      }
       if (timestamp_enable) {
-        std::cout << "Enter level: " << callback_data->data.op_data.nested_level << " at "
-                  << std::chrono::duration_cast<std::chrono::nanoseconds>(
-                         std::chrono::system_clock::now().time_since_epoch())
-                         .count()
+        uint64_t ns = 0;
+        torch_monitor_timestamp_to_ns(callback_data->timestamp, &ns);
+        std::cout << "Enter level: " << callback_data->data.op_data.nested_level << " at " << ns
                   << std::endl;
       }
       if (python_state_enable) {
@@ -93,16 +186,33 @@ static void driver_callback(torch_monitor_callback_site_t callback_site,
   } else if (callback_site == TORCH_MONITOR_CALLBACK_EXIT) {
     if (callback_data->domain != TORCH_MONITOR_DOMAIN_MEMORY) {
       if (timestamp_enable) {
-        std::cout << "Exit level: " << callback_data->data.op_data.nested_level << " at "
-                  << std::chrono::duration_cast<std::chrono::nanoseconds>(
-                         std::chrono::system_clock::now().time_since_epoch())
-                         .count()
+        uint64_t ns = 0;
+        torch_monitor_timestamp_to_ns(callback_data->timestamp, &ns);
+        std::cout << "Exit level: " << callback_data->data.op_data.nested_level << " at " << ns
                   << std::endl;
       }
     }
   }
 }
 
+static void driver_batch_callback(const torch_monitor_event_batch_t* batch) {
+  if (!verbose) {
+    return;
+  }
+
+  size_t num_op_events = 0;
+  int64_t mem_size = 0;
+  for (size_t i = 0; i < batch->num_events; ++i) {
+    if (batch->domain[i] == TORCH_MONITOR_DOMAIN_MEMORY) {
+      mem_size += batch->mem_size[i];
+    } else {
+      ++num_op_events;
+    }
+  }
+  std::cout << "Batch: " << batch->num_events << " events, " << num_op_events << " op events, "
+            << mem_size << " bytes allocated" << std::endl;
+}
+
 void driver_env_init() {
   if (const char* env = std::getenv("TORCH_MONITOR_PYTHON_STATE_ENABLE")) {
     if (std::atoi(env) == 1) {
@@ -127,6 +237,263 @@ void driver_env_init() {
       verbose = false;
     }
   }
+
+  if (const char* env = std::getenv("TORCH_MONITOR_ASYNC_ENABLE")) {
+    if (std::atoi(env) == 1) {
+      async_enable = true;
+    }
+  }
+
+  if (const char* env = std::getenv("TORCH_MONITOR_TRACE_PATH")) {
+    trace_path = env;
+  }
+
+  if (const char* env = std::getenv("TORCH_MONITOR_TRACE_DEDUP")) {
+    if (std::atoi(env) == 1) {
+      trace_dedup_enable = true;
+    }
+  }
+
+  if (const char* env = std::getenv("TORCH_MONITOR_SAMPLE_RATE")) {
+    sample_rate = std::atof(env);
+  }
+
+  if (const char* env = std::getenv("TORCH_MONITOR_ADAPTIVE_THRESHOLD")) {
+    adaptive_threshold = std::strtoull(env, nullptr, 10);
+  }
+
+  if (const char* env = std::getenv("TORCH_MONITOR_STEP_SKIP")) {
+    step_skip = std::strtoull(env, nullptr, 10);
+    step_window_enable = true;
+  }
+
+  if (const char* env = std::getenv("TORCH_MONITOR_STEP_RECORD")) {
+    step_record = std::strtoull(env, nullptr, 10);
+    step_window_enable = true;
+  }
+
+  if (const char* env = std::getenv("TORCH_MONITOR_STEP_MARKER")) {
+    step_marker = env;
+  }
+
+  if (const char* env = std::getenv("TORCH_MONITOR_CORRELATION_ENABLE")) {
+    if (std::atoi(env) == 1) {
+      correlation_enable = true;
+    }
+  }
+
+  if (const char* env = std::getenv("TORCH_MONITOR_COST_MODEL_ENABLE")) {
+    if (std::atoi(env) == 1) {
+      cost_model_enable = true;
+    }
+  }
+
+  if (const char* env = std::getenv("TORCH_MONITOR_ALLOCATION_TRACKING_ENABLE")) {
+    if (std::atoi(env) == 1) {
+      allocation_tracking_enable = true;
+    }
+  }
+
+  if (const char* env = std::getenv("TORCH_MONITOR_INPUT_CAPTURE_ENABLE")) {
+    if (std::atoi(env) == 1) {
+      input_capture_enable = true;
+    }
+  }
+
+  if (const char* env = std::getenv("TORCH_MONITOR_BATCH_SIZE")) {
+    batch_size = std::strtoull(env, nullptr, 10);
+  }
+
+  if (const char* env = std::getenv("TORCH_MONITOR_OP_STATS_ENABLE")) {
+    if (std::atoi(env) == 1) {
+      op_stats_enable = true;
+    }
+  }
+
+  if (const char* env = std::getenv("TORCH_MONITOR_OP_MEMORY_ENABLE")) {
+    if (std::atoi(env) == 1) {
+      op_memory_enable = true;
+    }
+  }
+
+  if (const char* env = std::getenv("TORCH_MONITOR_OP_ALLOW")) {
+    op_allow_patterns = env;
+  }
+
+  if (const char* env = std::getenv("TORCH_MONITOR_OP_DENY")) {
+    op_deny_patterns = env;
+  }
+
+  if (const char* env = std::getenv("TORCH_MONITOR_FLAME_GRAPH_PATH")) {
+    flame_graph_path = env;
+  }
+
+  if (const char* env = std::getenv("TORCH_MONITOR_STACK_SAMPLING_FREQUENCY")) {
+    stack_sampling_frequency = std::strtoull(env, nullptr, 10);
+  }
+
+  if (const char* env = std::getenv("TORCH_MONITOR_MEMORY_ANALYZER_ENABLE")) {
+    if (std::atoi(env) == 1) {
+      memory_analyzer_enable = true;
+    }
+  }
+
+  if (const char* env = std::getenv("TORCH_MONITOR_MEMORY_COALESCE_ENABLE")) {
+    if (std::atoi(env) == 1) {
+      // Transient counters are reported with op memory counters
+      memory_coalesce_enable = true;
+      op_memory_enable = true;
+    }
+  }
+}
+
+static void op_stats_report() {
+  static torch_monitor_op_stats_t op_stats[MAX_NUM_OP_STATS];
+  size_t num_op_stats = 0;
+  TORCH_MONITOR_CALL(torch_monitor_op_stats_get, (MAX_NUM_OP_STATS, op_stats, &num_op_stats));
+  for (size_t i = 0; i < num_op_stats; ++i) {
+    std::cout << "Op: " << op_stats[i].name << std::endl;
+    std::cout << "\tCount: " << op_stats[i].count << std::endl;
+    std::cout << "\tInclusive ns total/p50/p99: " << op_stats[i].inclusive.total << "/"
+              << op_stats[i].inclusive.p50 << "/" << op_stats[i].inclusive.p99 << std::endl;
+    std::cout << "\tSelf ns total/p50/p99: " << op_stats[i].self.total << "/"
+              << op_stats[i].self.p50 << "/" << op_stats[i].self.p99 << std::endl;
+  }
+}
+
+static void op_memory_counters_print(const char* kind,
+                                     const torch_monitor_memory_counters_t& counters) {
+  std::cout << "\t" << kind << " alloc count/bytes: " << counters.alloc_count << "/"
+            << counters.alloc_bytes << std::endl;
+  std::cout << "\t" << kind << " free count/bytes: " << counters.free_count << "/"
+            << counters.free_bytes << std::endl;
+  std::cout << "\t" << kind << " net bytes: " << counters.net_bytes << std::endl;
+  std::cout << "\t" << kind << " transient count/bytes: " << counters.transient_count << "/"
+            << counters.transient_bytes << std::endl;
+}
+
+static void op_memory_report() {
+  static torch_monitor_op_memory_t op_memories[MAX_NUM_OP_STATS];
+  size_t num_op_memories = 0;
+  TORCH_MONITOR_CALL(torch_monitor_op_memory_get,
+                     (MAX_NUM_OP_STATS, op_memories, &num_op_memories));
+  for (size_t i = 0; i < num_op_memories; ++i) {
+    std::cout << "Op memory: " << op_memories[i].name << std::endl;
+    op_memory_counters_print("Innermost", op_memories[i].innermost);
+    op_memory_counters_print("Master", op_memories[i].master);
+  }
+}
+
+static void memory_summary_report() {
+  torch_monitor_memory_summary_t summary;
+  TORCH_MONITOR_CALL(torch_monitor_memory_summary_get, (TORCH_MONITOR_DEVICE_TYPE_CPU, &summary));
+  std::cout << "Memory alloc/free count: " << summary.alloc_count << "/" << summary.free_count
+            << std::endl;
+  for (size_t i = 0; i < TORCH_MONITOR_SIZE_CLASS_COUNT; ++i) {
+    if (summary.size_class_counts[i] != 0) {
+      std::cout << "\tSize class " << (1ull << i) << " count/bytes: "
+                << summary.size_class_counts[i] << "/" << summary.size_class_bytes[i] << std::endl;
+    }
+  }
+  std::cout << "\tLifetime ns p50/p99: " << summary.lifetime.p50 << "/" << summary.lifetime.p99
+            << std::endl;
+  std::cout << "\tMax allocated/reserved/gap: " << summary.max_allocated << "/"
+            << summary.max_reserved << "/" << summary.max_gap << std::endl;
+
+  static torch_monitor_memory_sample_t samples[MAX_NUM_MEMORY_SAMPLES];
+  size_t num_samples = 0;
+  TORCH_MONITOR_CALL(torch_monitor_memory_timeline_get,
+                     (TORCH_MONITOR_DEVICE_TYPE_CPU, MAX_NUM_MEMORY_SAMPLES, samples, &num_samples));
+  for (size_t i = 0; i < num_samples; ++i) {
+    std::cout << "Memory sample: " << samples[i].timestamp << " " << samples[i].allocated << " "
+              << samples[i].reserved << " " << samples[i].gap << std::endl;
+  }
+}
+
+static void stack_samples_report() {
+  static torch_monitor_stack_sample_t samples[MAX_NUM_STACK_SAMPLES];
+  size_t num_samples = 0;
+  TORCH_MONITOR_CALL(torch_monitor_stack_samples_get,
+                     (MAX_NUM_STACK_SAMPLES, samples, &num_samples));
+  for (size_t i = 0; i < num_samples; ++i) {
+    // Stacks are printed from the outermost op, separated by ';'
+    std::cout << "Stack sample: " << samples[i].count << " ";
+    for (uint32_t level = 0; level < samples[i].depth; ++level) {
+      const char* name = nullptr;
+      TORCH_MONITOR_CALL(torch_monitor_op_name_lookup, (samples[i].name_ids[level], &name));
+      std::cout << (level == 0 ? "" : ";") << name;
+    }
+    std::cout << std::endl;
+  }
+}
+
+static void op_throughput_report() {
+  static torch_monitor_op_throughput_t op_throughputs[MAX_NUM_OP_STATS];
+  size_t num_op_throughputs = 0;
+  TORCH_MONITOR_CALL(torch_monitor_op_throughput_get,
+                     (MAX_NUM_OP_STATS, op_throughputs, &num_op_throughputs));
+  for (size_t i = 0; i < num_op_throughputs; ++i) {
+    std::cout << "Throughput: " << op_throughputs[i].name << std::endl;
+    std::cout << "\tCall path id: " << op_throughputs[i].callpath_id << std::endl;
+    std::cout << "\tCount: " << op_throughputs[i].count << std::endl;
+    std::cout << "\tGFLOP/s: " << op_throughputs[i].gflops_per_second << std::endl;
+    std::cout << "\tGB/s: " << op_throughputs[i].gbytes_per_second << std::endl;
+  }
+}
+
+static void peak_allocations_report() {
+  static torch_monitor_allocation_t allocations[MAX_NUM_ALLOCATIONS];
+  size_t num_allocations = 0;
+  int64_t peak_size = 0;
+  TORCH_MONITOR_CALL(torch_monitor_peak_allocations_get,
+                     (TORCH_MONITOR_DEVICE_TYPE_CPU, MAX_NUM_ALLOCATIONS, allocations,
+                      &num_allocations, &peak_size));
+  std::cout << "Peak size: " << peak_size << std::endl;
+  for (size_t i = 0; i < num_allocations; ++i) {
+    std::cout << "Peak allocation: " << allocations[i].name << std::endl;
+    std::cout << "\tSize: " << allocations[i].size << std::endl;
+    std::cout << "\tCall path id: " << allocations[i].callpath_id << std::endl;
+    std::cout << "\tTimestamp: " << allocations[i].timestamp << std::endl;
+  }
+}
+
+void driver_finalize() {
+  torch_monitor_finalize();
+  if (op_stats_enable) {
+    op_stats_report();
+  }
+  if (op_memory_enable) {
+    op_memory_report();
+  }
+  if (memory_analyzer_enable) {
+    memory_summary_report();
+  }
+  if (stack_sampling_frequency != 0) {
+    stack_samples_report();
+  }
+  if (cost_model_enable) {
+    op_throughput_report();
+  }
+  if (allocation_tracking_enable) {
+    peak_allocations_report();
+  }
+}
+
+static void op_filter_add(const char* patterns, torch_monitor_op_filter_mode_t mode) {
+  std::string pattern;
+  for (const char* c = patterns;; ++c) {
+    if (*c == ',' || *c == '\0') {
+      if (!pattern.empty()) {
+        TORCH_MONITOR_CALL(torch_monitor_op_filter_add, (pattern.c_str(), mode));
+        pattern.clear();
+      }
+      if (*c == '\0') {
+        break;
+      }
+    } else {
+      pattern += *c;
+    }
+  }
 }
 
 int driver_register() {
@@ -136,7 +503,76 @@ int driver_register() {
   TORCH_MONITOR_CALL(torch_monitor_domain_enable, (TORCH_MONITOR_DOMAIN_BACKWARD_FUNCTION));
   TORCH_MONITOR_CALL(torch_monitor_domain_enable, (TORCH_MONITOR_DOMAIN_MEMORY));
   TORCH_MONITOR_CALL(torch_monitor_callback_subscribe, (driver_callback));
+  if (sample_rate != 1.0) {
+    TORCH_MONITOR_CALL(torch_monitor_domain_sample_rate, (TORCH_MONITOR_DOMAIN_FUNCTION, sample_rate));
+    TORCH_MONITOR_CALL(torch_monitor_domain_sample_rate,
+                       (TORCH_MONITOR_DOMAIN_BACKWARD_FUNCTION, sample_rate));
+    TORCH_MONITOR_CALL(torch_monitor_domain_sample_rate, (TORCH_MONITOR_DOMAIN_MEMORY, sample_rate));
+  }
+  if (adaptive_threshold != 0) {
+    TORCH_MONITOR_CALL(torch_monitor_adaptive_sampling_enable, (adaptive_threshold));
+  }
+  // Trace iterations are delimited by marker steps even without a window
+  if (step_window_enable || trace_dedup_enable) {
+    TORCH_MONITOR_CALL(torch_monitor_step_window_set, (step_skip, step_record, step_marker));
+  }
+  if (async_enable) {
+    TORCH_MONITOR_CALL(torch_monitor_record_mode_set, (TORCH_MONITOR_RECORD_MODE_ASYNC, 0));
+  }
+  if (trace_path != nullptr) {
+    TORCH_MONITOR_CALL(torch_monitor_trace_enable, (trace_path));
+    if (trace_dedup_enable) {
+      TORCH_MONITOR_CALL(torch_monitor_trace_dedup_enable, ());
+    }
+  }
+  if (input_capture_enable) {
+    TORCH_MONITOR_CALL(torch_monitor_input_capture_enable, ());
+  }
+  if (cost_model_enable) {
+    TORCH_MONITOR_CALL(torch_monitor_cost_model_enable,
+                       (python_state_enable ? MAX_NUM_STATES : 0));
+  }
+  if (allocation_tracking_enable) {
+    TORCH_MONITOR_CALL(torch_monitor_allocation_tracking_enable,
+                       (python_state_enable ? MAX_NUM_STATES : 0));
+  }
+  if (batch_size != 0) {
+    TORCH_MONITOR_CALL(torch_monitor_batch_subscribe,
+                       (driver_batch_callback, TORCH_MONITOR_DOMAIN_MASK_ALL, batch_size));
+  }
+  if (op_stats_enable) {
+    TORCH_MONITOR_CALL(torch_monitor_op_stats_enable, ());
+  }
+  if (op_memory_enable) {
+    TORCH_MONITOR_CALL(torch_monitor_op_memory_enable, ());
+  }
+  if (memory_coalesce_enable) {
+    TORCH_MONITOR_CALL(torch_monitor_memory_coalesce_enable, ());
+  }
+  if (memory_analyzer_enable) {
+    TORCH_MONITOR_CALL(torch_monitor_memory_analyzer_enable, ());
+  }
+  if (op_allow_patterns != nullptr) {
+    op_filter_add(op_allow_patterns, TORCH_MONITOR_OP_FILTER_MODE_ALLOW);
+  }
+  if (op_deny_patterns != nullptr) {
+    op_filter_add(op_deny_patterns, TORCH_MONITOR_OP_FILTER_MODE_DENY);
+  }
+  if (flame_graph_path != nullptr) {
+    TORCH_MONITOR_CALL(torch_monitor_flame_graph_enable,
+                       (flame_graph_path, TORCH_MONITOR_FLAME_GRAPH_METRIC_SELF_TIME,
+                        python_state_enable ? MAX_NUM_STATES : 0));
+  }
+  if (stack_sampling_frequency != 0) {
+    TORCH_MONITOR_CALL(torch_monitor_stack_sampling_enable,
+                       (stack_sampling_frequency, python_state_enable ? MAX_NUM_STATES : 0));
+  }
+  if (correlation_enable) {
+    TORCH_MONITOR_CALL(torch_monitor_correlation_enable, (python_state_enable ? MAX_NUM_STATES : 0));
+  }
   TORCH_MONITOR_CALL(torch_monitor_init, ());
+  // Flush buffered events and close the trace at exit
+  std::atexit(driver_finalize);
   return 0;
 }
 
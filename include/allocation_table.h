@@ -0,0 +1,102 @@
+#ifndef TORCH_MONITOR_ALLOCATION_TABLE_H
+#define TORCH_MONITOR_ALLOCATION_TABLE_H
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include "torch_monitor.h"
+
+namespace torch_monitor {
+
+// A live allocation and the context it was allocated in
+struct Allocation {
+  void *ptr;
+  int64_t size;
+  uint64_t callpath_id;
+  uint64_t timestamp;
+  uint32_t name_id;
+  torch_monitor_device_type_t device_type;
+};
+
+// Tracks live allocations in an open-addressing hash table keyed by ptr,
+// with linear probing and backward-shift deletion.
+// The live set of each device type is copied into a snapshot when it reaches a new peak,
+// so the allocations live at the peak can be reported without replaying events.
+class AllocationTable {
+ public:
+  // max_num_states: depth of the python call paths of allocations, 0 means no call paths
+  void enable(size_t max_num_states) {
+    _max_num_states.store(max_num_states, std::memory_order_relaxed);
+    _enabled.store(true, std::memory_order_relaxed);
+  }
+
+  bool is_enabled() const { return _enabled.load(std::memory_order_relaxed); }
+
+  size_t max_num_states() const { return _max_num_states.load(std::memory_order_relaxed); }
+
+  // Record an allocation (size > 0) or a free (size < 0),
+  // allocations of device types without peaks (TORCH_MONITOR_DEVICE_TYPE_COUNT) are ignored
+  void record(const Allocation &allocation);
+
+  // Take the pending snapshots of peaks without following frees
+  void flush();
+
+  // Copy up to max_num_allocations allocations live at the snapshotted peak of device_type,
+  // largest first, and return the number of allocations
+  size_t peak(torch_monitor_device_type_t device_type, size_t max_num_allocations,
+              torch_monitor_allocation_t *allocations, int64_t *peak_size);
+
+  // Get the singleton instance
+  static AllocationTable &instance();
+
+ public:
+  const static size_t ALLOCATION_TABLE_MIN_CAPACITY = 4096;
+  // A peak is snapshotted only if it grows by 1/2^ALLOCATION_PEAK_GROWTH_SHIFT over the last
+  // snapshot, which bounds the snapshot cost while memory ramps up
+  const static size_t ALLOCATION_PEAK_GROWTH_SHIFT = 6;
+  const static size_t ALLOCATION_NOT_FOUND = SIZE_MAX;
+
+ private:
+  struct PeakState {
+    int64_t live_size = 0;
+    int64_t peak_size = 0;
+    int64_t snapshot_size = 0;
+    // The live set is at a peak worth a snapshot, taken at the next free
+    bool pending = false;
+    std::vector<Allocation> snapshot;
+  };
+
+  AllocationTable() {}
+
+  size_t slot(const void *ptr) const {
+    return (reinterpret_cast<uintptr_t>(ptr) * 0x9e3779b97f4a7c15ull) >> _shift;
+  }
+
+  void insert(const Allocation &allocation);
+
+  // Return the slot of ptr or ALLOCATION_NOT_FOUND
+  size_t find(const void *ptr) const;
+
+  void erase(size_t index);
+
+  void grow();
+
+  void snapshot(torch_monitor_device_type_t device_type);
+
+ private:
+  std::atomic<bool> _enabled{false};
+  std::atomic<size_t> _max_num_states{0};
+  std::mutex _mutex;
+  // Empty slots have nullptr ptr
+  std::vector<Allocation> _slots;
+  size_t _size = 0;
+  // 64 - log2(capacity)
+  size_t _shift = 64;
+  PeakState _peaks[TORCH_MONITOR_DEVICE_TYPE_COUNT];
+};
+
+}  // namespace torch_monitor
+
+#endif  // TORCH_MONITOR_ALLOCATION_TABLE_H
@@ -0,0 +1,88 @@
+#ifndef TORCH_MONITOR_CORRELATION_TABLE_H
+#define TORCH_MONITOR_CORRELATION_TABLE_H
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+
+#include "torch_monitor.h"
+
+namespace torch_monitor {
+
+// Maps <forward_thread_id, sequence_number> of forward ops to the ops themselves,
+// so that backward ops can be attributed to their forward counterparts.
+// Keys are spread over independently locked shards, each holding a bounded number of entries.
+class CorrelationTable {
+ public:
+  // max_num_states: depth of the python call paths of forward ops, 0 means no call paths
+  void enable(size_t max_num_states) {
+    _max_num_states.store(max_num_states, std::memory_order_relaxed);
+    _enabled.store(true, std::memory_order_relaxed);
+  }
+
+  bool is_enabled() const { return _enabled.load(std::memory_order_relaxed); }
+
+  size_t max_num_states() const { return _max_num_states.load(std::memory_order_relaxed); }
+
+  // Record a forward op and assign forward_op.correlation_id.
+  // A later forward op with the same key replaces the earlier one.
+  void insert(uint64_t forward_thread_id, int64_t sequence_number,
+              torch_monitor_forward_op_t &forward_op);
+
+  // Look up the forward op of a backward op and evict it.
+  // Entries with sequence_number 0 are kept until the next forward op with seq=0,
+  // so that every backward op with seq=0 is attributed to the most recent one.
+  // true: forward_op is found
+  // false: no forward op has the key or it was evicted
+  bool consume(uint64_t forward_thread_id, int64_t sequence_number,
+               torch_monitor_forward_op_t &forward_op);
+
+  // Number of forward ops not yet consumed
+  size_t size();
+
+  void clear();
+
+  // Get the singleton instance
+  static CorrelationTable &instance();
+
+ public:
+  const static size_t CORRELATION_NUM_SHARDS = 64;
+  // The oldest entry of a shard is evicted once the shard is full
+  const static size_t CORRELATION_SHARD_CAPACITY = 4096;
+
+ private:
+  using CorrelationKey = std::pair<uint64_t, int64_t>;
+
+  struct CorrelationKeyHash {
+    size_t operator()(const CorrelationKey &key) const {
+      return std::hash<uint64_t>()(key.first * 0x9e3779b97f4a7c15ull ^
+                                   static_cast<uint64_t>(key.second));
+    }
+  };
+
+  struct alignas(64) Shard {
+    std::mutex mutex;
+    std::unordered_map<CorrelationKey, torch_monitor_forward_op_t, CorrelationKeyHash> entries;
+    // Insertion order of <key, correlation_id>, stale pairs are skipped at eviction
+    std::deque<std::pair<CorrelationKey, uint64_t>> order;
+  };
+
+  CorrelationTable() {}
+
+  Shard &shard(const CorrelationKey &key) {
+    return _shards[CorrelationKeyHash()(key) % CORRELATION_NUM_SHARDS];
+  }
+
+ private:
+  std::atomic<bool> _enabled{false};
+  std::atomic<size_t> _max_num_states{0};
+  std::atomic<uint64_t> _next_correlation_id{1};
+  Shard _shards[CORRELATION_NUM_SHARDS];
+};
+
+}  // namespace torch_monitor
+
+#endif  // TORCH_MONITOR_CORRELATION_TABLE_H
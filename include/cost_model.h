@@ -0,0 +1,138 @@
+#ifndef TORCH_MONITOR_COST_MODEL_H
+#define TORCH_MONITOR_COST_MODEL_H
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "op_stack.h"
+#include "torch_monitor.h"
+
+namespace torch_monitor {
+
+// Estimated work of one op invocation
+struct OpCost {
+  uint64_t flops;
+  // Bytes read from inputs and written to the output
+  uint64_t bytes;
+};
+
+// Work and time of one <op name, call path>
+struct OpThroughput {
+  uint64_t count = 0;
+  uint64_t time = 0;
+  uint64_t flops = 0;
+  uint64_t bytes = 0;
+};
+
+// Estimates FLOPs and memory traffic of common ATen ops from their input signatures
+// and aggregates them with inclusive op time into achieved throughput.
+// Ops the model does not know are ignored.
+// Each thread updates a private table, tables are merged at finalize.
+class CostModel {
+ public:
+  // max_num_states: depth of the python call paths ops are keyed by, 0 keys ops by name only
+  void enable(size_t max_num_states) {
+    _max_num_states.store(max_num_states, std::memory_order_relaxed);
+    _enabled.store(true, std::memory_order_relaxed);
+  }
+
+  bool is_enabled() const { return _enabled.load(std::memory_order_relaxed); }
+
+  size_t max_num_states() const { return _max_num_states.load(std::memory_order_relaxed); }
+
+  // Record an op that exits after duration timer ticks
+  void record(const OpFrame &frame, uint64_t duration) {
+    OpCost cost;
+    if (!estimate(frame.name_id, frame.signature_id, cost)) {
+      return;
+    }
+
+    auto *table = _thread_table.get();
+    if (table == nullptr) {
+      table = register_thread_table();
+    }
+    auto &throughput = (*table)[OpKey(frame.name_id, frame.callpath_id)];
+    ++throughput.count;
+    throughput.time += duration;
+    throughput.flops += cost.flops;
+    throughput.bytes += cost.bytes;
+  }
+
+  // Estimate the cost of an op from its name and input signature, results are cached per thread
+  // true: the op is modeled
+  // false: the op or its inputs are not modeled
+  bool estimate(uint32_t name_id, uint32_t signature_id, OpCost &cost) {
+    auto key = (static_cast<uint64_t>(name_id) << 32) | signature_id;
+    auto &entry = _cache[(key * 0x9e3779b97f4a7c15ull) >> (64 - COST_CACHE_BITS)];
+    if (!entry.valid || entry.key != key) {
+      entry.key = key;
+      entry.modeled = estimate_slow(name_id, signature_id, entry.cost);
+      entry.valid = true;
+    }
+    cost = entry.cost;
+    return entry.modeled;
+  }
+
+  // Merge all thread tables, threads must not record during the merge
+  void merge();
+
+  bool is_merged() const { return _merged; }
+
+  // Copy up to max_num_results merged results in <name id, call path id> order
+  // and return the number of results
+  size_t get(size_t max_num_results, torch_monitor_op_throughput_t *results);
+
+  // Get the singleton instance
+  static CostModel &instance();
+
+ public:
+  const static size_t COST_CACHE_BITS = 10;
+  // Inputs beyond COST_MAX_INPUTS are not used by the model
+  const static size_t COST_MAX_INPUTS = 16;
+
+ private:
+  using OpKey = std::pair<uint32_t, uint64_t>;
+
+  struct OpKeyHash {
+    size_t operator()(const OpKey &key) const {
+      return std::hash<uint64_t>()(key.second * 0x9e3779b97f4a7c15ull ^ key.first);
+    }
+  };
+
+  using OpThroughputTable = std::unordered_map<OpKey, OpThroughput, OpKeyHash>;
+
+  // Zero-initialized as thread local storage
+  struct CacheEntry {
+    uint64_t key;
+    OpCost cost;
+    bool modeled;
+    bool valid;
+  };
+
+  CostModel() {}
+
+  bool estimate_slow(uint32_t name_id, uint32_t signature_id, OpCost &cost);
+
+  OpThroughputTable *register_thread_table();
+
+ private:
+  std::atomic<bool> _enabled{false};
+  std::atomic<size_t> _max_num_states{0};
+  bool _merged = false;
+  std::mutex _mutex;
+  std::vector<std::shared_ptr<OpThroughputTable>> _tables;
+  std::map<OpKey, OpThroughput> _merged_table;
+
+  static inline thread_local std::shared_ptr<OpThroughputTable> _thread_table;
+  static inline thread_local CacheEntry _cache[1 << COST_CACHE_BITS];
+};
+
+}  // namespace torch_monitor
+
+#endif  // TORCH_MONITOR_COST_MODEL_H
@@ -0,0 +1,133 @@
+#ifndef TORCH_MONITOR_EVENT_BATCHER_H
+#define TORCH_MONITOR_EVENT_BATCHER_H
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "torch_monitor.h"
+
+namespace torch_monitor {
+
+// Events of one batch subscriber buffered by one thread, stored column by column
+struct EventColumns {
+  // Generation of the subscriber slot the events belong to
+  uint64_t generation = 0;
+  std::vector<uint8_t> domain;
+  std::vector<uint8_t> site;
+  std::vector<uint64_t> thread_id;
+  std::vector<int64_t> sequence_number;
+  std::vector<uint32_t> nested_level;
+  std::vector<uint32_t> name_id;
+  std::vector<uint64_t> timestamp;
+  std::vector<double> weight;
+  std::vector<int64_t> mem_size;
+  std::vector<int64_t> mem_total_allocated;
+  std::vector<int64_t> mem_total_reserved;
+
+  size_t size() const { return domain.size(); }
+
+  void append(torch_monitor_callback_site_t callback_site,
+              const torch_monitor_callback_data_t *callback_data);
+
+  void reserve(size_t batch_size);
+
+  void clear();
+
+  // Pass all events to func and clear them
+  void flush(torch_monitor_batch_callback_func_t func);
+};
+
+// Buffers events per thread and delivers them to batch subscribers in columns.
+// A batch is delivered once batch_size events of a subscriber accumulate on a thread,
+// at torch_monitor_batch_flush/torch_monitor_thread_finalize on that thread,
+// when the thread exits, or at torch_monitor_finalize for all threads.
+class EventBatcher {
+ public:
+  // true: subscribe success
+  // false: func has been subscribed or all slots are taken
+  bool subscribe(torch_monitor_batch_callback_func_t func, uint64_t domain_mask,
+                 size_t batch_size);
+
+  // Events of func still buffered by other threads are discarded
+  // true: unsubscribe success
+  // false: func has not been subscribed
+  bool unsubscribe(torch_monitor_batch_callback_func_t func);
+
+  // Subscribers without domains are ignored
+  bool empty() const { return _domain_mask.load(std::memory_order_relaxed) == 0; }
+
+  bool has_subscriber(torch_monitor_domain_t domain) const {
+    return _domain_mask.load(std::memory_order_relaxed) & TORCH_MONITOR_DOMAIN_MASK(domain);
+  }
+
+  void append(torch_monitor_callback_site_t callback_site,
+              const torch_monitor_callback_data_t *callback_data);
+
+  // Deliver events buffered by the calling thread
+  void flush();
+
+  // Deliver events buffered by all threads, threads must not append during the flush
+  void flush_all();
+
+  // Remove all subscribers
+  void clear();
+
+  // Get the singleton instance
+  static EventBatcher &instance();
+
+ public:
+  const static size_t BATCH_SUBSCRIBER_MAX = 8;
+
+ private:
+  struct BatchSubscriber {
+    // nullptr if the slot is free
+    std::atomic<torch_monitor_batch_callback_func_t> func{nullptr};
+    std::atomic<uint64_t> domain_mask{0};
+    std::atomic<size_t> batch_size{0};
+    // Bumped whenever the slot is taken, stale buffered events are discarded
+    std::atomic<uint64_t> generation{0};
+  };
+
+  struct ThreadBatches {
+    // Serializes flushes of the owner thread, its exit, and torch_monitor_finalize,
+    // recursive because batch callbacks may flush the thread again
+    std::recursive_mutex mutex;
+    // Events raised by subscribers during a flush are not buffered
+    bool flushing = false;
+    EventColumns columns[BATCH_SUBSCRIBER_MAX];
+  };
+
+  // Flushes and unregisters the batches of a thread when the thread exits,
+  // so that columns of exited threads are not kept
+  struct ThreadBatchesOwner {
+    std::shared_ptr<ThreadBatches> batches;
+
+    ~ThreadBatchesOwner();
+  };
+
+  EventBatcher() {}
+
+  ThreadBatches *register_thread_batches();
+
+  void unregister_thread_batches(const std::shared_ptr<ThreadBatches> &batches);
+
+  void flush(ThreadBatches &batches);
+
+  // Recompute _domain_mask, the caller must hold _mutex
+  void update_domain_mask();
+
+ private:
+  std::atomic<uint64_t> _domain_mask{0};
+  BatchSubscriber _subscribers[BATCH_SUBSCRIBER_MAX];
+  // Serializes writers and protects _batches
+  std::mutex _mutex;
+  std::vector<std::shared_ptr<ThreadBatches>> _batches;
+
+  static inline thread_local ThreadBatchesOwner _thread_batches;
+};
+
+}  // namespace torch_monitor
+
+#endif  // TORCH_MONITOR_EVENT_BATCHER_H
@@ -0,0 +1,144 @@
+#ifndef TORCH_MONITOR_EVENT_BUFFER_H
+#define TORCH_MONITOR_EVENT_BUFFER_H
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "torch_monitor.h"
+
+namespace torch_monitor {
+
+// A compact fixed-size event copied into per-thread ring buffers
+struct EventRecord {
+  torch_monitor_callback_site_t callback_site;
+  torch_monitor_callback_data_t callback_data;
+  // Trace step of the producer, iterations must not shift with the consumer lag
+  uint64_t step;
+};
+
+// Single-producer single-consumer ring buffer.
+// The producer is the PyTorch thread that owns the buffer,
+// the consumer is the background thread of EventBufferManager.
+class EventRingBuffer {
+ public:
+  // capacity must be a power of two
+  explicit EventRingBuffer(size_t capacity)
+      : _records(capacity), _mask(capacity - 1) {}
+
+  // true: record pushed
+  // false: buffer full, record dropped
+  bool push(const EventRecord &record) {
+    auto tail = _tail.load(std::memory_order_relaxed);
+    if (tail - _cached_head > _mask) {
+      _cached_head = _head.load(std::memory_order_acquire);
+      if (tail - _cached_head > _mask) {
+        _dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+      }
+    }
+    _records[tail & _mask] = record;
+    _tail.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Invoke func on every pending record and return the number of drained records
+  template <typename Func>
+  size_t drain(Func &&func) {
+    auto head = _head.load(std::memory_order_relaxed);
+    auto tail = _tail.load(std::memory_order_acquire);
+    for (auto i = head; i != tail; ++i) {
+      func(_records[i & _mask]);
+    }
+    _head.store(tail, std::memory_order_release);
+    return tail - head;
+  }
+
+  size_t dropped() const { return _dropped.load(std::memory_order_relaxed); }
+
+ private:
+  std::vector<EventRecord> _records;
+  const size_t _mask;
+  // Written by the consumer
+  alignas(64) std::atomic<size_t> _head{0};
+  // Written by the producer
+  alignas(64) std::atomic<size_t> _tail{0};
+  // Producer's copy of _head, refreshed only when the buffer looks full
+  size_t _cached_head = 0;
+  std::atomic<size_t> _dropped{0};
+};
+
+// Owns per-thread ring buffers and the background thread that drains them.
+// Subscribers are invoked on the consumer thread, so they cannot query
+// thread local states (e.g., python states) of the thread that ran the op.
+class EventBufferManager {
+ public:
+  // true: set success
+  // false: capacity is not a power of two or the consumer is running
+  bool set_capacity(size_t capacity);
+
+  // true: consumer thread started
+  // false: consumer thread is already running
+  bool start();
+
+  // Stop the consumer thread and drain all pending records
+  // true: stop success
+  // false: consumer thread is not running
+  bool stop();
+
+  bool is_running() const { return _running.load(std::memory_order_relaxed); }
+
+  // Copy a record into the calling thread's buffer without blocking
+  // true: record buffered
+  // false: record dropped
+  bool record(torch_monitor_callback_site_t callback_site,
+              const torch_monitor_callback_data_t &callback_data, uint64_t step) {
+    auto *buffer = _thread_buffer.get();
+    if (buffer == nullptr) {
+      buffer = register_thread_buffer();
+    }
+    return buffer->push(EventRecord{callback_site, callback_data, step});
+  }
+
+  // Number of records dropped across all threads
+  size_t dropped();
+
+  // Get the singleton instance
+  static EventBufferManager &instance();
+
+ public:
+  const static size_t EVENT_BUFFER_DEFAULT_CAPACITY = 1 << 16;
+
+ private:
+  EventBufferManager() {}
+
+  // The consumer is stopped by torch_monitor_finalize. If the process exits without it,
+  // the consumer is joined without the final drain, because the singletons records are
+  // delivered to may already be destroyed.
+  ~EventBufferManager();
+
+  EventRingBuffer *register_thread_buffer();
+
+  // Drain every buffer once and return the number of drained records
+  size_t drain();
+
+  void consume();
+
+ private:
+  size_t _capacity = EVENT_BUFFER_DEFAULT_CAPACITY;
+  std::atomic<bool> _running{false};
+  std::thread _consumer;
+  // Protects _buffers, held by the consumer while draining
+  std::mutex _mutex;
+  std::vector<std::shared_ptr<EventRingBuffer>> _buffers;
+  // Records dropped by buffers of exited threads
+  size_t _retired_dropped = 0;
+
+  static inline thread_local std::shared_ptr<EventRingBuffer> _thread_buffer;
+};
+
+}  // namespace torch_monitor
+
+#endif  // TORCH_MONITOR_EVENT_BUFFER_H
@@ -0,0 +1,110 @@
+#ifndef TORCH_MONITOR_FLAME_GRAPH_H
+#define TORCH_MONITOR_FLAME_GRAPH_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "op_stack.h"
+#include "torch_monitor.h"
+
+namespace torch_monitor {
+
+// Aggregates ops into a trie of <python call path, nested op names> on each thread.
+// Each node accumulates the count and self time of an op stack, inclusive times are
+// the sums over subtrees that flame graph tools compute from self times,
+// so memory is proportional to the number of distinct stacks instead of the number of ops.
+// Tries are merged at finalize and written as collapsed stacks, one "frame;frame;... value"
+// line per stack, which flame graph tools read directly.
+class FlameGraph {
+ public:
+  // true: the output file is opened
+  // false: the output file cannot be opened
+  bool enable(const char *path, torch_monitor_flame_graph_metric_t metric, size_t max_num_states);
+
+  bool is_enabled() const { return _enabled.load(std::memory_order_relaxed); }
+
+  // Find the node of an op under its parent op, or under the python call path at nested level 0
+  void enter(OpFrame &frame, const OpFrame *parent) {
+    auto *trie = _thread_trie.get();
+    if (trie == nullptr) {
+      trie = register_thread_trie();
+    }
+    auto parent_node = parent != nullptr && parent->flame_node != FLAME_NODE_NULL
+                           ? parent->flame_node
+                           : root(*trie);
+    auto key = (static_cast<uint64_t>(parent_node) << 32) | frame.name_id;
+    auto iter = trie->children.find(key);
+    if (iter != trie->children.end()) {
+      frame.flame_node = iter->second;
+    } else {
+      frame.flame_node = static_cast<uint32_t>(trie->nodes.size());
+      trie->nodes.push_back(Node{parent_node, frame.name_id});
+      trie->children.emplace(key, frame.flame_node);
+    }
+  }
+
+  // Record an op whose self duration is in timer ticks,
+  // ops entered without a node (FLAME_NODE_NULL) are skipped
+  void record(const OpFrame &frame, uint64_t self) {
+    if (frame.flame_node == FLAME_NODE_NULL) {
+      return;
+    }
+    auto &node = _thread_trie->nodes[frame.flame_node];
+    ++node.count;
+    node.self += self;
+  }
+
+  // Merge all thread tries and write collapsed stacks, threads must not record during the write
+  void write();
+
+  // Get the singleton instance
+  static FlameGraph &instance();
+
+ public:
+  const static uint32_t FLAME_NODE_NULL = UINT32_MAX;
+
+ private:
+  struct Node {
+    // FLAME_NODE_NULL for roots
+    uint32_t parent;
+    // NAME_ID_NULL for roots
+    uint32_t name_id;
+    // Python call path of roots
+    uint64_t callpath_id = 0;
+    uint64_t count = 0;
+    uint64_t self = 0;
+  };
+
+  struct Trie {
+    std::vector<Node> nodes;
+    // <parent node, name id> to child node
+    std::unordered_map<uint64_t, uint32_t> children;
+    // Python call path to root node
+    std::unordered_map<uint64_t, uint32_t> roots;
+  };
+
+  FlameGraph() {}
+
+  uint32_t root(Trie &trie);
+
+  Trie *register_thread_trie();
+
+ private:
+  std::atomic<bool> _enabled{false};
+  torch_monitor_flame_graph_metric_t _metric = TORCH_MONITOR_FLAME_GRAPH_METRIC_SELF_TIME;
+  size_t _max_num_states = 0;
+  FILE *_file = nullptr;
+  std::mutex _mutex;
+  std::vector<std::shared_ptr<Trie>> _tries;
+
+  static inline thread_local std::shared_ptr<Trie> _thread_trie;
+};
+
+}  // namespace torch_monitor
+
+#endif  // TORCH_MONITOR_FLAME_GRAPH_H
@@ -0,0 +1,78 @@
+#ifndef TORCH_MONITOR_MEMORY_ANALYZER_H
+#define TORCH_MONITOR_MEMORY_ANALYZER_H
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "op_stats.h"
+#include "torch_monitor.h"
+
+namespace torch_monitor {
+
+// Summarizes allocator behavior of each device type for allocator tuning:
+// power-of-two size classes of requests, lifetimes of blocks, and a timeline of
+// allocated and reserved bytes whose resolution halves whenever it is full,
+// so the timeline covers the whole run with a bounded number of samples.
+class MemoryAnalyzer {
+ public:
+  void enable() { _enabled.store(true, std::memory_order_relaxed); }
+
+  bool is_enabled() const { return _enabled.load(std::memory_order_relaxed); }
+
+  // Record an allocation (size > 0) or a free (size < 0) with the allocator totals after it,
+  // events of device types without states (TORCH_MONITOR_DEVICE_TYPE_COUNT) are ignored
+  void record(torch_monitor_device_type_t device_type, const void *ptr, int64_t size,
+              int64_t total_allocated, int64_t total_reserved, uint64_t timestamp);
+
+  void summary(torch_monitor_device_type_t device_type, torch_monitor_memory_summary_t *summary);
+
+  // Copy up to max_num_samples samples in time order and return the number of samples
+  size_t timeline(torch_monitor_device_type_t device_type, size_t max_num_samples,
+                  torch_monitor_memory_sample_t *samples);
+
+  // Get the singleton instance
+  static MemoryAnalyzer &instance();
+
+ public:
+  // Samples are merged pairwise once the timeline holds MEMORY_TIMELINE_MAX_SAMPLES samples
+  const static size_t MEMORY_TIMELINE_MAX_SAMPLES = 1024;
+  const static uint64_t MEMORY_TIMELINE_MIN_INTERVAL_NS = 1000000;
+
+ private:
+  struct DeviceState {
+    std::mutex mutex;
+    uint64_t alloc_count = 0;
+    uint64_t free_count = 0;
+    uint64_t size_class_counts[TORCH_MONITOR_SIZE_CLASS_COUNT] = {};
+    uint64_t size_class_bytes[TORCH_MONITOR_SIZE_CLASS_COUNT] = {};
+    uint64_t lifetime_count = 0;
+    OpLatency::Distribution lifetime;
+    // Allocation timestamps of live blocks
+    std::unordered_map<const void *, uint64_t> live;
+    int64_t max_allocated = 0;
+    int64_t max_reserved = 0;
+    int64_t max_gap = 0;
+    // Nanoseconds of the first event
+    uint64_t start = 0;
+    uint64_t interval = MEMORY_TIMELINE_MIN_INTERVAL_NS;
+    // Sample i covers [start + i * interval, start + (i + 1) * interval)
+    std::vector<torch_monitor_memory_sample_t> samples;
+  };
+
+  MemoryAnalyzer() {}
+
+  static size_t size_class(uint64_t size) { return size == 0 ? 0 : 63 - __builtin_clzll(size); }
+
+  void sample(DeviceState &state, uint64_t ns, int64_t total_allocated, int64_t total_reserved);
+
+ private:
+  std::atomic<bool> _enabled{false};
+  DeviceState _states[TORCH_MONITOR_DEVICE_TYPE_COUNT];
+};
+
+}  // namespace torch_monitor
+
+#endif  // TORCH_MONITOR_MEMORY_ANALYZER_H
@@ -0,0 +1,149 @@
+#ifndef TORCH_MONITOR_MEMORY_COALESCER_H
+#define TORCH_MONITOR_MEMORY_COALESCER_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "op_stack.h"
+#include "torch_monitor.h"
+
+namespace torch_monitor {
+
+// An allocation event deferred until it is freed or escapes its innermost op
+struct PendingAllocation {
+  torch_monitor_callback_data_t callback_data;
+  // Nested level of the innermost op at the allocation
+  uint32_t level;
+  uint32_t name_id;
+  uint32_t master_name_id;
+};
+
+// Folds allocations freed inside the op that allocated them into transient counters.
+// Allocations made inside ops are kept pending on the allocating thread;
+// allocations still pending when their innermost op exits escape and are delivered.
+// Pending allocations are only folded by frees on the same thread.
+// Each thread keeps a private pending list, lists are flushed at finalize.
+class MemoryCoalescer {
+ public:
+  void enable() { _enabled.store(true, std::memory_order_relaxed); }
+
+  bool is_enabled() const { return _enabled.load(std::memory_order_relaxed); }
+
+  // Deliver allocations deferred before the callbacks were re-attached with func,
+  // their ops may have exited while detached so they can no longer escape
+  template <typename Func>
+  void sync(uint32_t epoch, Func &&func) {
+    auto *state = _thread_state.get();
+    if (state != nullptr && state->epoch != epoch) {
+      state->epoch = epoch;
+      for (auto &allocation : state->allocations) {
+        func(allocation);
+      }
+      state->allocations.clear();
+    }
+  }
+
+  // Defer an allocation made inside the innermost op of op_stack, after sync
+  // true: the allocation is pending
+  // false: no op is active or too many allocations are pending
+  bool defer(const torch_monitor_callback_data_t &callback_data, OpStack &op_stack,
+             uint32_t epoch) {
+    auto *innermost = op_stack.top();
+    if (innermost == nullptr) {
+      return false;
+    }
+    auto *state = _thread_state.get();
+    if (state == nullptr) {
+      state = register_thread_state(epoch);
+    }
+    auto &pending = state->allocations;
+    if (pending.size() == MEMORY_COALESCER_MAX_PENDING) {
+      return false;
+    }
+    pending.push_back(PendingAllocation{callback_data, op_stack.depth() - 1, innermost->name_id,
+                                        op_stack.bottom()->name_id});
+    return true;
+  }
+
+  // Remove the pending allocation of ptr, after sync
+  // true: the allocation was pending and is copied to allocation
+  // false: the allocation is not pending on this thread
+  bool fold(const void *ptr, PendingAllocation &allocation) {
+    auto *state = _thread_state.get();
+    if (state == nullptr) {
+      return false;
+    }
+    auto &pending = state->allocations;
+    // Temporaries are usually freed in reverse order
+    for (size_t i = pending.size(); i > 0; --i) {
+      if (pending[i - 1].callback_data.data.mem_data.ptr == ptr) {
+        allocation = pending[i - 1];
+        pending.erase(pending.begin() + (i - 1));
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Remove allocations that escape the op exiting at nested level, oldest first, after sync
+  template <typename Func>
+  void escape(uint32_t level, Func &&func) {
+    auto *state = _thread_state.get();
+    if (state == nullptr) {
+      return;
+    }
+    auto &pending = state->allocations;
+    // Allocations of exited ops have been removed, so levels never decrease
+    auto first = pending.size();
+    while (first > 0 && pending[first - 1].level >= level) {
+      --first;
+    }
+    for (auto i = first; i < pending.size(); ++i) {
+      func(pending[i]);
+    }
+    pending.resize(first);
+  }
+
+  // Deliver the pending allocations of all threads with func,
+  // threads must not allocate during the flush
+  template <typename Func>
+  void flush(Func &&func) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (auto &state : _states) {
+      for (auto &allocation : state->allocations) {
+        func(allocation);
+      }
+      state->allocations.clear();
+    }
+  }
+
+  // Get the singleton instance
+  static MemoryCoalescer &instance();
+
+ public:
+  const static size_t MEMORY_COALESCER_MAX_PENDING = 1024;
+
+ private:
+  struct PendingState {
+    uint32_t epoch = 0;
+    std::vector<PendingAllocation> allocations;
+  };
+
+  MemoryCoalescer() {}
+
+  PendingState *register_thread_state(uint32_t epoch);
+
+ private:
+  std::atomic<bool> _enabled{false};
+  std::mutex _mutex;
+  std::vector<std::shared_ptr<PendingState>> _states;
+
+  static inline thread_local std::shared_ptr<PendingState> _thread_state;
+};
+
+}  // namespace torch_monitor
+
+#endif  // TORCH_MONITOR_MEMORY_COALESCER_H
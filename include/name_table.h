@@ -0,0 +1,80 @@
+#ifndef TORCH_MONITOR_NAME_TABLE_H
+#define TORCH_MONITOR_NAME_TABLE_H
+
+#include <array>
+#include <atomic>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "torch_monitor.h"
+
+namespace torch_monitor {
+
+// Interns op names into dense ids.
+// Each thread first probes a small direct-mapped cache keyed by the name pointer,
+// only misses take the global lock. Lookups by id never lock.
+class NameTable {
+ public:
+  // Return the id of name, interning it on the first occurrence
+  uint32_t intern(const char *name) {
+    if (name == nullptr) {
+      return NAME_ID_NULL;
+    }
+    auto &entry = _cache[(reinterpret_cast<uintptr_t>(name) >> 3) & (NAME_CACHE_SIZE - 1)];
+    // A pointer can be reused by a different name, e.g., user scopes with temporary strings
+    if (entry.name == name && strcmp(entry.interned_name, name) == 0) {
+      return entry.id;
+    }
+    entry.id = intern_slow(name, &entry.interned_name);
+    entry.name = name;
+    return entry.id;
+  }
+
+  // Return the interned name of id or nullptr if id is not assigned
+  const char *lookup(uint32_t id) const {
+    if (id >= _size.load(std::memory_order_acquire)) {
+      return nullptr;
+    }
+    return _pages[id / NAME_PAGE_SIZE].load(std::memory_order_relaxed)[id % NAME_PAGE_SIZE];
+  }
+
+  // Number of assigned ids, including NAME_ID_NULL
+  uint32_t size() const { return _size.load(std::memory_order_acquire); }
+
+  // Get the singleton instance
+  static NameTable &instance();
+
+ public:
+  // Reserved for events without a name, maps to ""
+  const static uint32_t NAME_ID_NULL = 0;
+  const static size_t NAME_PAGE_SIZE = 4096;
+  const static size_t NAME_MAX_PAGES = 1024;
+  const static size_t NAME_CACHE_SIZE = 1024;
+
+ private:
+  // Zero-initialized as thread local storage
+  struct CacheEntry {
+    const char *name;
+    const char *interned_name;
+    uint32_t id;
+  };
+
+  NameTable();
+
+  uint32_t intern_slow(const char *name, const char **interned_name);
+
+ private:
+  std::mutex _mutex;
+  std::unordered_map<std::string, uint32_t> _ids;
+  // Pages are never freed so that lookups are safe without the lock
+  std::array<std::atomic<const char **>, NAME_MAX_PAGES> _pages = {};
+  std::atomic<uint32_t> _size{0};
+
+  static inline thread_local CacheEntry _cache[NAME_CACHE_SIZE];
+};
+
+}  // namespace torch_monitor
+
+#endif  // TORCH_MONITOR_NAME_TABLE_H
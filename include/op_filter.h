@@ -0,0 +1,73 @@
+#ifndef TORCH_MONITOR_OP_FILTER_H
+#define TORCH_MONITOR_OP_FILTER_H
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "torch_monitor.h"
+
+namespace torch_monitor {
+
+// Filters ops by name with glob patterns, where '*' matches any string and '?' any character.
+// An op passes if it matches an allow pattern, or if there is no allow pattern,
+// and it matches no deny pattern.
+// Patterns are fixed once profiling starts, so the verdict of each name id is evaluated once
+// and cached in pages indexed by name id. Filtered ops then only cost a lookup.
+class OpFilter {
+ public:
+  // true: the pattern is added
+  // false: the pattern is empty or profiling has started
+  bool add(const char *pattern, torch_monitor_op_filter_mode_t mode);
+
+  // Freeze the patterns and evaluate the names interned so far when profiling starts
+  void seal();
+
+  bool is_enabled() const { return _enabled.load(std::memory_order_relaxed); }
+
+  // true: the op is delivered
+  // false: the op is filtered
+  bool pass(uint32_t name_id) {
+    auto *page = _pages[name_id / OP_FILTER_PAGE_SIZE].load(std::memory_order_acquire);
+    if (page != nullptr) {
+      auto verdict = page[name_id % OP_FILTER_PAGE_SIZE].load(std::memory_order_relaxed);
+      if (verdict != VERDICT_UNKNOWN) {
+        return verdict == VERDICT_PASS;
+      }
+    }
+    return pass_slow(name_id);
+  }
+
+  // true: name matches the glob pattern
+  // false: name does not match
+  static bool match(const char *pattern, const char *name);
+
+  // Get the singleton instance
+  static OpFilter &instance();
+
+ public:
+  // Same paging as the name table
+  const static size_t OP_FILTER_PAGE_SIZE = 4096;
+  const static size_t OP_FILTER_MAX_PAGES = 1024;
+
+ private:
+  enum Verdict : uint8_t { VERDICT_UNKNOWN = 0, VERDICT_PASS = 1, VERDICT_FILTER = 2 };
+
+  OpFilter() {}
+
+  bool pass_slow(uint32_t name_id);
+
+ private:
+  std::atomic<bool> _enabled{false};
+  bool _sealed = false;
+  std::vector<std::string> _allow_patterns;
+  std::vector<std::string> _deny_patterns;
+  std::mutex _mutex;
+  std::atomic<std::atomic<uint8_t> *> _pages[OP_FILTER_MAX_PAGES] = {};
+};
+
+}  // namespace torch_monitor
+
+#endif  // TORCH_MONITOR_OP_FILTER_H
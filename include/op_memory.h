@@ -0,0 +1,129 @@
+#ifndef TORCH_MONITOR_OP_MEMORY_H
+#define TORCH_MONITOR_OP_MEMORY_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "name_table.h"
+#include "op_stack.h"
+#include "torch_monitor.h"
+
+namespace torch_monitor {
+
+// Memory events charged to one op name
+struct OpMemoryCounters {
+  uint64_t alloc_count = 0;
+  uint64_t alloc_bytes = 0;
+  uint64_t free_count = 0;
+  uint64_t free_bytes = 0;
+  // Allocations freed inside the op that allocated them, folded by the memory coalescer
+  uint64_t transient_count = 0;
+  uint64_t transient_bytes = 0;
+
+  void record(int64_t size) {
+    if (size >= 0) {
+      ++alloc_count;
+      alloc_bytes += size;
+    } else {
+      ++free_count;
+      free_bytes += -size;
+    }
+  }
+
+  void merge(const OpMemoryCounters &other) {
+    alloc_count += other.alloc_count;
+    alloc_bytes += other.alloc_bytes;
+    free_count += other.free_count;
+    free_bytes += other.free_bytes;
+    transient_count += other.transient_count;
+    transient_bytes += other.transient_bytes;
+  }
+};
+
+struct OpMemory {
+  // Events while the op is the innermost active op
+  OpMemoryCounters innermost;
+  // Events while the op is the active op of nested level 0
+  OpMemoryCounters master;
+};
+
+// Attributes memory events to the active ops on the shadow stack of the reporting thread.
+// Events outside any op are charged to NAME_ID_NULL.
+// Each thread updates a private table indexed by name id, tables are merged at finalize.
+class OpMemoryEngine {
+ public:
+  void enable() { _enabled.store(true, std::memory_order_relaxed); }
+
+  bool is_enabled() const { return _enabled.load(std::memory_order_relaxed); }
+
+  // Charge an allocation (size > 0) or a free (size < 0) to the active ops
+  void record(OpStack &op_stack, int64_t size) {
+    auto *table = _thread_table.get();
+    if (table == nullptr) {
+      table = register_thread_table();
+    }
+
+    auto *innermost = op_stack.top();
+    auto *master = op_stack.bottom();
+    auto &innermost_memory = lookup(*table, innermost != nullptr ? innermost->name_id : NameTable::NAME_ID_NULL);
+    innermost_memory.innermost.record(size);
+    auto &master_memory = lookup(*table, master != nullptr ? master->name_id : NameTable::NAME_ID_NULL);
+    master_memory.master.record(size);
+  }
+
+  // Charge an allocation freed inside the op that allocated it
+  void record_transient(uint32_t name_id, uint32_t master_name_id, uint64_t size) {
+    auto *table = _thread_table.get();
+    if (table == nullptr) {
+      table = register_thread_table();
+    }
+
+    auto &innermost_memory = lookup(*table, name_id);
+    ++innermost_memory.innermost.transient_count;
+    innermost_memory.innermost.transient_bytes += size;
+    auto &master_memory = lookup(*table, master_name_id);
+    ++master_memory.master.transient_count;
+    master_memory.master.transient_bytes += size;
+  }
+
+  // Merge all thread tables, threads must not record during the merge
+  void merge();
+
+  bool is_merged() const { return _merged; }
+
+  // Copy up to max_num_results merged results in name id order and return the number of results
+  size_t get(size_t max_num_results, torch_monitor_op_memory_t *results);
+
+  // Get the singleton instance
+  static OpMemoryEngine &instance();
+
+ private:
+  using OpMemoryTable = std::vector<OpMemory>;
+
+  OpMemoryEngine() {}
+
+  static OpMemory &lookup(OpMemoryTable &table, uint32_t name_id) {
+    if (name_id >= table.size()) {
+      table.resize(name_id + 1);
+    }
+    return table[name_id];
+  }
+
+  OpMemoryTable *register_thread_table();
+
+ private:
+  std::atomic<bool> _enabled{false};
+  bool _merged = false;
+  std::mutex _mutex;
+  std::vector<std::shared_ptr<OpMemoryTable>> _tables;
+  OpMemoryTable _merged_table;
+
+  static inline thread_local std::shared_ptr<OpMemoryTable> _thread_table;
+};
+
+}  // namespace torch_monitor
+
+#endif  // TORCH_MONITOR_OP_MEMORY_H
@@ -0,0 +1,113 @@
+#ifndef TORCH_MONITOR_OP_STACK_H
+#define TORCH_MONITOR_OP_STACK_H
+
+#include <atomic>
+#include <cstdint>
+
+#include "torch_monitor.h"
+
+namespace torch_monitor {
+
+// Per-op states kept between the enter and the exit callbacks
+struct OpFrame {
+  uint32_t name_id;
+  // The op is delivered to subscribers
+  bool sampled;
+  // Number of ops represented by this op if it is sampled
+  double weight;
+  // Input signature captured at enter
+  uint32_t signature_id;
+  // Python call path captured at enter by the cost model
+  uint64_t callpath_id;
+  // Enter timestamp
+  uint64_t timestamp;
+  // Inclusive time of nested ops
+  uint64_t children_time;
+  // Node of the op stack in the flame graph trie of the thread
+  uint32_t flame_node;
+  // Key of the forward/backward correlation
+  uint64_t forward_thread_id;
+  int64_t sequence_number;
+  torch_monitor_forward_op_t forward_op;
+};
+
+// A shadow stack of active ops on each thread.
+// The depth before a push is the nested level of an op.
+class OpStack {
+ public:
+  // Return nullptr if the stack is deeper than OP_STACK_MAX_DEPTH, the depth is still tracked
+  OpFrame *push() {
+    auto level = _depth++;
+    return level < OP_STACK_MAX_DEPTH ? &_frames[level] : nullptr;
+  }
+
+  // Push an op that is visible to signal handlers of this thread once it is pushed.
+  // Return nullptr if the stack is deeper than OP_STACK_MAX_DEPTH, the depth is still tracked
+  OpFrame *push(uint32_t name_id, uint64_t callpath_id) {
+    auto level = _depth;
+    OpFrame *frame = nullptr;
+    if (level < OP_STACK_MAX_DEPTH) {
+      frame = &_frames[level];
+      frame->name_id = name_id;
+      frame->callpath_id = callpath_id;
+    }
+    std::atomic_signal_fence(std::memory_order_release);
+    _depth = level + 1;
+    return frame;
+  }
+
+  // Return nullptr if the stack is empty or deeper than OP_STACK_MAX_DEPTH
+  OpFrame *pop() {
+    if (_depth == 0) {
+      return nullptr;
+    }
+    auto level = --_depth;
+    return level < OP_STACK_MAX_DEPTH ? &_frames[level] : nullptr;
+  }
+
+  uint32_t depth() const { return _depth; }
+
+  // Return the innermost active op or nullptr
+  OpFrame *top() {
+    return _depth != 0 && _depth <= OP_STACK_MAX_DEPTH ? &_frames[_depth - 1] : nullptr;
+  }
+
+  // Return the active op of nested level, level must be below depth and OP_STACK_MAX_DEPTH
+  const OpFrame &frame(uint32_t level) const { return _frames[level]; }
+
+  // Return the op enclosing the innermost active op or nullptr
+  OpFrame *parent() {
+    return _depth > 1 && _depth <= OP_STACK_MAX_DEPTH + 1 ? &_frames[_depth - 2] : nullptr;
+  }
+
+  // Return the active op of nested level 0 or nullptr
+  OpFrame *bottom() { return _depth != 0 ? &_frames[0] : nullptr; }
+
+  // Discard all frames if the stack was built before the callbacks were re-attached
+  void sync(uint32_t epoch) {
+    if (_epoch != epoch) {
+      _epoch = epoch;
+      _depth = 0;
+    }
+  }
+
+  // Get the stack of the calling thread
+  static OpStack &current() { return _stack; }
+
+ public:
+  const static uint32_t OP_STACK_MAX_DEPTH = 256;
+
+ private:
+  uint32_t _depth;
+  uint32_t _epoch;
+  OpFrame _frames[OP_STACK_MAX_DEPTH];
+
+  // Zero-initialized for each thread
+  static thread_local OpStack _stack;
+};
+
+inline thread_local OpStack OpStack::_stack;
+
+}  // namespace torch_monitor
+
+#endif  // TORCH_MONITOR_OP_STACK_H
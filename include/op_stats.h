@@ -0,0 +1,148 @@
+#ifndef TORCH_MONITOR_OP_STATS_H
+#define TORCH_MONITOR_OP_STATS_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "op_stack.h"
+#include "torch_monitor.h"
+
+namespace torch_monitor {
+
+// Log-linear histogram of durations.
+// Values below 2^LATENCY_SUB_BITS have exact buckets, larger values have
+// 2^LATENCY_SUB_BITS linear buckets per power of two, so the relative error is below 12.5%.
+class LatencyHistogram {
+ public:
+  void record(uint64_t value) { ++_counts[bucket(value)]; }
+
+  void merge(const LatencyHistogram &other) {
+    for (size_t i = 0; i < LATENCY_NUM_BUCKETS; ++i) {
+      _counts[i] += other._counts[i];
+    }
+  }
+
+  // Return the middle of the bucket that holds quantile q of count values
+  uint64_t quantile(double q, uint64_t count) const;
+
+ public:
+  const static size_t LATENCY_SUB_BITS = 3;
+  const static size_t LATENCY_SUB_BUCKETS = 1 << LATENCY_SUB_BITS;
+  // Values of 2^LATENCY_MAX_EXPONENT and above share the last buckets
+  const static size_t LATENCY_MAX_EXPONENT = 47;
+  const static size_t LATENCY_NUM_BUCKETS =
+      (LATENCY_MAX_EXPONENT - LATENCY_SUB_BITS + 2) * LATENCY_SUB_BUCKETS;
+
+ private:
+  static size_t bucket(uint64_t value) {
+    if (value < LATENCY_SUB_BUCKETS) {
+      return value;
+    }
+    size_t exponent = 63 - __builtin_clzll(value);
+    if (exponent > LATENCY_MAX_EXPONENT) {
+      return LATENCY_NUM_BUCKETS - 1;
+    }
+    size_t sub_bucket = (value >> (exponent - LATENCY_SUB_BITS)) & (LATENCY_SUB_BUCKETS - 1);
+    return (exponent - LATENCY_SUB_BITS + 1) * LATENCY_SUB_BUCKETS + sub_bucket;
+  }
+
+ private:
+  uint64_t _counts[LATENCY_NUM_BUCKETS] = {};
+};
+
+// Latency distribution of one op name
+struct OpLatency {
+  struct Distribution {
+    uint64_t total = 0;
+    uint64_t min = UINT64_MAX;
+    uint64_t max = 0;
+    LatencyHistogram histogram;
+
+    void record(uint64_t value) {
+      total += value;
+      min = std::min(min, value);
+      max = std::max(max, value);
+      histogram.record(value);
+    }
+
+    void merge(const Distribution &other) {
+      total += other.total;
+      min = std::min(min, other.min);
+      max = std::max(max, other.max);
+      histogram.merge(other.histogram);
+    }
+  };
+
+  uint64_t count = 0;
+  // Time including nested ops
+  Distribution inclusive;
+  // Time excluding nested ops
+  Distribution self;
+};
+
+// Convert a distribution of count durations in timer ticks to nanosecond statistics
+void copy_latency_stats(const OpLatency::Distribution &distribution, uint64_t count,
+                        torch_monitor_latency_stats_t &stats);
+
+// Aggregates enter/exit pairs into per-op latency histograms.
+// Each thread updates a private table indexed by name id,
+// tables are merged at finalize.
+class OpStatsEngine {
+ public:
+  void enable() { _enabled.store(true, std::memory_order_relaxed); }
+
+  bool is_enabled() const { return _enabled.load(std::memory_order_relaxed); }
+
+  // Record an op whose inclusive and self durations are in timer ticks
+  void record(uint32_t name_id, uint64_t inclusive, uint64_t self) {
+    auto *table = _thread_table.get();
+    if (table == nullptr) {
+      table = register_thread_table();
+    }
+    if (name_id >= table->size()) {
+      table->resize(name_id + 1);
+    }
+    auto &latency = (*table)[name_id];
+    if (latency == nullptr) {
+      latency = std::make_unique<OpLatency>();
+    }
+    ++latency->count;
+    latency->inclusive.record(inclusive);
+    latency->self.record(self);
+  }
+
+  // Merge all thread tables, threads must not record during the merge
+  void merge();
+
+  bool is_merged() const { return _merged; }
+
+  // Copy up to max_num_stats merged results in name id order and return the number of results
+  size_t get(size_t max_num_stats, torch_monitor_op_stats_t *stats);
+
+  // Get the singleton instance
+  static OpStatsEngine &instance();
+
+ private:
+  using OpLatencyTable = std::vector<std::unique_ptr<OpLatency>>;
+
+  OpStatsEngine() {}
+
+  OpLatencyTable *register_thread_table();
+
+ private:
+  std::atomic<bool> _enabled{false};
+  bool _merged = false;
+  std::mutex _mutex;
+  std::vector<std::shared_ptr<OpLatencyTable>> _tables;
+  OpLatencyTable _merged_table;
+
+  static inline thread_local std::shared_ptr<OpLatencyTable> _thread_table;
+};
+
+}  // namespace torch_monitor
+
+#endif  // TORCH_MONITOR_OP_STATS_H
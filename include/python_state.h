@@ -3,7 +3,11 @@
 
 #include <Python.h>
 
+#include <cstdint>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "torch_monitor.h"
@@ -11,13 +15,14 @@
 namespace torch_monitor {
 
 struct PythonState {
-  std::string file_name;
-  std::string function_name;
+  // Interned strings owned by PythonStateMonitor
+  const char *file_name;
+  const char *function_name;
   size_t function_first_lineno;
   size_t lineno;
 
-  PythonState(const std::string &file_name, const std::string &function_name,
-              size_t function_first_lineno, size_t lineno)
+  PythonState(const char *file_name, const char *function_name, size_t function_first_lineno,
+              size_t lineno)
       : file_name(file_name),
         function_name(function_name),
         function_first_lineno(function_first_lineno),
@@ -26,22 +31,113 @@ struct PythonState {
 
 class PythonStateMonitor {
  public:
-  // Return the current python states with a query or using the previous cached states
-  std::vector<PythonState> &get_states(bool cached = false);
+  // Return the current python states with a query or using the previous cached states.
+  // Only the innermost max_depth frames are collected.
+  std::vector<PythonState> &get_states(bool cached = false, size_t max_depth = SIZE_MAX);
+
+  // Return the calling context tree node of the innermost max_depth frames.
+  // CALLPATH_ID_NULL means there is no python frame.
+  // The previous id of the calling thread is reused if its frames are unchanged.
+  uint64_t get_callpath_id(size_t max_depth = SIZE_MAX);
+
+  // Return the call path id of the last query on the calling thread without a new query
+  uint64_t last_callpath_id() const { return _cache.callpath_id; }
+
+  // Expand a call path into up to max_num_states states, from the innermost frame.
+  // Return the number of states.
+  size_t expand_callpath(uint64_t callpath_id, size_t max_num_states,
+                         torch_monitor_python_state_t *states);
+
+  // true: callpath_id is a node of the calling context tree
+  // false: callpath_id is not assigned
+  bool has_callpath(uint64_t callpath_id);
 
   // Get the singleton instance
   static PythonStateMonitor &instance();
 
+ public:
+  // The root of the calling context tree
+  const static uint64_t CALLPATH_ID_NULL = 0;
+
  private:
-  PythonStateMonitor() {}
+  // File and function names are interned once per code object
+  struct CodeInfo {
+    std::string file_name;
+    std::string function_name;
+    size_t function_first_lineno;
+  };
+
+  struct CallPathNode {
+    uint64_t parent;
+    const CodeInfo *code_info;
+    size_t lineno;
+  };
+
+  // A child of a calling context tree node
+  struct CallPathKey {
+    uint64_t parent;
+    PyCodeObject *code;
+    size_t lineno;
+
+    bool operator==(const CallPathKey &other) const {
+      return parent == other.parent && code == other.code && lineno == other.lineno;
+    }
+  };
+
+  struct CallPathKeyHash {
+    size_t operator()(const CallPathKey &key) const {
+      auto hash = std::hash<uint64_t>()(key.parent);
+      hash ^= std::hash<const void *>()(key.code) + 0x9e3779b97f4a7c15ull + (hash << 6) + (hash >> 2);
+      hash ^= std::hash<size_t>()(key.lineno) + 0x9e3779b97f4a7c15ull + (hash << 6) + (hash >> 2);
+      return hash;
+    }
+  };
+
+  // A python frame collected while holding the GIL
+  struct Frame {
+    PyCodeObject *code;
+    size_t lineno;
+  };
+
+  // The last query of a thread.
+  // Frame objects are not referenced and their memory is reused by other calls,
+  // so the call path is reused only if every walked frame has the same code and line.
+  struct CallPathCache {
+    bool valid;
+    size_t max_depth;
+    uint64_t callpath_id;
+  };
+
+  PythonStateMonitor();
 
   std::string unpack_pyobject(PyObject *obj);
 
+  // The GIL must be held
+  // true: the frames starting from frame match the last query
+  // false: the call path must be collected again
+  bool match_cache(PyFrameObject *frame, size_t max_depth);
+
+  // The GIL must be held
+  const CodeInfo *intern_code(PyCodeObject *code);
+
  private:
+  // Protects the calling context tree and the code table
+  std::mutex _mutex;
+  std::vector<CallPathNode> _nodes;
+  std::unordered_map<CallPathKey, uint64_t, CallPathKeyHash> _children;
+  // Code objects are pinned so that their addresses are never reused
+  std::unordered_map<PyCodeObject *, std::unique_ptr<CodeInfo>> _code_infos;
+
   // Cached states for each thread
   static inline thread_local std::vector<PythonState> _states;
+  // The call path id of _states
+  static inline thread_local uint64_t _states_callpath_id = CALLPATH_ID_NULL;
+  // The last query of each thread, zero-initialized
+  static inline thread_local CallPathCache _cache;
+  // Frames of the last query, from the innermost frame
+  static inline thread_local std::vector<Frame> _frames;
 };
 
 }  // namespace torch_monitor
 
-#endif  // TORCH_MONITOR_PYTHON_STATE_H
\ No newline at end of file
+#endif  // TORCH_MONITOR_PYTHON_STATE_H
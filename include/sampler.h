@@ -0,0 +1,165 @@
+#ifndef TORCH_MONITOR_SAMPLER_H
+#define TORCH_MONITOR_SAMPLER_H
+
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+
+#include "torch_monitor.h"
+
+namespace torch_monitor {
+
+// Per-domain statistical sampler.
+// Each thread counts down a geometrically distributed number of events between samples,
+// so every event is sampled with probability rate independently and a sample stands
+// for 1 / rate events.
+class DomainSampler {
+ public:
+  // true: set success
+  // false: rate is not in (0, 1]
+  bool set_rate(torch_monitor_domain_t domain, double rate);
+
+  double rate(torch_monitor_domain_t domain) const {
+    return _rates[domain].load(std::memory_order_relaxed);
+  }
+
+  // true: the event is sampled and weight is set
+  // false: the event is skipped
+  bool sample(torch_monitor_domain_t domain, double &weight) {
+    auto rate = this->rate(domain);
+    if (rate >= 1.0) {
+      weight = 1.0;
+      return true;
+    }
+
+    auto &countdown = _countdowns[domain];
+    if (!countdown.initialized) {
+      countdown.initialized = true;
+      countdown.skip = next_skip(rate);
+    }
+    if (countdown.skip != 0) {
+      --countdown.skip;
+      return false;
+    }
+    countdown.skip = next_skip(rate);
+    weight = 1.0 / rate;
+    return true;
+  }
+
+  // Get the singleton instance
+  static DomainSampler &instance();
+
+ private:
+  struct Countdown {
+    bool initialized;
+    // Number of events to skip before the next sample
+    uint64_t skip;
+  };
+
+  DomainSampler();
+
+  // Number of failures before the next success of a Bernoulli(rate) process
+  static uint64_t next_skip(double rate) {
+    // xorshift64*, seeded per thread
+    if (_random_state == 0) {
+      _random_state = reinterpret_cast<uintptr_t>(&_random_state) | 1;
+    }
+    _random_state ^= _random_state >> 12;
+    _random_state ^= _random_state << 25;
+    _random_state ^= _random_state >> 27;
+    auto bits = (_random_state * 0x2545f4914f6cdd1dull) >> 11;
+    // Uniform in (0, 1]
+    double uniform = (bits + 1) * (1.0 / 9007199254740992.0);
+    return static_cast<uint64_t>(std::log(uniform) / std::log1p(-rate));
+  }
+
+ private:
+  std::atomic<double> _rates[TORCH_MONITOR_DOMAIN_COUNT];
+
+  // Zero-initialized for each thread
+  static inline thread_local Countdown _countdowns[TORCH_MONITOR_DOMAIN_COUNT];
+  static inline thread_local uint64_t _random_state;
+};
+
+// Per-<op name, nested level> rate limiter.
+// The first threshold ops of a key are all sampled. After that, the sampling period doubles
+// each time the count of the key doubles, so a hot key emits O(log count) samples per
+// threshold while a sample stands for the ops of its period.
+// Each thread counts keys in a small direct-mapped table, and a key that loses its
+// entry to another key starts over from full fidelity.
+class AdaptiveSampler {
+ public:
+  // true: enable success
+  // false: threshold is 0
+  bool enable(uint64_t threshold) {
+    if (threshold == 0) {
+      return false;
+    }
+    _threshold.store(threshold, std::memory_order_relaxed);
+    return true;
+  }
+
+  bool is_enabled() const { return _threshold.load(std::memory_order_relaxed) != 0; }
+
+  // true: the op is sampled and weight is set
+  // false: the op is skipped
+  bool sample(uint32_t name_id, uint32_t nested_level, double &weight) {
+    auto key = (static_cast<uint64_t>(name_id) << 32) | nested_level;
+    auto &counter = _counters[(key * 0x9e3779b97f4a7c15ull) >> (64 - ADAPTIVE_COUNTER_BITS)];
+    if (counter.key != key) {
+      counter.key = key;
+      counter.count = 0;
+    }
+    auto count = counter.count++;
+    auto threshold = _threshold.load(std::memory_order_relaxed);
+    if (count < threshold) {
+      weight = 1.0;
+      return true;
+    }
+    // Window k >= 1 spans [threshold << (k - 1), threshold << k) with period 2^k.
+    // Periods are aligned to the window start, and the last op of each period, or of a
+    // partial period at the window end, is sampled with the number of ops since the
+    // previous sample, so the weights of a completed period add up to its ops.
+    uint64_t k = 64 - __builtin_clzll(count / threshold);
+    auto window_start = threshold << (k - 1);
+    auto window_length = window_start;
+    auto shift = k;
+    if (shift > ADAPTIVE_MAX_PERIOD_SHIFT) {
+      shift = ADAPTIVE_MAX_PERIOD_SHIFT;
+    }
+    auto period = 1ull << shift;
+    auto offset = count - window_start;
+    auto phase = offset & (period - 1);
+    if (phase != period - 1 && offset != window_length - 1) {
+      return false;
+    }
+    weight = static_cast<double>(phase + 1);
+    return true;
+  }
+
+  // Get the singleton instance
+  static AdaptiveSampler &instance();
+
+ public:
+  const static size_t ADAPTIVE_COUNTER_BITS = 10;
+  const static uint64_t ADAPTIVE_MAX_PERIOD_SHIFT = 20;
+
+ private:
+  // Zero-initialized as thread local storage
+  struct Counter {
+    uint64_t key;
+    uint64_t count;
+  };
+
+  AdaptiveSampler() {}
+
+ private:
+  // 0 disables adaptive sampling
+  std::atomic<uint64_t> _threshold{0};
+
+  static inline thread_local Counter _counters[1 << ADAPTIVE_COUNTER_BITS];
+};
+
+}  // namespace torch_monitor
+
+#endif  // TORCH_MONITOR_SAMPLER_H
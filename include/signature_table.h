@@ -0,0 +1,102 @@
+#ifndef TORCH_MONITOR_SIGNATURE_TABLE_H
+#define TORCH_MONITOR_SIGNATURE_TABLE_H
+
+#include <array>
+#include <atomic>
+#include <cstring>
+#include <mutex>
+#include <unordered_map>
+
+#include "torch_monitor.h"
+#include "utils.h"
+
+namespace torch_monitor {
+
+// Interns input signatures of ops, i.e., shapes, strides and dtypes of tensors and
+// values of scalars, into dense ids.
+// A signature is encoded as 64-bit words into a per-thread scratch buffer and probed in a
+// per-thread direct-mapped cache keyed by its hash, so repeated signatures never allocate.
+// New signatures are copied into a per-thread bump-pointer arena and published under the lock.
+// Lookups by id never lock.
+class SignatureTable {
+ public:
+  // Inputs are only passed to the RecordFunction callback attached after enable
+  void enable() { _enabled.store(true, std::memory_order_relaxed); }
+
+  bool is_enabled() const { return _enabled.load(std::memory_order_relaxed); }
+
+  // Return the signature id of the inputs of fn, interning it on the first occurrence
+  uint32_t intern(const at::RecordFunction &fn);
+
+  // Decode up to max_num_inputs inputs of a signature, sizes and strides point into the table
+  // true: signature_id is assigned
+  // false: signature_id is invalid
+  bool lookup(uint32_t signature_id, size_t max_num_inputs, torch_monitor_input_t *inputs,
+              size_t *num_inputs) const;
+
+  // Number of assigned ids, including SIGNATURE_ID_NULL
+  uint32_t size() const { return _size.load(std::memory_order_acquire); }
+
+  // Get the singleton instance
+  static SignatureTable &instance();
+
+ public:
+  // Reserved for ops without captured inputs, maps to no inputs
+  const static uint32_t SIGNATURE_ID_NULL = 0;
+  // Inputs beyond the scratch buffer are not encoded
+  const static size_t SIGNATURE_MAX_WORDS = 1024;
+  const static size_t SIGNATURE_PAGE_SIZE = 4096;
+  const static size_t SIGNATURE_MAX_PAGES = 1024;
+  const static size_t SIGNATURE_CACHE_SIZE = 1024;
+  const static size_t SIGNATURE_ARENA_CHUNK_WORDS = 8192;
+
+ private:
+  // Zero-initialized as thread local storage
+  struct CacheEntry {
+    uint64_t hash;
+    uint32_t id;
+  };
+
+  // Records are never freed, even after the owning thread exits
+  struct Arena {
+    uint64_t *chunk;
+    size_t used;
+    size_t capacity;
+  };
+
+  SignatureTable();
+
+  // A record is the number of words followed by the words
+  const uint64_t *record(uint32_t signature_id) const {
+    return _pages[signature_id / SIGNATURE_PAGE_SIZE].load(
+        std::memory_order_relaxed)[signature_id % SIGNATURE_PAGE_SIZE];
+  }
+
+  static bool match(const uint64_t *record, const uint64_t *words, size_t num_words) {
+    return record[0] == num_words && memcmp(record + 1, words, num_words * sizeof(uint64_t)) == 0;
+  }
+
+  // Encode inputs of fn into _scratch and return the number of words
+  static size_t encode(const at::RecordFunction &fn);
+
+  uint32_t intern_slow(const uint64_t *words, size_t num_words, uint64_t hash);
+
+  // Copy a record into the arena of the calling thread
+  static const uint64_t *allocate_record(const uint64_t *words, size_t num_words);
+
+ private:
+  std::atomic<bool> _enabled{false};
+  std::mutex _mutex;
+  std::unordered_multimap<uint64_t, uint32_t> _ids;
+  // Pages are never freed so that lookups are safe without the lock
+  std::array<std::atomic<const uint64_t **>, SIGNATURE_MAX_PAGES> _pages = {};
+  std::atomic<uint32_t> _size{0};
+
+  static inline thread_local uint64_t _scratch[SIGNATURE_MAX_WORDS];
+  static inline thread_local CacheEntry _cache[SIGNATURE_CACHE_SIZE];
+  static inline thread_local Arena _arena;
+};
+
+}  // namespace torch_monitor
+
+#endif  // TORCH_MONITOR_SIGNATURE_TABLE_H
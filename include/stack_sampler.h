@@ -0,0 +1,146 @@
+#ifndef TORCH_MONITOR_STACK_SAMPLER_H
+#define TORCH_MONITOR_STACK_SAMPLER_H
+
+#include <signal.h>
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "op_stack.h"
+#include "torch_monitor.h"
+
+namespace torch_monitor {
+
+// A statistical op profiler.
+// Op callbacks only push and pop op names on the shadow stack of each thread.
+// An ITIMER_PROF timer raises SIGPROF on the thread that consumes CPU time, and the handler
+// copies the op stack of the interrupted thread into a lock-free per-thread ring.
+// Rings are drained by their threads at op enters and exits, by a drainer thread so that
+// long ops do not fill them, and at finalize.
+class StackSampler {
+ public:
+  // frequency: samples per second of CPU time
+  // max_num_states: depth of python call paths captured at ops of nested level 0, 0 means none
+  void enable(uint64_t frequency, size_t max_num_states) {
+    _frequency = frequency;
+    _max_num_states = max_num_states;
+    _enabled.store(true, std::memory_order_relaxed);
+  }
+
+  bool is_enabled() const { return _enabled.load(std::memory_order_relaxed); }
+
+  // Push an op on the stack of the calling thread
+  void enter(OpStack &op_stack, uint32_t name_id);
+
+  // Pop an op from the stack of the calling thread
+  void exit(OpStack &op_stack);
+
+  // Start the timer
+  // true: the timer is started
+  // false: the signal handler or the timer cannot be installed
+  bool start();
+
+  // Stop the timer and the drainer thread,
+  // the signal handler stays installed and ignores late signals
+  void stop();
+
+  // Drain all rings and merge all thread tables, threads must not run ops during the merge
+  void merge();
+
+  bool is_merged() const { return _merged; }
+
+  // Copy up to max_num_samples merged stacks and return the number of stacks
+  size_t get(size_t max_num_samples, torch_monitor_stack_sample_t *samples);
+
+  // Get the singleton instance
+  static StackSampler &instance();
+
+ public:
+  // Frames beyond STACK_SAMPLE_MAX_DEPTH are not sampled
+  const static uint32_t STACK_SAMPLE_MAX_DEPTH = 32;
+  // Must be a power of two
+  const static uint64_t STACK_SAMPLE_RING_SIZE = 256;
+  // Higher frequencies mostly measure the signal handler itself
+  const static uint64_t STACK_SAMPLE_MAX_FREQUENCY = 10000;
+
+ private:
+  struct StackSample {
+    uint64_t callpath_id;
+    uint32_t depth;
+    uint32_t name_ids[STACK_SAMPLE_MAX_DEPTH];
+  };
+
+  // <call path id low, call path id high, name ids from the outermost op>
+  using StackKey = std::vector<uint32_t>;
+
+  struct StackKeyHash {
+    size_t operator()(const StackKey &key) const {
+      uint64_t hash = key.size();
+      for (auto id : key) {
+        hash = (hash ^ id) * 0x9e3779b97f4a7c15ull;
+      }
+      return hash ^ (hash >> 32);
+    }
+  };
+
+  using StackTable = std::unordered_map<StackKey, uint64_t, StackKeyHash>;
+
+  // Written by the signal handler and read by the drainer
+  struct ThreadSamples {
+    OpStack *op_stack;
+    std::atomic<uint64_t> head{0};
+    std::atomic<uint64_t> tail{0};
+    StackSample ring[STACK_SAMPLE_RING_SIZE];
+    // Serializes the owner thread, the drainer thread and the merge, never taken by the handler
+    std::mutex mutex;
+    StackTable table;
+  };
+
+  StackSampler() {}
+
+  // The timer is stopped by torch_monitor_finalize, only the drainer of an
+  // unfinalized process is stopped here
+  ~StackSampler();
+
+  ThreadSamples *register_thread(OpStack &op_stack);
+
+  // Drain the ring of the calling thread if it is half full and no one else drains it
+  static void try_drain(ThreadSamples &samples);
+
+  // The mutex of samples must be held
+  static void drain(ThreadSamples &samples);
+
+  void run_drainer();
+
+  static void signal_handler(int signo, siginfo_t *info, void *context);
+
+ private:
+  std::atomic<bool> _enabled{false};
+  std::atomic<bool> _running{false};
+  std::thread _drainer;
+  uint64_t _frequency = 0;
+  size_t _max_num_states = 0;
+  bool _signal_installed = false;
+  // Samples of threads that never ran an op or whose ring is full
+  std::atomic<uint64_t> _num_unattributed{0};
+  std::atomic<uint64_t> _num_dropped{0};
+  bool _merged = false;
+  std::mutex _mutex;
+  std::vector<std::shared_ptr<ThreadSamples>> _threads;
+  std::map<StackKey, uint64_t> _merged_table;
+
+  // The signal handler must not call __tls_get_addr, which may allocate,
+  // so the only state it reads through TLS is a pointer in the static TLS block
+  static inline thread_local ThreadSamples *_thread_samples
+      __attribute__((tls_model("initial-exec"))) = nullptr;
+};
+
+}  // namespace torch_monitor
+
+#endif  // TORCH_MONITOR_STACK_SAMPLER_H
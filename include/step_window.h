@@ -0,0 +1,71 @@
+#ifndef TORCH_MONITOR_STEP_WINDOW_H
+#define TORCH_MONITOR_STEP_WINDOW_H
+
+#include <cstdint>
+#include <string>
+
+namespace torch_monitor {
+
+// Counts training steps and decides when the window of recorded steps opens and closes.
+// Steps end at torch_monitor_step or at the exits of marker ops of the user scope,
+// e.g., "Optimizer.step#SGD.step" recorded by torch.optim.
+// The first skip_steps steps are not recorded, then record_steps steps are recorded.
+// Callers serialize all methods.
+class StepWindow {
+ public:
+  enum Transition { TRANSITION_NONE = 0, TRANSITION_OPEN = 1, TRANSITION_CLOSE = 2 };
+
+  // record_steps: 0 records until torch_monitor_finalize
+  // marker: glob pattern of marker op names, nullptr counts torch_monitor_step only
+  void set(uint64_t skip_steps, uint64_t record_steps, const char *marker) {
+    _skip_steps = skip_steps;
+    _record_steps = record_steps;
+    _marker = marker == nullptr ? "" : marker;
+    _steps = 0;
+    _enabled = true;
+  }
+
+  bool is_enabled() const { return _enabled; }
+
+  bool has_marker() const { return _enabled && !_marker.empty(); }
+
+  // true: name is a marker op
+  // false: name is not a marker op
+  bool is_marker(const char *name) const;
+
+  // true: ops are recorded before the first step
+  // false: ops are recorded after skip_steps steps
+  bool is_open_at_start() const { return !_enabled || _skip_steps == 0; }
+
+  // End a step and return how the window changes
+  Transition step() {
+    if (!_enabled) {
+      return TRANSITION_NONE;
+    }
+    ++_steps;
+    if (_skip_steps != 0 && _steps == _skip_steps) {
+      return TRANSITION_OPEN;
+    }
+    if (_record_steps != 0 && _steps == _skip_steps + _record_steps) {
+      return TRANSITION_CLOSE;
+    }
+    return TRANSITION_NONE;
+  }
+
+  // Get the singleton instance
+  static StepWindow &instance();
+
+ private:
+  StepWindow() {}
+
+ private:
+  bool _enabled = false;
+  uint64_t _skip_steps = 0;
+  uint64_t _record_steps = 0;
+  uint64_t _steps = 0;
+  std::string _marker;
+};
+
+}  // namespace torch_monitor
+
+#endif  // TORCH_MONITOR_STEP_WINDOW_H
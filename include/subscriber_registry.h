@@ -0,0 +1,75 @@
+#ifndef TORCH_MONITOR_SUBSCRIBER_REGISTRY_H
+#define TORCH_MONITOR_SUBSCRIBER_REGISTRY_H
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "torch_monitor.h"
+
+namespace torch_monitor {
+
+// Subscribers and their domain masks.
+// Dispatch reads an immutable snapshot without locks. Writers copy the snapshot,
+// modify the copy, and publish it atomically. Retired snapshots may still be read
+// by dispatching threads, so they are kept until the process exits; registration
+// is rare and each snapshot is small.
+class SubscriberRegistry {
+ public:
+  // true: subscribe success
+  // false: func has been subscribed
+  bool subscribe(torch_monitor_callback_func_t func, uint64_t domain_mask);
+
+  // true: unsubscribe success
+  // false: func has not been subscribed
+  bool unsubscribe(torch_monitor_callback_func_t func);
+
+  // Remove all subscribers
+  void clear();
+
+  bool empty() const { return _snapshot.load(std::memory_order_acquire)->subscribers.empty(); }
+
+  bool has_subscriber(torch_monitor_domain_t domain) const {
+    return !_snapshot.load(std::memory_order_acquire)->domain_subscribers[domain].empty();
+  }
+
+  // Call subscribers interested in the domain of callback_data
+  void dispatch(torch_monitor_callback_site_t callback_site,
+                torch_monitor_callback_data_t *callback_data) const {
+    auto *snapshot = _snapshot.load(std::memory_order_acquire);
+    for (auto func : snapshot->domain_subscribers[callback_data->domain]) {
+      func(callback_site, callback_data);
+    }
+  }
+
+  // Get the singleton instance
+  static SubscriberRegistry &instance();
+
+ private:
+  struct Subscriber {
+    torch_monitor_callback_func_t func;
+    uint64_t domain_mask;
+  };
+
+  struct Snapshot {
+    std::vector<Subscriber> subscribers;
+    // Subscribers of each domain in subscription order
+    std::vector<torch_monitor_callback_func_t> domain_subscribers[TORCH_MONITOR_DOMAIN_COUNT];
+  };
+
+  SubscriberRegistry();
+
+  // Build and publish a snapshot, the caller must hold _mutex
+  void publish(std::vector<Subscriber> &&subscribers);
+
+ private:
+  // Serializes writers
+  std::mutex _mutex;
+  std::atomic<const Snapshot *> _snapshot;
+  std::vector<std::unique_ptr<Snapshot>> _snapshots;
+};
+
+}  // namespace torch_monitor
+
+#endif  // TORCH_MONITOR_SUBSCRIBER_REGISTRY_H
@@ -0,0 +1,70 @@
+#ifndef TORCH_MONITOR_TIMER_H
+#define TORCH_MONITOR_TIMER_H
+
+#include <cstdint>
+#include <ctime>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace torch_monitor {
+
+// Cheap monotonic timestamps.
+// Reads the invariant TSC if the CPU has one and converts ticks to CLOCK_MONOTONIC
+// nanoseconds with a ratio calibrated at construction. Otherwise timestamps are
+// CLOCK_MONOTONIC nanoseconds.
+class Timer {
+ public:
+  uint64_t now() const {
+#if defined(__x86_64__) || defined(__i386__)
+    if (_use_tsc) {
+      return __rdtsc();
+    }
+#endif
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+  }
+
+  // Convert a timestamp to CLOCK_MONOTONIC nanoseconds
+  uint64_t to_ns(uint64_t timestamp) const {
+    if (!_use_tsc) {
+      return timestamp;
+    }
+    // Ticks read on another core can be slightly earlier than the base
+    auto ticks = static_cast<int64_t>(timestamp - _base_ticks);
+    return _base_ns + static_cast<int64_t>(ticks * _ns_per_tick);
+  }
+
+  // Convert the difference of two timestamps to nanoseconds
+  uint64_t duration_to_ns(uint64_t duration) const {
+    return _use_tsc ? static_cast<uint64_t>(duration * _ns_per_tick) : duration;
+  }
+
+  bool use_tsc() const { return _use_tsc; }
+
+  // Get the singleton instance
+  static Timer &instance();
+
+ public:
+  // Time spent to measure the TSC frequency
+  const static uint64_t TIMER_CALIBRATION_NS = 10000000;
+
+ private:
+  Timer();
+
+  // true: the CPU has an invariant TSC
+  // false: the TSC cannot be used as a clock
+  static bool has_invariant_tsc();
+
+ private:
+  bool _use_tsc = false;
+  uint64_t _base_ticks = 0;
+  uint64_t _base_ns = 0;
+  double _ns_per_tick = 1.0;
+};
+
+}  // namespace torch_monitor
+
+#endif  // TORCH_MONITOR_TIMER_H
@@ -25,7 +25,34 @@ typedef enum torch_monitor_status {
   TORCH_MONITOR_STATUS_FINALIZE_NOT_INIT = 7,
   TORCH_MONITOR_STATUS_FINALIZE_MEMORY_FAIL = 8,
   TORCH_MONITOR_STATUS_PYTHON_STATES_NULL = 9,
-  TORCH_MONITOR_STATUS_COUNT = 10
+  TORCH_MONITOR_STATUS_RECORD_MODE_INVALID = 10,
+  TORCH_MONITOR_STATUS_TRACE_OPEN_FAIL = 11,
+  TORCH_MONITOR_STATUS_NAME_ID_INVALID = 12,
+  TORCH_MONITOR_STATUS_CALLPATH_ID_INVALID = 13,
+  TORCH_MONITOR_STATUS_SAMPLE_RATE_INVALID = 14,
+  TORCH_MONITOR_STATUS_UNSUBSCRIBE_NOT_EXIST = 15,
+  TORCH_MONITOR_STATUS_PAUSE_NOT_INIT = 16,
+  TORCH_MONITOR_STATUS_RESUME_NOT_INIT = 17,
+  TORCH_MONITOR_STATUS_OP_STATS_NOT_FINALIZE = 18,
+  TORCH_MONITOR_STATUS_BATCH_SIZE_INVALID = 19,
+  TORCH_MONITOR_STATUS_BATCH_SUBSCRIBE_FAIL = 20,
+  TORCH_MONITOR_STATUS_SIGNATURE_ID_INVALID = 21,
+  TORCH_MONITOR_STATUS_COST_MODEL_NOT_FINALIZE = 22,
+  TORCH_MONITOR_STATUS_DEVICE_TYPE_INVALID = 23,
+  TORCH_MONITOR_STATUS_OP_MEMORY_NOT_FINALIZE = 24,
+  TORCH_MONITOR_STATUS_SAMPLE_FREQUENCY_INVALID = 25,
+  TORCH_MONITOR_STATUS_STACK_SAMPLING_NOT_FINALIZE = 26,
+  TORCH_MONITOR_STATUS_FLAME_GRAPH_METRIC_INVALID = 27,
+  TORCH_MONITOR_STATUS_FLAME_GRAPH_OPEN_FAIL = 28,
+  TORCH_MONITOR_STATUS_OP_FILTER_INVALID = 29,
+  TORCH_MONITOR_STATUS_ADAPTIVE_THRESHOLD_INVALID = 30,
+  TORCH_MONITOR_STATUS_STEP_WINDOW_INVALID = 31,
+  TORCH_MONITOR_STATUS_STEP_NOT_INIT = 32,
+  TORCH_MONITOR_STATUS_TRACE_DEDUP_INVALID = 33,
+  TORCH_MONITOR_STATUS_INPUT_CAPTURE_INVALID = 34,
+  TORCH_MONITOR_STATUS_OP_STATS_INVALID = 35,
+  TORCH_MONITOR_STATUS_STACK_SAMPLING_INVALID = 36,
+  TORCH_MONITOR_STATUS_COUNT = 37
 } torch_monitor_status_t;
 
 /**
@@ -57,6 +84,13 @@ typedef enum torch_monitor_domain {
   TORCH_MONITOR_DOMAIN_COUNT = 11
 } torch_monitor_domain_t;
 
+/**
+ * @brief A bit mask of domains
+ *
+ */
+#define TORCH_MONITOR_DOMAIN_MASK(domain) (((uint64_t)1) << (domain))
+#define TORCH_MONITOR_DOMAIN_MASK_ALL (TORCH_MONITOR_DOMAIN_MASK(TORCH_MONITOR_DOMAIN_COUNT) - 1)
+
 /**
  * @brief Enter or exit a torch function
  *
@@ -67,6 +101,43 @@ typedef enum torch_monitor_callback_site {
   TORCH_MONITOR_CALLBACK_COUNT = 2
 } torch_monitor_callback_site_t;
 
+/**
+ * @brief Whether ops matching a filter pattern are delivered
+ *
+ */
+typedef enum torch_monitor_op_filter_mode {
+  // Only ops matching allow patterns are delivered if there is any allow pattern
+  TORCH_MONITOR_OP_FILTER_MODE_ALLOW = 0,
+  // Ops matching deny patterns are never delivered
+  TORCH_MONITOR_OP_FILTER_MODE_DENY = 1,
+  TORCH_MONITOR_OP_FILTER_MODE_COUNT = 2
+} torch_monitor_op_filter_mode_t;
+
+/**
+ * @brief Value of each collapsed stack in the flame graph
+ *
+ */
+typedef enum torch_monitor_flame_graph_metric {
+  // Nanoseconds spent in the innermost op of the stack, excluding nested ops
+  TORCH_MONITOR_FLAME_GRAPH_METRIC_SELF_TIME = 0,
+  // Number of calls of the innermost op of the stack
+  TORCH_MONITOR_FLAME_GRAPH_METRIC_CALLS = 1,
+  TORCH_MONITOR_FLAME_GRAPH_METRIC_COUNT = 2
+} torch_monitor_flame_graph_metric_t;
+
+/**
+ * @brief How callbacks are delivered to the subscriber
+ *
+ */
+typedef enum torch_monitor_record_mode {
+  // Call the subscriber on the PyTorch thread that runs the op
+  TORCH_MONITOR_RECORD_MODE_SYNC = 0,
+  // Copy events into per-thread ring buffers and call the subscriber on a background thread.
+  // Events are dropped instead of blocking the op when a buffer is full.
+  TORCH_MONITOR_RECORD_MODE_ASYNC = 1,
+  TORCH_MONITOR_RECORD_MODE_COUNT = 2
+} torch_monitor_record_mode_t;
+
 /**
  * @brief The device type of a memory or operation
  *
@@ -92,6 +163,20 @@ typedef enum torch_monitor_thread_state {
   TORCH_MONITOR_THREAD_STATE_INVALID = (0x1 << 5),
 } torch_monitor_thread_state_t;
 
+/**
+ * @brief A forward operation that backward operations are attributed to
+ *
+ */
+typedef struct torch_monitor_forward_op {
+  // A unique id of the forward operation, 0 means no forward operation
+  uint64_t correlation_id;
+  uint32_t name_id;
+  // Use torch_monitor_python_callpath_expand to get the python frames,
+  // 0 means the call path is not captured
+  uint64_t callpath_id;
+  uint64_t timestamp;
+} torch_monitor_forward_op_t;
+
 /**
  * @brief Information of each aten operation
  * The <forward_thread_id, sequence_number> pair records the
@@ -99,6 +184,7 @@ typedef enum torch_monitor_thread_state {
  * We attribute a backward operation to the master frame of that operation.
  * There can be multiple <1, 0> pairs, the backward operation with seq=0 only
  * attributes to the most recent forward operation with seq=0.
+ * torch_monitor_correlation_enable maintains this map inside torch_monitor.
  *
  */
 typedef struct torch_monitor_op_data {
@@ -111,9 +197,56 @@ typedef struct torch_monitor_op_data {
   //               |
   //             master
   uint32_t nested_level;
+  // A dense id of name, stable during the process, which can index flat arrays.
+  // Use torch_monitor_op_name_lookup to get the name of an id.
+  uint32_t name_id;
   const char *name;
+  // A dense id of the input shapes, strides, dtypes and scalar values, 0 if inputs are not captured.
+  // Use torch_monitor_op_signature_lookup to decode an id.
+  uint32_t signature_id;
+  // Filled only if correlation is enabled.
+  // Forward ops: the master frame itself, nested ops of the same sequence number share it.
+  // Backward ops: the forward counterpart.
+  torch_monitor_forward_op_t forward_op;
 } torch_monitor_op_data_t;
 
+/**
+ * @brief The type of an op input
+ *
+ */
+typedef enum torch_monitor_input_type {
+  TORCH_MONITOR_INPUT_TYPE_NONE = 0,
+  TORCH_MONITOR_INPUT_TYPE_TENSOR = 1,
+  TORCH_MONITOR_INPUT_TYPE_INT = 2,
+  TORCH_MONITOR_INPUT_TYPE_DOUBLE = 3,
+  TORCH_MONITOR_INPUT_TYPE_BOOL = 4,
+  TORCH_MONITOR_INPUT_TYPE_INT_LIST = 5,
+  TORCH_MONITOR_INPUT_TYPE_OTHER = 6,
+  TORCH_MONITOR_INPUT_TYPE_COUNT = 7
+} torch_monitor_input_type_t;
+
+/**
+ * @brief An op input decoded from a signature id.
+ * Undefined tensors are NONE inputs.
+ *
+ */
+typedef struct torch_monitor_input {
+  torch_monitor_input_type_t type;
+  // The c10::ScalarType value of a tensor
+  int32_t dtype;
+  // Number of dimensions of a tensor or length of an int list
+  uint32_t dim;
+  // Sizes of a tensor or values of an int list
+  const int64_t *sizes;
+  // Strides of a tensor, nullptr if the tensor is not strided
+  const int64_t *strides;
+  // Value of an INT, DOUBLE or BOOL input
+  union {
+    int64_t int_value;
+    double double_value;
+  } value;
+} torch_monitor_input_t;
+
 /**
  * @brief Memory allocation or free
  *
@@ -137,6 +270,23 @@ typedef struct torch_monitor_mem_data {
   int64_t total_reserved;
 } torch_monitor_mem_data_t;
 
+/**
+ * @brief A live allocation and the op that allocated it
+ *
+ */
+typedef struct torch_monitor_allocation {
+  void *ptr;
+  int64_t size;
+  torch_monitor_device_type_t device_type;
+  // The innermost op running at the allocation, NAME_ID 0 ("") outside ops
+  uint32_t name_id;
+  const char *name;
+  // 0 if call paths are not captured
+  uint64_t callpath_id;
+  // CLOCK_MONOTONIC nanoseconds
+  uint64_t timestamp;
+} torch_monitor_allocation_t;
+
 /**
  * @brief Information about each python frame
  *
@@ -155,6 +305,12 @@ typedef struct torch_monitor_python_state {
 typedef struct torch_monitor_callback_data {
   torch_monitor_domain_t domain;
   uint64_t current_thread_id;
+  // Number of events this event stands for, 1 unless the domain is sampled.
+  // Sum weights to reconstruct totals.
+  double weight;
+  // Monotonic timestamp taken when the callback starts,
+  // use torch_monitor_timestamp_to_ns to convert it to nanoseconds
+  uint64_t timestamp;
 
   // data can be casted using domain to
   // torch_monitor_callback_op_data_t
@@ -165,6 +321,131 @@ typedef struct torch_monitor_callback_data {
   } data;
 } torch_monitor_callback_data_t;
 
+/**
+ * @brief Summary of a latency distribution in nanoseconds.
+ * Quantiles are estimated by log-linear histograms with a relative error below 12.5%.
+ *
+ */
+typedef struct torch_monitor_latency_stats {
+  uint64_t total;
+  uint64_t min;
+  uint64_t max;
+  uint64_t p50;
+  uint64_t p90;
+  uint64_t p99;
+} torch_monitor_latency_stats_t;
+
+/**
+ * @brief Latency statistics of each op name aggregated across threads
+ *
+ */
+typedef struct torch_monitor_op_stats {
+  uint32_t name_id;
+  const char *name;
+  uint64_t count;
+  // Time from enter to exit
+  torch_monitor_latency_stats_t inclusive;
+  // Inclusive time minus the inclusive time of nested ops
+  torch_monitor_latency_stats_t self;
+} torch_monitor_op_stats_t;
+
+/**
+ * @brief Memory events charged to an op
+ *
+ */
+typedef struct torch_monitor_memory_counters {
+  uint64_t alloc_count;
+  uint64_t alloc_bytes;
+  uint64_t free_count;
+  uint64_t free_bytes;
+  // alloc_bytes - free_bytes
+  int64_t net_bytes;
+  // Allocations freed inside the op that allocated them, not delivered if coalescing is enabled
+  uint64_t transient_count;
+  uint64_t transient_bytes;
+} torch_monitor_memory_counters_t;
+
+/**
+ * @brief Memory events of each op name aggregated across threads
+ *
+ */
+typedef struct torch_monitor_op_memory {
+  uint32_t name_id;
+  const char *name;
+  // Events while the op is the innermost active op
+  torch_monitor_memory_counters_t innermost;
+  // Events while the op is the active op of nested level 0
+  torch_monitor_memory_counters_t master;
+} torch_monitor_op_memory_t;
+
+/**
+ * @brief Number of CPU time samples of an op stack
+ *
+ */
+typedef struct torch_monitor_stack_sample {
+  // Name ids of active ops from nested level 0, empty if no op was active
+  const uint32_t *name_ids;
+  uint32_t depth;
+  // Python call path of the op of nested level 0, 0 if call paths are not captured
+  uint64_t callpath_id;
+  uint64_t count;
+} torch_monitor_stack_sample_t;
+
+// Size class i holds requests of [2^i, 2^(i+1)) bytes, class 0 also holds empty requests
+#define TORCH_MONITOR_SIZE_CLASS_COUNT 64
+
+/**
+ * @brief Allocator behavior of a device type
+ *
+ */
+typedef struct torch_monitor_memory_summary {
+  torch_monitor_device_type_t device_type;
+  uint64_t alloc_count;
+  uint64_t free_count;
+  // Number and bytes of allocation requests of each size class
+  uint64_t size_class_counts[TORCH_MONITOR_SIZE_CLASS_COUNT];
+  uint64_t size_class_bytes[TORCH_MONITOR_SIZE_CLASS_COUNT];
+  // Nanoseconds from the allocation to the free of blocks freed while analyzed
+  torch_monitor_latency_stats_t lifetime;
+  int64_t max_allocated;
+  int64_t max_reserved;
+  // Maximum of reserved minus allocated bytes
+  int64_t max_gap;
+} torch_monitor_memory_summary_t;
+
+/**
+ * @brief Maxima of allocator totals in a time interval
+ *
+ */
+typedef struct torch_monitor_memory_sample {
+  // CLOCK_MONOTONIC nanoseconds of the interval start
+  uint64_t timestamp;
+  int64_t allocated;
+  int64_t reserved;
+  // Reserved minus allocated bytes
+  int64_t gap;
+} torch_monitor_memory_sample_t;
+
+/**
+ * @brief Estimated work and achieved throughput of an op name at a python call path
+ *
+ */
+typedef struct torch_monitor_op_throughput {
+  uint32_t name_id;
+  const char *name;
+  // 0 if call paths are not captured
+  uint64_t callpath_id;
+  uint64_t count;
+  // Total inclusive time in nanoseconds
+  uint64_t time;
+  // Estimated floating point operations
+  uint64_t flops;
+  // Estimated bytes read and written
+  uint64_t bytes;
+  double gflops_per_second;
+  double gbytes_per_second;
+} torch_monitor_op_throughput_t;
+
 /**
  * @brief A callback that handles callback_data at each pytorch function enter/exit
  *
@@ -176,31 +457,474 @@ typedef void (*torch_monitor_callback_func_t)(torch_monitor_callback_site_t call
                                               torch_monitor_callback_data_t *callback_data);
 
 /**
- * @brief A callback that handles callback_data at each pytorch function enter/exit
+ * @brief A batch of events stored column by column, the i-th event is the i-th element of each column.
+ * Columns are only valid during the batch callback.
+ *
+ */
+typedef struct torch_monitor_event_batch {
+  size_t num_events;
+  // torch_monitor_domain_t
+  const uint8_t *domain;
+  // torch_monitor_callback_site_t
+  const uint8_t *site;
+  const uint64_t *thread_id;
+  // -1 for memory events
+  const int64_t *sequence_number;
+  const uint32_t *nested_level;
+  const uint32_t *name_id;
+  const uint64_t *timestamp;
+  const double *weight;
+  // Allocated bytes, negative for frees, 0 for op events
+  const int64_t *mem_size;
+  const int64_t *mem_total_allocated;
+  const int64_t *mem_total_reserved;
+} torch_monitor_event_batch_t;
+
+/**
+ * @brief A callback that handles a batch of events buffered by one thread
+ *
+ * @param batch
+ *
+ */
+typedef void (*torch_monitor_batch_callback_func_t)(const torch_monitor_event_batch_t *batch);
+
+/**
+ * @brief Subscribe a callback to events of all domains.
+ * Multiple callbacks can be subscribed, each is called in subscription order.
  *
  * @param func The callback to register
  * @return torch_monitor_status_t
  *
- * @note not thread safe
- *
  */
 EXTERNC torch_monitor_status_t torch_monitor_callback_subscribe(torch_monitor_callback_func_t func);
 
 /**
- * @brief Enable a domain to be monitored
+ * @brief Subscribe a callback to events of selected domains.
+ * Subscribers can be added or removed while monitoring is running.
+ *
+ * @param func The callback to register
+ * @param domain_mask A bit mask built with TORCH_MONITOR_DOMAIN_MASK
+ * @return torch_monitor_status_t
+ *
+ */
+EXTERNC torch_monitor_status_t torch_monitor_callback_subscribe_domains(
+    torch_monitor_callback_func_t func, uint64_t domain_mask);
+
+/**
+ * @brief Unsubscribe a callback. It can still be called by threads that are dispatching
+ * an event when this function returns.
+ *
+ * @param func The callback to unregister
+ * @return torch_monitor_status_t
+ *
+ */
+EXTERNC torch_monitor_status_t torch_monitor_callback_unsubscribe(torch_monitor_callback_func_t func);
+
+/**
+ * @brief Subscribe a batch callback to events of selected domains.
+ * Each thread buffers events and calls func once batch_size events accumulate,
+ * at torch_monitor_batch_flush or torch_monitor_thread_finalize on that thread,
+ * and at torch_monitor_finalize for all threads.
+ * In the async record mode events are buffered by the background thread.
+ * Events raised inside func are not buffered.
+ *
+ * @param func The callback to register
+ * @param domain_mask A bit mask built with TORCH_MONITOR_DOMAIN_MASK
+ * @param batch_size Number of events per batch
+ * @return torch_monitor_status_t
+ *
+ */
+EXTERNC torch_monitor_status_t torch_monitor_batch_subscribe(torch_monitor_batch_callback_func_t func,
+                                                             uint64_t domain_mask, size_t batch_size);
+
+/**
+ * @brief Unsubscribe a batch callback. Events of func buffered by other threads are discarded.
+ *
+ * @param func The callback to unregister
+ * @return torch_monitor_status_t
+ *
+ */
+EXTERNC torch_monitor_status_t torch_monitor_batch_unsubscribe(torch_monitor_batch_callback_func_t func);
+
+/**
+ * @brief Deliver events buffered by the calling thread to batch callbacks
+ *
+ * @return torch_monitor_status_t
+ *
+ */
+EXTERNC torch_monitor_status_t torch_monitor_batch_flush();
+
+/**
+ * @brief Enable a domain to be monitored.
+ * After torch_monitor_init, op domains are enabled by re-attaching the callback.
+ * The memory domain must be enabled before torch_monitor_init to be toggled later.
  *
  * @param domain The domain to monitor
  * @return torch_monitor_status_t
  *
+ */
+EXTERNC torch_monitor_status_t torch_monitor_domain_enable(torch_monitor_domain_t domain);
+
+/**
+ * @brief Stop monitoring a domain. Op domains no longer pay the RecordFunction cost.
+ *
+ * @param domain The domain to stop monitoring
+ * @return torch_monitor_status_t
+ *
+ */
+EXTERNC torch_monitor_status_t torch_monitor_domain_disable(torch_monitor_domain_t domain);
+
+/**
+ * @brief Sample events of a domain. Each event is delivered with probability rate
+ * and carries weight 1 / rate. An op is delivered at both enter and exit or not at all.
+ *
+ * @param domain The domain to sample
+ * @param rate Sampling probability in (0, 1], 1 delivers every event
+ * @return torch_monitor_status_t
+ *
+ */
+EXTERNC torch_monitor_status_t torch_monitor_domain_sample_rate(torch_monitor_domain_t domain,
+                                                                double rate);
+
+/**
+ * @brief Rate limit hot ops of the op domains. Each <op name, nested level> pair is
+ * delivered in full for its first threshold ops, after which its sampling period doubles
+ * each time its count doubles. The last op of each period is delivered with the number of
+ * ops of the pair since the previous delivery as weight, multiplied by the weight of domain
+ * sampling, so weights add up to the op count at period boundaries.
+ *
+ * @param threshold Number of ops of a pair delivered before sampling starts, must be positive
+ * @return torch_monitor_status_t
+ *
+ */
+EXTERNC torch_monitor_status_t torch_monitor_adaptive_sampling_enable(uint64_t threshold);
+
+/**
+ * @brief Set how callbacks are delivered. Must be called before torch_monitor_init.
+ *
+ * @param mode The record mode
+ * @param buffer_size Number of events per thread buffer in the async mode,
+ * must be a power of two. 0 means the default size.
+ * @return torch_monitor_status_t
+ *
  * @note not thread safe
  *
  */
-EXTERNC torch_monitor_status_t torch_monitor_domain_enable(torch_monitor_domain_t domain);
+EXTERNC torch_monitor_status_t torch_monitor_record_mode_set(torch_monitor_record_mode_t mode,
+                                                             size_t buffer_size);
+
+/**
+ * @brief Query the number of events dropped by the async record mode
+ *
+ * @param num_dropped Number of dropped events across all threads
+ * @return torch_monitor_status_t
+ *
+ */
+EXTERNC torch_monitor_status_t torch_monitor_dropped_events_get(size_t *num_dropped);
+
+/**
+ * @brief Write every callback of the enabled domains to a binary trace file.
+ * Records have a fixed layout and the file ends with a name table and a block index.
+ * The trace is closed by torch_monitor_finalize. Must be called before torch_monitor_init.
+ * A subscriber is optional when the trace is enabled.
+ *
+ * @param path The trace file path, truncated if it exists
+ * @return torch_monitor_status_t
+ *
+ * @note not thread safe
+ *
+ */
+EXTERNC torch_monitor_status_t torch_monitor_trace_enable(const char *path);
+
+/**
+ * @brief Store repeated training iterations of the binary trace once.
+ * Records of each thread are grouped into iterations by steps, see torch_monitor_step and
+ * torch_monitor_step_window_set. An iteration identical to an earlier one is stored as a
+ * reference to it plus timing deltas, and a divergent iteration as a diff against the latest
+ * stored one. Must be called after torch_monitor_trace_enable and before torch_monitor_init.
+ *
+ * @return torch_monitor_status_t
+ *
+ * @note not thread safe
+ *
+ */
+EXTERNC torch_monitor_status_t torch_monitor_trace_dedup_enable();
+
+/**
+ * @brief Get the op name of a name id
+ *
+ * @param name_id The name_id field of torch_monitor_op_data_t
+ * @param name The interned name, valid until the process exits
+ * @return torch_monitor_status_t
+ *
+ */
+EXTERNC torch_monitor_status_t torch_monitor_op_name_lookup(uint32_t name_id, const char **name);
+
+/**
+ * @brief Get the number of assigned name ids. Ids are dense and start from 0,
+ * where 0 is reserved for events without a name.
+ *
+ * @param num_names Number of assigned name ids
+ * @return torch_monitor_status_t
+ *
+ */
+EXTERNC torch_monitor_status_t torch_monitor_op_name_count(uint32_t *num_names);
+
+/**
+ * @brief Filter ops of the op domains by name before any other processing.
+ * Patterns are globs where '*' matches any string and '?' matches any character,
+ * e.g., "aten::view", "aten::_*".
+ * Filtered ops are invisible to every feature, including nested levels of their nested ops.
+ * Must be called before torch_monitor_init.
+ *
+ * @param pattern The glob pattern of op names
+ * @param mode Allow or deny ops matching the pattern
+ * @return torch_monitor_status_t
+ *
+ */
+EXTERNC torch_monitor_status_t torch_monitor_op_filter_add(const char *pattern,
+                                                           torch_monitor_op_filter_mode_t mode);
+
+/**
+ * @brief Aggregate per-op latency histograms inside torch_monitor.
+ * Every op of the enabled op domains is timed, regardless of sampling and subscribers.
+ * Must be called before torch_monitor_init.
+ *
+ * @return torch_monitor_status_t, TORCH_MONITOR_STATUS_OP_STATS_INVALID if profiling has started
+ *
+ */
+EXTERNC torch_monitor_status_t torch_monitor_op_stats_enable();
+
+/**
+ * @brief Attribute memory events to the active ops of the reporting thread inside torch_monitor.
+ * Every event of the memory domain is counted, regardless of sampling and subscribers.
+ * Events outside ops are charged to NAME_ID 0 ("").
+ * The memory domain and at least one op domain must be enabled.
+ *
+ * @return torch_monitor_status_t
+ *
+ */
+EXTERNC torch_monitor_status_t torch_monitor_op_memory_enable();
+
+/**
+ * @brief Fold allocations freed inside the op that allocated them into transient counters
+ * of torch_monitor_op_memory_get instead of delivering the pair.
+ * Allocations still live when their innermost op exits are delivered before the exit callback
+ * of the op, with their original timestamps. Allocations outside ops are delivered immediately.
+ * Implies torch_monitor_op_memory_enable.
+ *
+ * @return torch_monitor_status_t
+ *
+ */
+EXTERNC torch_monitor_status_t torch_monitor_memory_coalesce_enable();
+
+/**
+ * @brief Aggregate every op of the enabled op domains by <python call path, nested op names>
+ * and write collapsed stacks ("frame;frame;... value" lines) to path at torch_monitor_finalize.
+ * Python frames precede op names if max_num_states is not 0.
+ * Must be called before torch_monitor_init.
+ *
+ * @param path The collapsed stack file
+ * @param metric The value of each stack
+ * @param max_num_states Depth of python call paths of ops at nested level 0, 0 does not capture them
+ * @return torch_monitor_status_t, TORCH_MONITOR_STATUS_FLAME_GRAPH_OPEN_FAIL if the file cannot be
+ * opened or profiling has started
+ *
+ */
+EXTERNC torch_monitor_status_t torch_monitor_flame_graph_enable(
+    const char *path, torch_monitor_flame_graph_metric_t metric, size_t max_num_states);
+
+/**
+ * @brief Analyze size classes, block lifetimes, and allocated and reserved bytes over time
+ * of every event of the memory domain, regardless of sampling and subscribers.
+ * The memory domain must be enabled.
+ *
+ * @return torch_monitor_status_t
+ *
+ */
+EXTERNC torch_monitor_status_t torch_monitor_memory_analyzer_enable();
+
+/**
+ * @brief Profile ops statistically instead of delivering op callbacks.
+ * Op callbacks only push and pop op names on a per-thread stack, and a SIGPROF timer
+ * samples the stack of the thread consuming CPU time at a fixed frequency,
+ * so the overhead does not depend on the op rate.
+ * Op domains are not delivered to subscribers, op stats, the cost model, or the correlation table.
+ * Coalesced allocations are still scoped by ops.
+ * The SIGPROF handler stays installed after torch_monitor_finalize.
+ * Must be called before torch_monitor_init.
+ *
+ * @param frequency Samples per second of CPU time, from 1 to 10000
+ * @param max_num_states Depth of python call paths captured at ops of nested level 0,
+ * 0 does not capture them
+ * @return torch_monitor_status_t, TORCH_MONITOR_STATUS_STACK_SAMPLING_INVALID if profiling has
+ * started
+ *
+ */
+EXTERNC torch_monitor_status_t torch_monitor_stack_sampling_enable(uint64_t frequency,
+                                                                   size_t max_num_states);
+
+/**
+ * @brief Capture input shapes, strides, dtypes and scalar values of sampled ops as signature ids.
+ * Must be called before torch_monitor_init.
+ *
+ * @return torch_monitor_status_t, TORCH_MONITOR_STATUS_INPUT_CAPTURE_INVALID if profiling has started
+ *
+ */
+EXTERNC torch_monitor_status_t torch_monitor_input_capture_enable();
+
+/**
+ * @brief Decode the inputs of a signature id.
+ * sizes and strides point into torch_monitor and stay valid during the process.
+ *
+ * @param signature_id The signature_id field of torch_monitor_op_data_t
+ * @param max_num_inputs Returns up to max_num_inputs inputs
+ * @param inputs An array of inputs allocated by the tool but not torch_monitor
+ * @param num_inputs Number of inputs decoded
+ * @return torch_monitor_status_t
+ *
+ */
+EXTERNC torch_monitor_status_t torch_monitor_op_signature_lookup(uint32_t signature_id,
+                                                                 size_t max_num_inputs,
+                                                                 torch_monitor_input_t *inputs,
+                                                                 size_t *num_inputs);
+
+/**
+ * @brief Estimate FLOPs and memory traffic of common ATen ops (mm, addmm, bmm, baddbmm, linear,
+ * convolutions, elementwise ops and reductions) from their inputs, and aggregate them with
+ * inclusive op time. Enables input capture, must be called before torch_monitor_init.
+ *
+ * @param max_num_states Depth of the python call paths ops are keyed by, 0 keys ops by name only.
+ * Call paths are captured at modeled ops of nested level 0 and shared by their nested modeled ops.
+ * @return torch_monitor_status_t, TORCH_MONITOR_STATUS_INPUT_CAPTURE_INVALID if profiling has started
+ *
+ */
+EXTERNC torch_monitor_status_t torch_monitor_cost_model_enable(size_t max_num_states);
+
+/**
+ * @brief Query achieved throughput merged at torch_monitor_finalize,
+ * in <name id, call path id> order
+ *
+ * @param max_num_results Returns up to max_num_results results
+ * @param results An array of results allocated by the tool but not torch_monitor
+ * @param num_results Number of results collected
+ * @return torch_monitor_status_t
+ *
+ */
+EXTERNC torch_monitor_status_t torch_monitor_op_throughput_get(
+    size_t max_num_results, torch_monitor_op_throughput_t *results, size_t *num_results);
+
+/**
+ * @brief Track live allocations of the memory domain regardless of sampling and subscribers.
+ * The live set of each device type is snapshotted at its peak, ignoring peaks that grow less
+ * than 1/64 over the previous snapshot.
+ * The memory domain must be enabled.
+ *
+ * @param max_num_states Depth of the python call paths of allocations, 0 does not capture them.
+ * Call paths are only captured on threads holding the GIL when they allocate.
+ * @return torch_monitor_status_t
+ *
+ */
+EXTERNC torch_monitor_status_t torch_monitor_allocation_tracking_enable(size_t max_num_states);
+
+/**
+ * @brief Query allocations live at the snapshotted peak of a device type, largest first
+ *
+ * @param device_type The device type of allocations
+ * @param max_num_allocations Returns up to max_num_allocations allocations
+ * @param allocations An array of allocations allocated by the tool but not torch_monitor
+ * @param num_allocations Number of allocations collected
+ * @param peak_size Total size of live allocations at the snapshotted peak
+ * @return torch_monitor_status_t
+ *
+ */
+EXTERNC torch_monitor_status_t torch_monitor_peak_allocations_get(
+    torch_monitor_device_type_t device_type, size_t max_num_allocations,
+    torch_monitor_allocation_t *allocations, size_t *num_allocations, int64_t *peak_size);
+
+/**
+ * @brief Attribute backward ops to forward ops inside torch_monitor.
+ * Forward ops are kept in a bounded map until their backward ops consume them.
+ *
+ * @param max_num_states Depth of the python call paths captured at forward ops,
+ * 0 does not capture call paths
+ * @return torch_monitor_status_t
+ *
+ */
+EXTERNC torch_monitor_status_t torch_monitor_correlation_enable(size_t max_num_states);
+
+/**
+ * @brief Query per-op latency statistics merged at torch_monitor_finalize, in name id order
+ *
+ * @param max_num_stats Returns up to max_num_stats ops
+ * @param stats An array of stats allocated by the tool but not torch_monitor
+ * @param num_stats Number of stats collected
+ * @return torch_monitor_status_t
+ *
+ */
+EXTERNC torch_monitor_status_t torch_monitor_op_stats_get(size_t max_num_stats,
+                                                          torch_monitor_op_stats_t *stats,
+                                                          size_t *num_stats);
+
+/**
+ * @brief Query per-op memory counters merged at torch_monitor_finalize, in name id order
+ *
+ * @param max_num_results Returns up to max_num_results ops
+ * @param results An array of results allocated by the tool but not torch_monitor
+ * @param num_results Number of results collected
+ * @return torch_monitor_status_t
+ *
+ */
+EXTERNC torch_monitor_status_t torch_monitor_op_memory_get(size_t max_num_results,
+                                                           torch_monitor_op_memory_t *results,
+                                                           size_t *num_results);
+
+/**
+ * @brief Query the allocator summary of a device type
+ *
+ * @param device_type The device type of the allocator
+ * @param summary A summary allocated by the tool but not torch_monitor
+ * @return torch_monitor_status_t
+ *
+ */
+EXTERNC torch_monitor_status_t torch_monitor_memory_summary_get(
+    torch_monitor_device_type_t device_type, torch_monitor_memory_summary_t *summary);
+
+/**
+ * @brief Query the allocator timeline of a device type in time order.
+ * Intervals start at 1ms and double whenever the timeline holds 1024 samples,
+ * so the timeline covers the whole run.
+ *
+ * @param device_type The device type of the allocator
+ * @param max_num_samples Returns up to max_num_samples samples
+ * @param samples An array of samples allocated by the tool but not torch_monitor
+ * @param num_samples Number of samples collected
+ * @return torch_monitor_status_t
+ *
+ */
+EXTERNC torch_monitor_status_t torch_monitor_memory_timeline_get(
+    torch_monitor_device_type_t device_type, size_t max_num_samples,
+    torch_monitor_memory_sample_t *samples, size_t *num_samples);
+
+/**
+ * @brief Query op stack samples merged at torch_monitor_finalize.
+ * Name ids are valid until the process exits.
+ *
+ * @param max_num_samples Returns up to max_num_samples stacks
+ * @param samples An array of samples allocated by the tool but not torch_monitor
+ * @param num_samples Number of stacks collected
+ * @return torch_monitor_status_t
+ *
+ */
+EXTERNC torch_monitor_status_t torch_monitor_stack_samples_get(size_t max_num_samples,
+                                                               torch_monitor_stack_sample_t *samples,
+                                                               size_t *num_samples);
 
 /**
  * @brief Query the python states of the query thread
  *
- * @param max_num_states Returns up to num_states frames
+ * @param max_num_states Returns up to num_states frames, frames beyond are not walked,
+ * 0 collects no frame and returns TORCH_MONITOR_STATUS_PYTHON_STATES_NULL
  * @param states An array of states allocated by the tool but not torch_monitor
  * @param num_states Number of states collected
  * @return torch_monitor_status_t
@@ -212,6 +936,49 @@ EXTERNC torch_monitor_status_t torch_monitor_python_state_get(size_t max_num_sta
                                                               torch_monitor_python_state_t *states,
                                                               size_t *num_states);
 
+/**
+ * @brief Query the python call path of the query thread as a single id.
+ * Ids are nodes of a calling context tree shared by all threads, so the same
+ * call path always has the same id during the process.
+ * The GIL is only acquired if the query thread does not hold it, and the previous id
+ * of the thread is reused if its top frames are unchanged.
+ *
+ * @param max_num_states Only the innermost max_num_states frames are collected,
+ * 0 collects no frame and returns TORCH_MONITOR_STATUS_PYTHON_STATES_NULL
+ * @param callpath_id The call path id, 0 if there is no python frame
+ * @return torch_monitor_status_t
+ *
+ */
+EXTERNC torch_monitor_status_t torch_monitor_python_callpath_get(size_t max_num_states,
+                                                                 uint64_t *callpath_id);
+
+/**
+ * @brief Expand a call path id into python states, starting from the innermost frame
+ *
+ * @param callpath_id A call path id returned by torch_monitor_python_callpath_get
+ * @param max_num_states Returns up to num_states frames
+ * @param states An array of states allocated by the tool but not torch_monitor.
+ * Strings are interned and valid until the process exits.
+ * @param num_states Number of states collected
+ * @return torch_monitor_status_t
+ *
+ */
+EXTERNC torch_monitor_status_t torch_monitor_python_callpath_expand(
+    uint64_t callpath_id, size_t max_num_states, torch_monitor_python_state_t *states,
+    size_t *num_states);
+
+/**
+ * @brief Convert the timestamp of callback data to CLOCK_MONOTONIC nanoseconds.
+ * Timestamps are TSC ticks calibrated at torch_monitor_init if the CPU has an invariant TSC,
+ * otherwise they are CLOCK_MONOTONIC nanoseconds already.
+ *
+ * @param timestamp The timestamp field of torch_monitor_callback_data_t
+ * @param ns Nanoseconds
+ * @return torch_monitor_status_t
+ *
+ */
+EXTERNC torch_monitor_status_t torch_monitor_timestamp_to_ns(uint64_t timestamp, uint64_t *ns);
+
 /**
  * @brief Start monitoring pytorch functions in registered domains.
  * This function should be called only once at process initialization.
@@ -223,6 +990,48 @@ EXTERNC torch_monitor_status_t torch_monitor_python_state_get(size_t max_num_sta
  */
 EXTERNC torch_monitor_status_t torch_monitor_init();
 
+/**
+ * @brief Stop delivering events and remove the RecordFunction callback.
+ * Monitoring costs nothing except a check in memory callbacks until torch_monitor_resume.
+ *
+ * @return torch_monitor_status_t
+ *
+ */
+EXTERNC torch_monitor_status_t torch_monitor_pause();
+
+/**
+ * @brief Re-attach the RecordFunction callback and deliver events again.
+ * Ops in flight at the pause are not delivered at their exits.
+ *
+ * @return torch_monitor_status_t
+ *
+ */
+EXTERNC torch_monitor_status_t torch_monitor_resume();
+
+/**
+ * @brief Record a window of training steps only. The first skip_steps steps are not
+ * delivered, the next record_steps steps are, and then the RecordFunction callbacks are
+ * detached as by torch_monitor_pause. Must be called before torch_monitor_init.
+ *
+ * @param skip_steps Number of warm-up steps before the window
+ * @param record_steps Number of steps in the window, 0 records until torch_monitor_finalize
+ * @param marker Glob pattern of user scope ops whose exits end steps,
+ * e.g., "Optimizer.step*" recorded by torch.optim. nullptr counts torch_monitor_step only.
+ * @return torch_monitor_status_t
+ *
+ */
+EXTERNC torch_monitor_status_t torch_monitor_step_window_set(uint64_t skip_steps,
+                                                             uint64_t record_steps,
+                                                             const char *marker);
+
+/**
+ * @brief End a training step, which may open or close the step window.
+ *
+ * @return torch_monitor_status_t
+ *
+ */
+EXTERNC torch_monitor_status_t torch_monitor_step();
+
 /**
  * @brief Init thread local states. This function should be called when each thread initializes.
  *
@@ -1,6 +1,7 @@
 #ifndef TORCH_MONITOR_TORCH_PROFILER_H
 #define TORCH_MONITOR_TORCH_PROFILER_H
 
+#include <string>
 #include <unordered_set>
 
 #include "torch_monitor.h"
@@ -8,6 +9,8 @@
 
 namespace torch_monitor {
 
+struct OpFrame;
+
 class TorchProfiler {
  public:
   void enable_memory_profiling() { _is_memory_profiling_enabled = true; }
@@ -20,13 +23,63 @@ class TorchProfiler {
   // false: register fail
   bool register_domain(torch_monitor_domain_t domain);
 
+  // true: unregister success
+  // false: unregister fail
+  bool unregister_domain(torch_monitor_domain_t domain);
+
   // true: domain registered
   // false: domain not registered
   bool has_domain(torch_monitor_domain_t domain);
 
   // true: register success
-  // false: register fail
-  bool register_callback(torch_monitor_callback_func_t callback);
+  // false: callback has been registered
+  bool register_callback(torch_monitor_callback_func_t callback, uint64_t domain_mask);
+
+  // true: unregister success
+  // false: callback has not been registered
+  bool unregister_callback(torch_monitor_callback_func_t callback);
+
+  // true: set success
+  // false: profiling has started or the buffer size is invalid
+  bool set_record_mode(torch_monitor_record_mode_t record_mode, size_t buffer_size);
+
+  torch_monitor_record_mode_t record_mode();
+
+  // true: trace file opened
+  // false: profiling has started or the trace file cannot be opened
+  bool enable_trace(const std::string& path);
+
+  // true: trace deduplication enabled
+  // false: profiling has started or the trace is not enabled
+  bool enable_trace_dedup();
+
+  // true: op stats enabled
+  // false: profiling has started
+  bool enable_op_stats();
+
+  // The timer is only started with profiling
+  // true: stack sampling enabled
+  // false: profiling has started
+  bool enable_stack_sampling(uint64_t frequency, size_t max_num_states);
+
+  // true: flame graph file opened
+  // false: profiling has started or the flame graph file cannot be opened
+  bool enable_flame_graph(const char* path, torch_monitor_flame_graph_metric_t metric,
+                          size_t max_num_states);
+
+  // Inputs are only recorded if capture is enabled when callbacks are registered
+  // true: input capture enabled
+  // false: profiling has started
+  bool enable_input_capture();
+
+  // true: set success
+  // false: profiling has started
+  bool set_step_window(uint64_t skip_steps, uint64_t record_steps, const char* marker);
+
+  // End a training step, which may open or close the step window
+  // true: step success
+  // false: profiling has not started or callbacks cannot be attached
+  bool step();
 
   // true: start profiling
   // false: cannot start profiling
@@ -36,6 +89,14 @@ class TorchProfiler {
   // false: cannot stop profiling
   bool stop_profiling();
 
+  // true: callbacks are detached
+  // false: profiling has not started
+  bool pause_profiling();
+
+  // true: callbacks are re-attached
+  // false: profiling has not started or callbacks cannot be attached
+  bool resume_profiling();
+
   // true: start profiling
   // false: cannot start profiling
   bool start_memory_profiling();
@@ -47,6 +108,11 @@ class TorchProfiler {
   // Get the singleton instance
   static TorchProfiler& instance();
 
+  // Call the subscribers directly
+  // step: the trace step when the event was recorded
+  static void deliver_callback(torch_monitor_callback_site_t callback_site,
+                               torch_monitor_callback_data_t* callback_data, uint64_t step);
+
  public:
   const static int64_t TORCH_PROFILER_SEQUENCE_NUMBER_NULL = -1;
   const static int64_t TORCH_PROFILER_HANDLE_NULL = 0;
@@ -79,11 +145,45 @@ class TorchProfiler {
     }
   }
 
+  // Add the RecordFunction callback for the registered scopes
+  // true: attach success
+  // false: attach fail
+  bool attach_callback();
+
+  // Remove the RecordFunction callback
+  void detach_callback();
+
+  // Add the RecordFunction callback that ends steps at marker ops of the user scope
+  // true: attach success
+  // false: attach fail
+  bool attach_marker_callback();
+
+  // Remove the marker callback
+  void detach_marker_callback();
+
+  // Intern the name of an op
+  static uint32_t intern_name(const at::RecordFunction& fn);
+
+  // name_id is only used at enter
   // true: init success
   // false: init fail
   static bool init_callback_data(torch_monitor_callback_site_t callback_site,
-                                 const at::RecordFunction& fn,
-                                 torch_monitor_callback_data_t& callback_data);
+                                 const at::RecordFunction& fn, uint32_t name_id,
+                                 uint64_t timestamp, torch_monitor_callback_data_t& callback_data);
+
+  // Record a forward op or look up the forward op of a backward op
+  static void correlate(torch_monitor_domain_t domain, const at::RecordFunction& fn,
+                        uint64_t timestamp, OpFrame& frame, const OpFrame* parent);
+
+  // Sample a memory event and dispatch it
+  static void dispatch_memory_callback(torch_monitor_callback_data_t* callback_data);
+
+  // Dispatch coalesced allocations not freed by the op exiting at nested_level
+  static void escape_memory_callbacks(uint32_t nested_level);
+
+  // Deliver the callback now or defer it to the event buffers according to the record mode
+  static void dispatch_callback(torch_monitor_callback_site_t callback_site,
+                                torch_monitor_callback_data_t* callback_data);
 
  private:
   bool _is_memory_profiling_enabled = false;
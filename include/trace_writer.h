@@ -0,0 +1,308 @@
+#ifndef TORCH_MONITOR_TRACE_WRITER_H
+#define TORCH_MONITOR_TRACE_WRITER_H
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "torch_monitor.h"
+
+namespace torch_monitor {
+
+// Trace file layout, all fields are little endian:
+//
+//   TraceFileHeader
+//   TraceRecord[num_records]        grouped in blocks flushed by each thread
+//   TraceNameEntry + name bytes     for each name id of NameTable, in id order
+//   TraceIndexEntry[num_blocks]     one entry per record block
+//   TraceIterationEntry[num_iterations] and TraceIterationTrailer, only in version 2
+//   TraceFileTrailer
+//
+// Readers locate the trailer at the end of the file, then seek to the name table
+// and the block index without scanning records. Version 2 readers find the iteration
+// table through the TraceIterationTrailer right before the trailer.
+const uint64_t TRACE_FILE_MAGIC = 0x3145434152544d54;          // "TMTRACE1"
+const uint64_t TRACE_FILE_TRAILER_MAGIC = 0x314c494152544d54;  // "TMTRAIL1"
+const uint32_t TRACE_FILE_VERSION = 1;
+// Deduplicated traces store references and diffs of iterations instead of the records,
+// so version 1 readers cannot consume them even though the header and trailer are shared.
+const uint32_t TRACE_FILE_VERSION_DEDUP = 2;
+
+struct TraceFileHeader {
+  uint64_t magic;
+  uint32_t version;
+  uint32_t record_size;
+  uint64_t num_records;
+  uint64_t trailer_offset;
+};
+
+struct TraceRecord {
+  uint8_t domain;
+  uint8_t callback_site;
+  // torch_monitor_mem_data_type_t for memory records
+  uint8_t mem_type;
+  // torch_monitor_device_type_t for memory records
+  uint8_t device_type;
+  uint32_t nested_level;
+  uint64_t thread_id;
+  // CLOCK_MONOTONIC nanoseconds
+  uint64_t timestamp;
+  uint32_t name_id;
+  // Sampling weight
+  float weight;
+  union {
+    struct {
+      uint64_t forward_thread_id;
+      int64_t sequence_number;
+      // Correlation id of the forward op, 0 if correlation is disabled
+      uint64_t correlation_id;
+    } op;
+    struct {
+      uint64_t ptr;
+      int64_t size;
+      int64_t total_allocated;
+      int64_t total_reserved;
+    } mem;
+  } data;
+};
+
+static_assert(sizeof(TraceRecord) == 64, "TraceRecord must fit a cache line");
+
+struct TraceNameEntry {
+  uint32_t name_id;
+  uint32_t length;
+};
+
+// Blocks are filled by the thread delivering records, which in the async mode is one
+// consumer for all threads. Readers must use the thread_id of each record.
+const uint64_t TRACE_THREAD_ID_MIXED = UINT64_MAX;
+
+struct TraceIndexEntry {
+  uint64_t offset;
+  uint64_t num_records;
+  // Thread id of all records of the block, or TRACE_THREAD_ID_MIXED
+  uint64_t thread_id;
+  uint64_t min_timestamp;
+  uint64_t max_timestamp;
+};
+
+// Records of each thread are grouped into iterations by training steps.
+// An iteration is stored in one of three ways:
+//
+//   reference: all records, in a block of the index
+//   repeat:    the same record sequence as a reference, only timing deltas are stored
+//   diff:      a prefix and a suffix of records shared with a reference,
+//              the records in between in a block of the index, plus timing deltas
+//
+// Records are compared by domain, site, nested level, name id, weight, input signature,
+// and allocation size. Pointers, totals, sequence numbers, and correlation ids of shared
+// records are those of the reference.
+// Timing deltas are zigzag LEB128 varints, one for each shared record in iteration order,
+// of the gap to the previous record minus the gap between the matching reference records.
+// The gap of the first record of an iteration is 0, its timestamp is base_timestamp.
+enum TraceIterationKind : uint32_t {
+  TRACE_ITERATION_REFERENCE = 0,
+  TRACE_ITERATION_REPEAT = 1,
+  TRACE_ITERATION_DIFF = 2
+};
+
+struct TraceIterationEntry {
+  uint64_t thread_id;
+  // Number of steps taken before the iteration
+  uint64_t step;
+  uint64_t base_timestamp;
+  // Index of the reference in the iteration table, its own index for references
+  uint64_t reference;
+  uint64_t num_records;
+  // Records shared with the beginning and the end of the reference
+  uint64_t prefix_records;
+  uint64_t suffix_records;
+  // num_records - prefix_records - suffix_records records stored in full
+  uint64_t records_offset;
+  uint64_t deltas_offset;
+  uint64_t deltas_size;
+  uint32_t kind;
+  uint32_t padding;
+};
+
+struct TraceIterationTrailer {
+  uint64_t iteration_offset;
+  uint64_t num_iterations;
+};
+
+struct TraceFileTrailer {
+  uint64_t name_table_offset;
+  uint64_t num_names;
+  uint64_t index_offset;
+  uint64_t num_index_entries;
+  uint64_t magic;
+};
+
+// An append-only file that is grown chunk by chunk.
+// Only the chunk being written is mapped, so memory usage is independent of the file size.
+class MappedFile {
+ public:
+  // true: open success
+  // false: open fail
+  bool open(const std::string &path);
+
+  // Append size bytes and return the offset of the first byte
+  uint64_t append(const void *data, size_t size);
+
+  // Write size bytes at a previously appended offset
+  bool overwrite(uint64_t offset, const void *data, size_t size);
+
+  // Truncate the file to the appended size and close it
+  bool close();
+
+  bool is_open() const { return _fd >= 0; }
+
+  uint64_t size() const { return _size; }
+
+ public:
+  const static size_t MAPPED_FILE_CHUNK_SIZE = 64 << 20;
+
+ private:
+  // true: map success
+  // false: map fail
+  bool map_chunk(uint64_t chunk_offset);
+
+  void unmap_chunk();
+
+ private:
+  int _fd = -1;
+  // Bytes appended so far
+  uint64_t _size = 0;
+  // File offset of the mapped chunk
+  uint64_t _chunk_offset = 0;
+  char *_chunk = nullptr;
+};
+
+// A built-in sink that writes fixed-layout records of every delivered callback.
+// Each thread fills a private block of records and only takes the lock to copy
+// a full block into the mapped file.
+class TraceWriter {
+ public:
+  // true: open success
+  // false: open fail or the trace is already open
+  bool open(const std::string &path);
+
+  // Flush all thread blocks and iterations, write the name table, the index, and the trailer.
+  // Threads must not write during close, stop_profiling closes the trace only after the
+  // callback is detached and the async consumer has stopped.
+  // true: close success
+  // false: trace is not open
+  bool close();
+
+  bool is_open() const { return _file.is_open(); }
+
+  // Store iterations of repeated records once, must be enabled before any record
+  void enable_dedup() { _dedup_enabled = true; }
+
+  bool is_dedup_enabled() const { return _dedup_enabled; }
+
+  // End the current iteration of every thread at its next record
+  void step() { _step.fetch_add(1, std::memory_order_relaxed); }
+
+  // Number of steps so far, captured when an event is recorded
+  uint64_t current_step() const { return _step.load(std::memory_order_relaxed); }
+
+  // step: current_step() when the event was recorded, which lags behind in the async mode
+  void write(torch_monitor_callback_site_t callback_site,
+             const torch_monitor_callback_data_t *callback_data, uint64_t step);
+
+  // Get the singleton instance
+  static TraceWriter &instance();
+
+ public:
+  const static size_t TRACE_BLOCK_NUM_RECORDS = 1024;
+  // Iterations are cut at TRACE_DEDUP_MAX_RECORDS records, which bounds the buffer of
+  // each thread to 1 MB. Longer iterations are stored in pieces that repeat as well.
+  const static size_t TRACE_DEDUP_MAX_RECORDS = 1 << 14;
+  // Recent references of each thread that iterations are compared against
+  const static size_t TRACE_DEDUP_MAX_REFERENCES = 8;
+  // Must be a power of two
+  const static size_t TRACE_DEDUP_ITERATION_CACHE_SIZE = 8;
+
+ private:
+  struct TraceBlock {
+    uint64_t thread_id = 0;
+    size_t num_records = 0;
+    TraceRecord records[TRACE_BLOCK_NUM_RECORDS];
+  };
+
+  struct TraceReference {
+    uint64_t entry;
+    uint64_t hash;
+    std::vector<uint64_t> keys;
+    std::vector<int64_t> gaps;
+  };
+
+  struct TraceIteration {
+    uint64_t thread_id = 0;
+    uint64_t step = 0;
+    std::vector<TraceRecord> records;
+    // Comparison keys of records
+    std::vector<uint64_t> keys;
+    // The most recent reference is the last
+    std::deque<TraceReference> references;
+    // Sequence hash of the last diff
+    uint64_t diff_hash = 0;
+    std::vector<int64_t> gaps;
+    std::vector<uint8_t> deltas;
+  };
+
+  // Iterations are never removed, so cached pointers stay valid
+  struct IterationCacheEntry {
+    uint64_t thread_id;
+    TraceIteration *iteration;
+  };
+
+  TraceWriter() {}
+
+  TraceBlock *register_thread_block();
+
+  // Find or create the iteration of the thread that recorded events of thread_id
+  TraceIteration *find_iteration(uint64_t thread_id, uint64_t step);
+
+  // Append records as a block of the index and return the offset,
+  // the caller must hold _mutex
+  uint64_t append_records(const TraceRecord *records, size_t num_records, uint64_t thread_id);
+
+  // Copy block records into the file, the caller must hold _mutex
+  void flush_block(TraceBlock &block);
+
+  void write_dedup(torch_monitor_callback_site_t callback_site,
+                   const torch_monitor_callback_data_t *callback_data, uint64_t step);
+
+  // Store the buffered iteration against the references of its thread,
+  // the caller must hold _mutex
+  void flush_iteration(TraceIteration &iteration);
+
+ private:
+  std::mutex _mutex;
+  MappedFile _file;
+  uint64_t _num_records = 0;
+  std::vector<TraceIndexEntry> _index;
+  std::vector<std::shared_ptr<TraceBlock>> _blocks;
+  bool _dedup_enabled = false;
+  std::atomic<uint64_t> _step{0};
+  std::vector<TraceIterationEntry> _iterations;
+  // Iterations are keyed by the thread that recorded events rather than the writing thread,
+  // which is the consumer in the async mode
+  std::unordered_map<uint64_t, std::shared_ptr<TraceIteration>> _thread_iterations;
+
+  static inline thread_local std::shared_ptr<TraceBlock> _thread_block;
+  // Iterations last written by this thread, indexed by the low bits of their thread ids,
+  // so that the async consumer alternating between producers does not take _mutex
+  static inline thread_local IterationCacheEntry _iteration_cache[TRACE_DEDUP_ITERATION_CACHE_SIZE];
+};
+
+}  // namespace torch_monitor
+
+#endif  // TORCH_MONITOR_TRACE_WRITER_H
@@ -26,6 +26,9 @@ at::RecordScope torch_monitor_domain_match(torch_monitor_domain_t domain);
 
 torch_monitor_device_type_t aten_device_type_match(at::DeviceType device_type);
 
+// CLOCK_MONOTONIC in nanoseconds
+uint64_t monotonic_timestamp();
+
 }  // namespace torch_monitor
 
 #endif  // TORCH_MONITOR_UTILS_H
\ No newline at end of file
@@ -0,0 +1,170 @@
+#include "allocation_table.h"
+
+#include <algorithm>
+
+#include "name_table.h"
+#include "timer.h"
+
+namespace torch_monitor {
+
+AllocationTable &AllocationTable::instance() {
+  static AllocationTable table;
+  return table;
+}
+
+void AllocationTable::grow() {
+  size_t capacity = ALLOCATION_TABLE_MIN_CAPACITY;
+  if (_slots.size() * 2 > capacity) {
+    capacity = _slots.size() * 2;
+  }
+  std::vector<Allocation> slots(capacity);
+  std::swap(slots, _slots);
+  _shift = 64 - __builtin_ctzll(capacity);
+  _size = 0;
+  for (auto &allocation : slots) {
+    if (allocation.ptr != nullptr) {
+      insert(allocation);
+    }
+  }
+}
+
+void AllocationTable::insert(const Allocation &allocation) {
+  // Keep the load factor below 1/2
+  if ((_size + 1) * 2 > _slots.size()) {
+    grow();
+  }
+
+  auto mask = _slots.size() - 1;
+  auto index = slot(allocation.ptr);
+  while (_slots[index].ptr != nullptr && _slots[index].ptr != allocation.ptr) {
+    index = (index + 1) & mask;
+  }
+  if (_slots[index].ptr == nullptr) {
+    ++_size;
+  }
+  _slots[index] = allocation;
+}
+
+size_t AllocationTable::find(const void *ptr) const {
+  if (_size == 0) {
+    return ALLOCATION_NOT_FOUND;
+  }
+
+  auto mask = _slots.size() - 1;
+  auto index = slot(ptr);
+  while (_slots[index].ptr != ptr) {
+    if (_slots[index].ptr == nullptr) {
+      return ALLOCATION_NOT_FOUND;
+    }
+    index = (index + 1) & mask;
+  }
+  return index;
+}
+
+void AllocationTable::erase(size_t index) {
+  // Shift back following entries of the probe sequence so that no tombstone is needed
+  auto mask = _slots.size() - 1;
+  auto hole = index;
+  auto next = (index + 1) & mask;
+  while (_slots[next].ptr != nullptr) {
+    auto home = slot(_slots[next].ptr);
+    // Move the entry if its home slot is not in (hole, next]
+    if (((next - home) & mask) >= ((next - hole) & mask)) {
+      _slots[hole] = _slots[next];
+      hole = next;
+    }
+    next = (next + 1) & mask;
+  }
+  _slots[hole].ptr = nullptr;
+  --_size;
+}
+
+void AllocationTable::snapshot(torch_monitor_device_type_t device_type) {
+  auto &peak = _peaks[device_type];
+  peak.snapshot.clear();
+  for (auto &allocation : _slots) {
+    if (allocation.ptr != nullptr && allocation.device_type == device_type) {
+      peak.snapshot.push_back(allocation);
+    }
+  }
+  peak.snapshot_size = peak.live_size;
+  peak.pending = false;
+}
+
+void AllocationTable::record(const Allocation &allocation) {
+  // XPU, MPS, Meta and other devices are not mapped to a device type
+  if (allocation.device_type >= TORCH_MONITOR_DEVICE_TYPE_COUNT) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(_mutex);
+
+  if (allocation.size >= 0) {
+    // A block freed before tracking was enabled can be reused
+    auto index = find(allocation.ptr);
+    if (index != ALLOCATION_NOT_FOUND) {
+      _peaks[_slots[index].device_type].live_size -= _slots[index].size;
+      erase(index);
+    }
+    auto &peak = _peaks[allocation.device_type];
+    insert(allocation);
+    peak.live_size += allocation.size;
+    if (peak.live_size > peak.peak_size) {
+      peak.peak_size = peak.live_size;
+      if (peak.peak_size - peak.snapshot_size >
+          (peak.snapshot_size >> ALLOCATION_PEAK_GROWTH_SHIFT)) {
+        peak.pending = true;
+      }
+    }
+  } else {
+    auto index = find(allocation.ptr);
+    // Blocks allocated before tracking was enabled are unknown
+    if (index == ALLOCATION_NOT_FOUND) {
+      return;
+    }
+    auto device_type = _slots[index].device_type;
+    auto &peak = _peaks[device_type];
+    // Only allocations follow a peak, so the live set before the first free is the peak
+    if (peak.pending) {
+      snapshot(device_type);
+    }
+    peak.live_size -= _slots[index].size;
+    erase(index);
+  }
+}
+
+void AllocationTable::flush() {
+  std::lock_guard<std::mutex> lock(_mutex);
+
+  for (int device_type = 0; device_type < TORCH_MONITOR_DEVICE_TYPE_COUNT; ++device_type) {
+    if (_peaks[device_type].pending) {
+      snapshot(static_cast<torch_monitor_device_type_t>(device_type));
+    }
+  }
+}
+
+size_t AllocationTable::peak(torch_monitor_device_type_t device_type, size_t max_num_allocations,
+                             torch_monitor_allocation_t *allocations, int64_t *peak_size) {
+  std::lock_guard<std::mutex> lock(_mutex);
+
+  auto &peak = _peaks[device_type];
+  std::sort(peak.snapshot.begin(), peak.snapshot.end(),
+            [](const Allocation &left, const Allocation &right) { return left.size > right.size; });
+
+  auto &timer = Timer::instance();
+  auto num_allocations = std::min(max_num_allocations, peak.snapshot.size());
+  for (size_t i = 0; i < num_allocations; ++i) {
+    auto &allocation = peak.snapshot[i];
+    allocations[i].ptr = allocation.ptr;
+    allocations[i].size = allocation.size;
+    allocations[i].device_type = allocation.device_type;
+    allocations[i].name_id = allocation.name_id;
+    allocations[i].name = NameTable::instance().lookup(allocation.name_id);
+    allocations[i].callpath_id = allocation.callpath_id;
+    allocations[i].timestamp = timer.to_ns(allocation.timestamp);
+  }
+  *peak_size = peak.snapshot_size;
+  return num_allocations;
+}
+
+}  // namespace torch_monitor
@@ -0,0 +1,65 @@
+#include "correlation_table.h"
+
+namespace torch_monitor {
+
+void CorrelationTable::insert(uint64_t forward_thread_id, int64_t sequence_number,
+                              torch_monitor_forward_op_t &forward_op) {
+  forward_op.correlation_id = _next_correlation_id.fetch_add(1, std::memory_order_relaxed);
+
+  CorrelationKey key(forward_thread_id, sequence_number);
+  auto &shard = this->shard(key);
+  std::lock_guard<std::mutex> lock(shard.mutex);
+
+  shard.entries[key] = forward_op;
+  shard.order.emplace_back(key, forward_op.correlation_id);
+  while (shard.order.size() > CORRELATION_SHARD_CAPACITY) {
+    auto &oldest = shard.order.front();
+    auto iter = shard.entries.find(oldest.first);
+    // Skip keys that were consumed or replaced by a newer forward op
+    if (iter != shard.entries.end() && iter->second.correlation_id == oldest.second) {
+      shard.entries.erase(iter);
+    }
+    shard.order.pop_front();
+  }
+}
+
+bool CorrelationTable::consume(uint64_t forward_thread_id, int64_t sequence_number,
+                               torch_monitor_forward_op_t &forward_op) {
+  CorrelationKey key(forward_thread_id, sequence_number);
+  auto &shard = this->shard(key);
+  std::lock_guard<std::mutex> lock(shard.mutex);
+
+  auto iter = shard.entries.find(key);
+  if (iter == shard.entries.end()) {
+    return false;
+  }
+  forward_op = iter->second;
+  if (sequence_number != 0) {
+    shard.entries.erase(iter);
+  }
+  return true;
+}
+
+size_t CorrelationTable::size() {
+  size_t size = 0;
+  for (auto &shard : _shards) {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    size += shard.entries.size();
+  }
+  return size;
+}
+
+void CorrelationTable::clear() {
+  for (auto &shard : _shards) {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    shard.entries.clear();
+    shard.order.clear();
+  }
+}
+
+CorrelationTable &CorrelationTable::instance() {
+  static CorrelationTable correlation_table;
+  return correlation_table;
+}
+
+}  // namespace torch_monitor
@@ -0,0 +1,319 @@
+#include "cost_model.h"
+
+#include <string_view>
+
+#include "name_table.h"
+#include "signature_table.h"
+#include "timer.h"
+#include "utils.h"
+
+namespace torch_monitor {
+
+enum OpKind {
+  OP_KIND_MM = 0,
+  OP_KIND_ADDMM = 1,
+  OP_KIND_BMM = 2,
+  OP_KIND_BADDBMM = 3,
+  OP_KIND_LINEAR = 4,
+  // aten::conv1d/2d/3d(input, weight, bias, stride, padding, dilation, groups)
+  OP_KIND_CONV = 5,
+  // aten::convolution(input, weight, bias, stride, padding, dilation, transposed, output_padding,
+  // groups) and aten::_convolution
+  OP_KIND_CONVOLUTION = 6,
+  // One FLOP per output element, all tensor inputs are read
+  OP_KIND_ELEMENTWISE = 7,
+  // One FLOP per element of the first input, only the first input is read
+  OP_KIND_REDUCTION = 8,
+  OP_KIND_COUNT = 9
+};
+
+static const std::unordered_map<std::string_view, OpKind> &op_kinds() {
+  static const std::unordered_map<std::string_view, OpKind> kinds = {
+      {"aten::mm", OP_KIND_MM},
+      {"aten::addmm", OP_KIND_ADDMM},
+      {"aten::bmm", OP_KIND_BMM},
+      {"aten::baddbmm", OP_KIND_BADDBMM},
+      {"aten::linear", OP_KIND_LINEAR},
+      {"aten::conv1d", OP_KIND_CONV},
+      {"aten::conv2d", OP_KIND_CONV},
+      {"aten::conv3d", OP_KIND_CONV},
+      {"aten::convolution", OP_KIND_CONVOLUTION},
+      {"aten::_convolution", OP_KIND_CONVOLUTION},
+      {"aten::add", OP_KIND_ELEMENTWISE},
+      {"aten::add_", OP_KIND_ELEMENTWISE},
+      {"aten::sub", OP_KIND_ELEMENTWISE},
+      {"aten::sub_", OP_KIND_ELEMENTWISE},
+      {"aten::mul", OP_KIND_ELEMENTWISE},
+      {"aten::mul_", OP_KIND_ELEMENTWISE},
+      {"aten::div", OP_KIND_ELEMENTWISE},
+      {"aten::div_", OP_KIND_ELEMENTWISE},
+      {"aten::relu", OP_KIND_ELEMENTWISE},
+      {"aten::relu_", OP_KIND_ELEMENTWISE},
+      {"aten::threshold_backward", OP_KIND_ELEMENTWISE},
+      {"aten::sigmoid", OP_KIND_ELEMENTWISE},
+      {"aten::tanh", OP_KIND_ELEMENTWISE},
+      {"aten::gelu", OP_KIND_ELEMENTWISE},
+      {"aten::exp", OP_KIND_ELEMENTWISE},
+      {"aten::dropout", OP_KIND_ELEMENTWISE},
+      {"aten::sum", OP_KIND_REDUCTION},
+      {"aten::mean", OP_KIND_REDUCTION},
+      {"aten::amax", OP_KIND_REDUCTION},
+      {"aten::max", OP_KIND_REDUCTION},
+      {"aten::min", OP_KIND_REDUCTION},
+      {"aten::norm", OP_KIND_REDUCTION},
+      {"aten::softmax", OP_KIND_REDUCTION},
+      {"aten::_softmax", OP_KIND_REDUCTION},
+      {"aten::log_softmax", OP_KIND_REDUCTION},
+      {"aten::_log_softmax", OP_KIND_REDUCTION},
+      {"aten::nll_loss_forward", OP_KIND_REDUCTION},
+  };
+  return kinds;
+}
+
+static uint64_t input_numel(const torch_monitor_input_t &input) {
+  uint64_t numel = 1;
+  for (uint32_t i = 0; i < input.dim; ++i) {
+    numel *= static_cast<uint64_t>(input.sizes[i]);
+  }
+  return numel;
+}
+
+static uint64_t input_bytes(const torch_monitor_input_t &input) {
+  return input_numel(input) * c10::elementSize(static_cast<c10::ScalarType>(input.dtype));
+}
+
+static bool is_tensor(const torch_monitor_input_t *inputs, size_t num_inputs, size_t index,
+                      uint32_t dim = 0) {
+  return index < num_inputs && inputs[index].type == TORCH_MONITOR_INPUT_TYPE_TENSOR &&
+         (dim == 0 || inputs[index].dim == dim);
+}
+
+// Return the index-th value of an int list argument, single-value lists apply to every dimension
+static int64_t int_list_value(const torch_monitor_input_t *inputs, size_t num_inputs,
+                              size_t arg, size_t index, int64_t default_value) {
+  if (arg >= num_inputs || inputs[arg].type != TORCH_MONITOR_INPUT_TYPE_INT_LIST ||
+      inputs[arg].dim == 0) {
+    return default_value;
+  }
+  return inputs[arg].sizes[index < inputs[arg].dim ? index : 0];
+}
+
+// Cost of a matrix product [batch, m, k] x [batch, k, n], plus an optional bias
+static void matmul_cost(uint64_t batch, uint64_t m, uint64_t k, uint64_t n, uint64_t element_size,
+                        uint64_t bias_bytes, bool has_bias, OpCost &cost) {
+  cost.flops = 2 * batch * m * k * n + (has_bias ? batch * m * n : 0);
+  cost.bytes = batch * (m * k + k * n + m * n) * element_size + bias_bytes;
+}
+
+// Cost of a convolution with weight [out_channels, in_channels / groups, kernel...]
+static bool conv_cost(const torch_monitor_input_t *inputs, size_t num_inputs, size_t stride_arg,
+                      size_t padding_arg, size_t dilation_arg, OpCost &cost) {
+  if (!is_tensor(inputs, num_inputs, 0) || !is_tensor(inputs, num_inputs, 1)) {
+    return false;
+  }
+  auto &input = inputs[0];
+  auto &weight = inputs[1];
+  if (input.dim < 3 || weight.dim != input.dim) {
+    return false;
+  }
+
+  auto batch = static_cast<uint64_t>(input.sizes[0]);
+  auto out_channels = static_cast<uint64_t>(weight.sizes[0]);
+  uint64_t kernel_size = 1;
+  uint64_t output_spatial = 1;
+  for (uint32_t i = 2; i < input.dim; ++i) {
+    auto kernel = weight.sizes[i];
+    auto stride = int_list_value(inputs, num_inputs, stride_arg, i - 2, 1);
+    // String paddings such as "same" keep the spatial size
+    auto padding = int_list_value(inputs, num_inputs, padding_arg, i - 2, 0);
+    auto dilation = int_list_value(inputs, num_inputs, dilation_arg, i - 2, 1);
+    int64_t output = input.sizes[i];
+    if (padding_arg < num_inputs &&
+        inputs[padding_arg].type == TORCH_MONITOR_INPUT_TYPE_INT_LIST && stride > 0) {
+      output = (input.sizes[i] + 2 * padding - dilation * (kernel - 1) - 1) / stride + 1;
+    }
+    if (output <= 0) {
+      return false;
+    }
+    kernel_size *= static_cast<uint64_t>(kernel);
+    output_spatial *= static_cast<uint64_t>(output);
+  }
+
+  auto output_numel = batch * out_channels * output_spatial;
+  auto element_size = c10::elementSize(static_cast<c10::ScalarType>(input.dtype));
+  cost.flops = 2 * output_numel * static_cast<uint64_t>(weight.sizes[1]) * kernel_size;
+  cost.bytes = input_bytes(input) + input_bytes(weight) + output_numel * element_size;
+  if (is_tensor(inputs, num_inputs, 2)) {
+    cost.flops += output_numel;
+    cost.bytes += input_bytes(inputs[2]);
+  }
+  return true;
+}
+
+bool CostModel::estimate_slow(uint32_t name_id, uint32_t signature_id, OpCost &cost) {
+  cost = {0, 0};
+
+  auto *name = NameTable::instance().lookup(name_id);
+  if (name == nullptr) {
+    return false;
+  }
+  auto &kinds = op_kinds();
+  auto iter = kinds.find(name);
+  if (iter == kinds.end()) {
+    return false;
+  }
+
+  torch_monitor_input_t inputs[COST_MAX_INPUTS];
+  size_t num_inputs = 0;
+  if (!SignatureTable::instance().lookup(signature_id, COST_MAX_INPUTS, inputs, &num_inputs)) {
+    return false;
+  }
+
+  switch (iter->second) {
+    case OP_KIND_MM: {
+      if (!is_tensor(inputs, num_inputs, 0, 2) || !is_tensor(inputs, num_inputs, 1, 2)) {
+        return false;
+      }
+      matmul_cost(1, inputs[0].sizes[0], inputs[0].sizes[1], inputs[1].sizes[1],
+                  c10::elementSize(static_cast<c10::ScalarType>(inputs[0].dtype)), 0, false,
+                  cost);
+      return true;
+    }
+    case OP_KIND_ADDMM: {
+      if (!is_tensor(inputs, num_inputs, 0) || !is_tensor(inputs, num_inputs, 1, 2) ||
+          !is_tensor(inputs, num_inputs, 2, 2)) {
+        return false;
+      }
+      matmul_cost(1, inputs[1].sizes[0], inputs[1].sizes[1], inputs[2].sizes[1],
+                  c10::elementSize(static_cast<c10::ScalarType>(inputs[1].dtype)),
+                  input_bytes(inputs[0]), true, cost);
+      return true;
+    }
+    case OP_KIND_BMM:
+    case OP_KIND_BADDBMM: {
+      // baddbmm(self, batch1, batch2)
+      size_t first = iter->second == OP_KIND_BMM ? 0 : 1;
+      if (!is_tensor(inputs, num_inputs, first, 3) ||
+          !is_tensor(inputs, num_inputs, first + 1, 3)) {
+        return false;
+      }
+      auto &left = inputs[first];
+      auto &right = inputs[first + 1];
+      bool has_bias = first == 1 && is_tensor(inputs, num_inputs, 0);
+      matmul_cost(left.sizes[0], left.sizes[1], left.sizes[2], right.sizes[2],
+                  c10::elementSize(static_cast<c10::ScalarType>(left.dtype)),
+                  has_bias ? input_bytes(inputs[0]) : 0, has_bias, cost);
+      return true;
+    }
+    case OP_KIND_LINEAR: {
+      // linear(input [..., in_features], weight [out_features, in_features], bias)
+      if (!is_tensor(inputs, num_inputs, 0) || !is_tensor(inputs, num_inputs, 1, 2) ||
+          inputs[0].dim == 0 || inputs[1].sizes[1] == 0) {
+        return false;
+      }
+      auto in_features = static_cast<uint64_t>(inputs[1].sizes[1]);
+      auto rows = input_numel(inputs[0]) / in_features;
+      bool has_bias = is_tensor(inputs, num_inputs, 2);
+      matmul_cost(1, rows, in_features, inputs[1].sizes[0],
+                  c10::elementSize(static_cast<c10::ScalarType>(inputs[0].dtype)),
+                  has_bias ? input_bytes(inputs[2]) : 0, has_bias, cost);
+      return true;
+    }
+    case OP_KIND_CONV: {
+      return conv_cost(inputs, num_inputs, 3, 4, 5, cost);
+    }
+    case OP_KIND_CONVOLUTION: {
+      // Transposed convolutions are not modeled
+      if (num_inputs > 6 && inputs[6].type == TORCH_MONITOR_INPUT_TYPE_BOOL &&
+          inputs[6].value.int_value != 0) {
+        return false;
+      }
+      return conv_cost(inputs, num_inputs, 3, 4, 5, cost);
+    }
+    case OP_KIND_ELEMENTWISE: {
+      // The output has the broadcast shape, approximated by the largest input
+      uint64_t output_bytes = 0;
+      for (size_t i = 0; i < num_inputs; ++i) {
+        if (inputs[i].type == TORCH_MONITOR_INPUT_TYPE_TENSOR) {
+          auto bytes = input_bytes(inputs[i]);
+          cost.flops = std::max(cost.flops, input_numel(inputs[i]));
+          cost.bytes += bytes;
+          output_bytes = std::max(output_bytes, bytes);
+        }
+      }
+      cost.bytes += output_bytes;
+      return cost.bytes != 0;
+    }
+    case OP_KIND_REDUCTION: {
+      if (!is_tensor(inputs, num_inputs, 0)) {
+        return false;
+      }
+      cost.flops = input_numel(inputs[0]);
+      cost.bytes = input_bytes(inputs[0]);
+      return true;
+    }
+    default:
+      return false;
+  }
+}
+
+CostModel &CostModel::instance() {
+  static CostModel cost_model;
+  return cost_model;
+}
+
+CostModel::OpThroughputTable *CostModel::register_thread_table() {
+  _thread_table = std::make_shared<OpThroughputTable>();
+
+  std::lock_guard<std::mutex> lock(_mutex);
+  _tables.push_back(_thread_table);
+  return _thread_table.get();
+}
+
+void CostModel::merge() {
+  std::lock_guard<std::mutex> lock(_mutex);
+
+  for (auto &table : _tables) {
+    for (auto &iter : *table) {
+      auto &merged = _merged_table[iter.first];
+      merged.count += iter.second.count;
+      merged.time += iter.second.time;
+      merged.flops += iter.second.flops;
+      merged.bytes += iter.second.bytes;
+    }
+    table->clear();
+  }
+  _merged = true;
+}
+
+size_t CostModel::get(size_t max_num_results, torch_monitor_op_throughput_t *results) {
+  std::lock_guard<std::mutex> lock(_mutex);
+
+  auto &name_table = NameTable::instance();
+  auto &timer = Timer::instance();
+  size_t num_results = 0;
+  for (auto &iter : _merged_table) {
+    if (num_results == max_num_results) {
+      break;
+    }
+    auto &result = results[num_results++];
+    result.name_id = iter.first.first;
+    result.name = name_table.lookup(iter.first.first);
+    result.callpath_id = iter.first.second;
+    result.count = iter.second.count;
+    result.time = timer.duration_to_ns(iter.second.time);
+    result.flops = iter.second.flops;
+    result.bytes = iter.second.bytes;
+    // FLOP/ns and byte/ns equal GFLOP/s and GB/s
+    if (result.time != 0) {
+      result.gflops_per_second = static_cast<double>(result.flops) / result.time;
+      result.gbytes_per_second = static_cast<double>(result.bytes) / result.time;
+    } else {
+      result.gflops_per_second = 0.0;
+      result.gbytes_per_second = 0.0;
+    }
+  }
+  return num_results;
+}
+
+}  // namespace torch_monitor
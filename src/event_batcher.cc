@@ -0,0 +1,244 @@
+#include "event_batcher.h"
+
+namespace torch_monitor {
+
+void EventColumns::append(torch_monitor_callback_site_t callback_site,
+                          const torch_monitor_callback_data_t *callback_data) {
+  domain.push_back(callback_data->domain);
+  site.push_back(callback_site);
+  thread_id.push_back(callback_data->current_thread_id);
+  timestamp.push_back(callback_data->timestamp);
+  weight.push_back(callback_data->weight);
+  if (callback_data->domain == TORCH_MONITOR_DOMAIN_MEMORY) {
+    auto &mem_data = callback_data->data.mem_data;
+    sequence_number.push_back(-1);
+    nested_level.push_back(0);
+    name_id.push_back(0);
+    mem_size.push_back(mem_data.type == TORCH_MONITOR_MEM_DATA_FREE ? -mem_data.size
+                                                                    : mem_data.size);
+    mem_total_allocated.push_back(mem_data.total_allocated);
+    mem_total_reserved.push_back(mem_data.total_reserved);
+  } else {
+    auto &op_data = callback_data->data.op_data;
+    sequence_number.push_back(op_data.sequence_number);
+    nested_level.push_back(op_data.nested_level);
+    name_id.push_back(op_data.name_id);
+    mem_size.push_back(0);
+    mem_total_allocated.push_back(0);
+    mem_total_reserved.push_back(0);
+  }
+}
+
+void EventColumns::reserve(size_t batch_size) {
+  domain.reserve(batch_size);
+  site.reserve(batch_size);
+  thread_id.reserve(batch_size);
+  sequence_number.reserve(batch_size);
+  nested_level.reserve(batch_size);
+  name_id.reserve(batch_size);
+  timestamp.reserve(batch_size);
+  weight.reserve(batch_size);
+  mem_size.reserve(batch_size);
+  mem_total_allocated.reserve(batch_size);
+  mem_total_reserved.reserve(batch_size);
+}
+
+void EventColumns::clear() {
+  domain.clear();
+  site.clear();
+  thread_id.clear();
+  sequence_number.clear();
+  nested_level.clear();
+  name_id.clear();
+  timestamp.clear();
+  weight.clear();
+  mem_size.clear();
+  mem_total_allocated.clear();
+  mem_total_reserved.clear();
+}
+
+void EventColumns::flush(torch_monitor_batch_callback_func_t func) {
+  if (size() == 0) {
+    return;
+  }
+
+  torch_monitor_event_batch_t batch;
+  batch.num_events = size();
+  batch.domain = domain.data();
+  batch.site = site.data();
+  batch.thread_id = thread_id.data();
+  batch.sequence_number = sequence_number.data();
+  batch.nested_level = nested_level.data();
+  batch.name_id = name_id.data();
+  batch.timestamp = timestamp.data();
+  batch.weight = weight.data();
+  batch.mem_size = mem_size.data();
+  batch.mem_total_allocated = mem_total_allocated.data();
+  batch.mem_total_reserved = mem_total_reserved.data();
+  func(&batch);
+  clear();
+}
+
+bool EventBatcher::subscribe(torch_monitor_batch_callback_func_t func, uint64_t domain_mask,
+                             size_t batch_size) {
+  std::lock_guard<std::mutex> lock(_mutex);
+
+  BatchSubscriber *free_subscriber = nullptr;
+  for (auto &subscriber : _subscribers) {
+    auto subscriber_func = subscriber.func.load(std::memory_order_relaxed);
+    if (subscriber_func == func) {
+      return false;
+    }
+    if (subscriber_func == nullptr && free_subscriber == nullptr) {
+      free_subscriber = &subscriber;
+    }
+  }
+  if (free_subscriber == nullptr) {
+    return false;
+  }
+
+  free_subscriber->domain_mask.store(domain_mask, std::memory_order_relaxed);
+  free_subscriber->batch_size.store(batch_size, std::memory_order_relaxed);
+  free_subscriber->generation.fetch_add(1, std::memory_order_relaxed);
+  // Publish the slot after its fields
+  free_subscriber->func.store(func, std::memory_order_release);
+  update_domain_mask();
+  return true;
+}
+
+bool EventBatcher::unsubscribe(torch_monitor_batch_callback_func_t func) {
+  std::lock_guard<std::mutex> lock(_mutex);
+
+  for (auto &subscriber : _subscribers) {
+    if (subscriber.func.load(std::memory_order_relaxed) == func) {
+      subscriber.func.store(nullptr, std::memory_order_release);
+      update_domain_mask();
+      return true;
+    }
+  }
+  return false;
+}
+
+void EventBatcher::update_domain_mask() {
+  uint64_t domain_mask = 0;
+  for (auto &subscriber : _subscribers) {
+    if (subscriber.func.load(std::memory_order_relaxed) != nullptr) {
+      domain_mask |= subscriber.domain_mask.load(std::memory_order_relaxed);
+    }
+  }
+  _domain_mask.store(domain_mask, std::memory_order_relaxed);
+}
+
+EventBatcher::ThreadBatches *EventBatcher::register_thread_batches() {
+  _thread_batches.batches = std::make_shared<ThreadBatches>();
+  std::lock_guard<std::mutex> lock(_mutex);
+  _batches.push_back(_thread_batches.batches);
+  return _thread_batches.batches.get();
+}
+
+void EventBatcher::unregister_thread_batches(const std::shared_ptr<ThreadBatches> &batches) {
+  flush(*batches);
+
+  std::lock_guard<std::mutex> lock(_mutex);
+  for (auto iter = _batches.begin(); iter != _batches.end(); ++iter) {
+    if (*iter == batches) {
+      _batches.erase(iter);
+      break;
+    }
+  }
+}
+
+EventBatcher::ThreadBatchesOwner::~ThreadBatchesOwner() {
+  if (batches != nullptr) {
+    EventBatcher::instance().unregister_thread_batches(batches);
+  }
+}
+
+void EventBatcher::append(torch_monitor_callback_site_t callback_site,
+                          const torch_monitor_callback_data_t *callback_data) {
+  auto *batches = _thread_batches.batches.get();
+  if (batches == nullptr) {
+    batches = register_thread_batches();
+  }
+  if (batches->flushing) {
+    return;
+  }
+
+  for (size_t i = 0; i < BATCH_SUBSCRIBER_MAX; ++i) {
+    auto &subscriber = _subscribers[i];
+    auto func = subscriber.func.load(std::memory_order_acquire);
+    if (func == nullptr ||
+        !(subscriber.domain_mask.load(std::memory_order_relaxed) &
+          TORCH_MONITOR_DOMAIN_MASK(callback_data->domain))) {
+      continue;
+    }
+
+    auto &columns = batches->columns[i];
+    auto generation = subscriber.generation.load(std::memory_order_relaxed);
+    auto batch_size = subscriber.batch_size.load(std::memory_order_relaxed);
+    if (columns.generation != generation) {
+      // The slot has been taken by another subscriber
+      columns.clear();
+      columns.reserve(batch_size);
+      columns.generation = generation;
+    }
+
+    columns.append(callback_site, callback_data);
+    if (columns.size() >= batch_size) {
+      batches->flushing = true;
+      columns.flush(func);
+      batches->flushing = false;
+    }
+  }
+}
+
+void EventBatcher::flush(ThreadBatches &batches) {
+  std::lock_guard<std::recursive_mutex> lock(batches.mutex);
+
+  batches.flushing = true;
+  for (size_t i = 0; i < BATCH_SUBSCRIBER_MAX; ++i) {
+    auto &subscriber = _subscribers[i];
+    auto &columns = batches.columns[i];
+    auto func = subscriber.func.load(std::memory_order_acquire);
+    if (func != nullptr &&
+        columns.generation == subscriber.generation.load(std::memory_order_relaxed)) {
+      columns.flush(func);
+    } else {
+      columns.clear();
+    }
+  }
+  batches.flushing = false;
+}
+
+void EventBatcher::flush() {
+  if (auto *batches = _thread_batches.batches.get()) {
+    flush(*batches);
+  }
+}
+
+void EventBatcher::flush_all() {
+  std::vector<std::shared_ptr<ThreadBatches>> batches_list;
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    batches_list = _batches;
+  }
+  for (auto &batches : batches_list) {
+    flush(*batches);
+  }
+}
+
+void EventBatcher::clear() {
+  std::lock_guard<std::mutex> lock(_mutex);
+
+  for (auto &subscriber : _subscribers) {
+    subscriber.func.store(nullptr, std::memory_order_release);
+  }
+  update_domain_mask();
+}
+
+EventBatcher &EventBatcher::instance() {
+  static EventBatcher batcher;
+  return batcher;
+}
+
+}  // namespace torch_monitor
@@ -0,0 +1,113 @@
+#include "event_buffer.h"
+
+#include <chrono>
+
+#include "name_table.h"
+#include "torch_profiler.h"
+#include "utils.h"
+
+namespace torch_monitor {
+
+// Sleep interval of the consumer when all buffers are empty
+static const auto EVENT_BUFFER_IDLE_INTERVAL = std::chrono::microseconds(100);
+
+EventBufferManager &EventBufferManager::instance() {
+  static EventBufferManager manager;
+  return manager;
+}
+
+EventBufferManager::~EventBufferManager() {
+  if (_consumer.joinable()) {
+    _running.store(false, std::memory_order_release);
+    _consumer.join();
+  }
+}
+
+bool EventBufferManager::set_capacity(size_t capacity) {
+  if (is_running() || capacity == 0 || (capacity & (capacity - 1)) != 0) {
+    return false;
+  }
+  _capacity = capacity;
+  return true;
+}
+
+EventRingBuffer *EventBufferManager::register_thread_buffer() {
+  _thread_buffer = std::make_shared<EventRingBuffer>(_capacity);
+
+  std::lock_guard<std::mutex> lock(_mutex);
+  _buffers.push_back(_thread_buffer);
+
+  LOG_INFO("Register event buffer %p", _thread_buffer.get());
+  return _thread_buffer.get();
+}
+
+size_t EventBufferManager::drain() {
+  size_t num_records = 0;
+
+  std::lock_guard<std::mutex> lock(_mutex);
+  for (auto iter = _buffers.begin(); iter != _buffers.end();) {
+    auto &buffer = *iter;
+    num_records += buffer->drain([](const EventRecord &record) {
+      auto callback_data = record.callback_data;
+      if (callback_data.domain != TORCH_MONITOR_DOMAIN_MEMORY) {
+        // The original name may be a temporary string of a finished user scope
+        callback_data.data.op_data.name =
+            NameTable::instance().lookup(callback_data.data.op_data.name_id);
+      }
+      TorchProfiler::deliver_callback(record.callback_site, &callback_data, record.step);
+    });
+    // The owner thread has exited and the buffer has been drained
+    if (buffer.use_count() == 1) {
+      _retired_dropped += buffer->dropped();
+      iter = _buffers.erase(iter);
+    } else {
+      ++iter;
+    }
+  }
+
+  return num_records;
+}
+
+void EventBufferManager::consume() {
+  while (_running.load(std::memory_order_acquire)) {
+    if (drain() == 0) {
+      std::this_thread::sleep_for(EVENT_BUFFER_IDLE_INTERVAL);
+    }
+  }
+}
+
+bool EventBufferManager::start() {
+  if (is_running()) {
+    return false;
+  }
+  _running.store(true, std::memory_order_release);
+  _consumer = std::thread(&EventBufferManager::consume, this);
+  return true;
+}
+
+bool EventBufferManager::stop() {
+  if (!is_running()) {
+    return false;
+  }
+  _running.store(false, std::memory_order_release);
+  _consumer.join();
+  // Deliver records pushed after the last round of the consumer
+  drain();
+
+  auto num_dropped = dropped();
+  if (num_dropped != 0) {
+    fprintf(stderr, "TORCH_MONITOR-> %zu events dropped due to full event buffers\n", num_dropped);
+  }
+  return true;
+}
+
+size_t EventBufferManager::dropped() {
+  std::lock_guard<std::mutex> lock(_mutex);
+  size_t num_dropped = _retired_dropped;
+  for (auto &buffer : _buffers) {
+    num_dropped += buffer->dropped();
+  }
+  return num_dropped;
+}
+
+}  // namespace torch_monitor
@@ -0,0 +1,117 @@
+#include "flame_graph.h"
+
+#include <map>
+#include <string>
+
+#include "name_table.h"
+#include "python_state.h"
+#include "timer.h"
+
+namespace torch_monitor {
+
+FlameGraph &FlameGraph::instance() {
+  static FlameGraph flame_graph;
+  return flame_graph;
+}
+
+bool FlameGraph::enable(const char *path, torch_monitor_flame_graph_metric_t metric,
+                        size_t max_num_states) {
+  std::lock_guard<std::mutex> lock(_mutex);
+
+  if (_file != nullptr) {
+    fclose(_file);
+  }
+  _file = fopen(path, "w");
+  if (_file == nullptr) {
+    return false;
+  }
+  _metric = metric;
+  _max_num_states = max_num_states;
+  _enabled.store(true, std::memory_order_relaxed);
+  return true;
+}
+
+FlameGraph::Trie *FlameGraph::register_thread_trie() {
+  _thread_trie = std::make_shared<Trie>();
+
+  std::lock_guard<std::mutex> lock(_mutex);
+  _tries.push_back(_thread_trie);
+  return _thread_trie.get();
+}
+
+uint32_t FlameGraph::root(Trie &trie) {
+  auto callpath_id = _max_num_states != 0
+                         ? PythonStateMonitor::instance().get_callpath_id(_max_num_states)
+                         : PythonStateMonitor::CALLPATH_ID_NULL;
+  auto iter = trie.roots.find(callpath_id);
+  if (iter != trie.roots.end()) {
+    return iter->second;
+  }
+  auto node = static_cast<uint32_t>(trie.nodes.size());
+  trie.nodes.push_back(Node{FLAME_NODE_NULL, NameTable::NAME_ID_NULL, callpath_id});
+  trie.roots.emplace(callpath_id, node);
+  return node;
+}
+
+// Frames of the python call path from the outermost frame, as "function (file:line)"
+static std::string callpath_frames(uint64_t callpath_id, size_t max_num_states) {
+  std::vector<torch_monitor_python_state_t> states(max_num_states);
+  auto num_states =
+      PythonStateMonitor::instance().expand_callpath(callpath_id, max_num_states, states.data());
+  std::string frames;
+  for (size_t i = num_states; i > 0; --i) {
+    auto &state = states[i - 1];
+    if (!frames.empty()) {
+      frames += ";";
+    }
+    frames += std::string(state.function_name) + " (" + state.file_name + ":" +
+              std::to_string(state.lineno) + ")";
+  }
+  return frames;
+}
+
+void FlameGraph::write() {
+  std::lock_guard<std::mutex> lock(_mutex);
+
+  if (_file == nullptr) {
+    return;
+  }
+
+  // The same stack on different threads is one line
+  std::map<std::string, uint64_t> stacks;
+  auto &name_table = NameTable::instance();
+  auto &timer = Timer::instance();
+  for (auto &trie : _tries) {
+    // Parents are always created before their children
+    std::vector<std::string> paths(trie->nodes.size());
+    for (size_t i = 0; i < trie->nodes.size(); ++i) {
+      auto &node = trie->nodes[i];
+      if (node.parent == FLAME_NODE_NULL) {
+        if (_max_num_states != 0 && node.callpath_id != PythonStateMonitor::CALLPATH_ID_NULL) {
+          paths[i] = callpath_frames(node.callpath_id, _max_num_states);
+        }
+        continue;
+      }
+      auto &parent_path = paths[node.parent];
+      paths[i] = parent_path.empty() ? name_table.lookup(node.name_id)
+                                     : parent_path + ";" + name_table.lookup(node.name_id);
+      auto value = _metric == TORCH_MONITOR_FLAME_GRAPH_METRIC_CALLS
+                       ? node.count
+                       : timer.duration_to_ns(node.self);
+      if (value != 0) {
+        stacks[paths[i]] += value;
+      }
+    }
+    trie->nodes.clear();
+    trie->children.clear();
+    trie->roots.clear();
+  }
+
+  for (auto &iter : stacks) {
+    fprintf(_file, "%s %lu\n", iter.first.c_str(), static_cast<unsigned long>(iter.second));
+  }
+  fclose(_file);
+  _file = nullptr;
+}
+
+}  // namespace torch_monitor
@@ -0,0 +1,126 @@
+#include "memory_analyzer.h"
+
+#include <algorithm>
+
+#include "timer.h"
+
+namespace torch_monitor {
+
+MemoryAnalyzer &MemoryAnalyzer::instance() {
+  static MemoryAnalyzer analyzer;
+  return analyzer;
+}
+
+void MemoryAnalyzer::record(torch_monitor_device_type_t device_type, const void *ptr,
+                            int64_t size, int64_t total_allocated, int64_t total_reserved,
+                            uint64_t timestamp) {
+  // XPU, MPS, Meta and other devices are not mapped to a device type
+  if (device_type >= TORCH_MONITOR_DEVICE_TYPE_COUNT) {
+    return;
+  }
+
+  auto &state = _states[device_type];
+  std::lock_guard<std::mutex> lock(state.mutex);
+
+  if (size >= 0) {
+    ++state.alloc_count;
+    auto size_class = MemoryAnalyzer::size_class(size);
+    ++state.size_class_counts[size_class];
+    state.size_class_bytes[size_class] += size;
+    state.live[ptr] = timestamp;
+  } else {
+    ++state.free_count;
+    // Blocks allocated before the analyzer was enabled have no lifetime
+    auto iter = state.live.find(ptr);
+    if (iter != state.live.end()) {
+      ++state.lifetime_count;
+      state.lifetime.record(timestamp - iter->second);
+      state.live.erase(iter);
+    }
+  }
+
+  state.max_allocated = std::max(state.max_allocated, total_allocated);
+  state.max_reserved = std::max(state.max_reserved, total_reserved);
+  state.max_gap = std::max(state.max_gap, total_reserved - total_allocated);
+  sample(state, Timer::instance().to_ns(timestamp), total_allocated, total_reserved);
+}
+
+void MemoryAnalyzer::sample(DeviceState &state, uint64_t ns, int64_t total_allocated,
+                            int64_t total_reserved) {
+  if (state.samples.empty()) {
+    state.start = ns;
+  }
+  // Events from other threads can be slightly out of order
+  auto offset = ns > state.start ? ns - state.start : 0;
+  auto index = offset / state.interval;
+  while (index >= MEMORY_TIMELINE_MAX_SAMPLES) {
+    // Halve the resolution, each sample keeps the maxima of the two samples it replaces
+    auto &samples = state.samples;
+    for (size_t i = 0; i < samples.size(); i += 2) {
+      auto merged = samples[i];
+      if (i + 1 < samples.size()) {
+        auto &next = samples[i + 1];
+        merged.allocated = std::max(merged.allocated, next.allocated);
+        merged.reserved = std::max(merged.reserved, next.reserved);
+        merged.gap = std::max(merged.gap, next.gap);
+      }
+      merged.timestamp = state.start + (i / 2) * state.interval * 2;
+      samples[i / 2] = merged;
+    }
+    samples.resize((samples.size() + 1) / 2);
+    state.interval *= 2;
+    index = offset / state.interval;
+  }
+
+  // Intervals without events repeat the last totals
+  while (state.samples.size() <= index) {
+    torch_monitor_memory_sample_t sample;
+    if (state.samples.empty()) {
+      sample.allocated = total_allocated;
+      sample.reserved = total_reserved;
+      sample.gap = total_reserved - total_allocated;
+    } else {
+      sample = state.samples.back();
+    }
+    sample.timestamp = state.start + state.samples.size() * state.interval;
+    state.samples.push_back(sample);
+  }
+  auto &sample = state.samples[index];
+  sample.allocated = std::max(sample.allocated, total_allocated);
+  sample.reserved = std::max(sample.reserved, total_reserved);
+  sample.gap = std::max(sample.gap, total_reserved - total_allocated);
+}
+
+void MemoryAnalyzer::summary(torch_monitor_device_type_t device_type,
+                             torch_monitor_memory_summary_t *summary) {
+  auto &state = _states[device_type];
+  std::lock_guard<std::mutex> lock(state.mutex);
+
+  summary->device_type = device_type;
+  summary->alloc_count = state.alloc_count;
+  summary->free_count = state.free_count;
+  for (size_t i = 0; i < TORCH_MONITOR_SIZE_CLASS_COUNT; ++i) {
+    summary->size_class_counts[i] = state.size_class_counts[i];
+    summary->size_class_bytes[i] = state.size_class_bytes[i];
+  }
+  if (state.lifetime_count != 0) {
+    copy_latency_stats(state.lifetime, state.lifetime_count, summary->lifetime);
+  } else {
+    summary->lifetime = {};
+  }
+  summary->max_allocated = state.max_allocated;
+  summary->max_reserved = state.max_reserved;
+  summary->max_gap = state.max_gap;
+}
+
+size_t MemoryAnalyzer::timeline(torch_monitor_device_type_t device_type, size_t max_num_samples,
+                                torch_monitor_memory_sample_t *samples) {
+  auto &state = _states[device_type];
+  std::lock_guard<std::mutex> lock(state.mutex);
+
+  auto num_samples = std::min(max_num_samples, state.samples.size());
+  std::copy(state.samples.begin(), state.samples.begin() + num_samples, samples);
+  return num_samples;
+}
+
+}  // namespace torch_monitor
@@ -0,0 +1,19 @@
+#include "memory_coalescer.h"
+
+namespace torch_monitor {
+
+MemoryCoalescer &MemoryCoalescer::instance() {
+  static MemoryCoalescer coalescer;
+  return coalescer;
+}
+
+MemoryCoalescer::PendingState *MemoryCoalescer::register_thread_state(uint32_t epoch) {
+  _thread_state = std::make_shared<PendingState>();
+  _thread_state->epoch = epoch;
+
+  std::lock_guard<std::mutex> lock(_mutex);
+  _states.push_back(_thread_state);
+  return _thread_state.get();
+}
+
+}  // namespace torch_monitor
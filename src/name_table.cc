@@ -0,0 +1,43 @@
+#include "name_table.h"
+
+#include "utils.h"
+
+namespace torch_monitor {
+
+NameTable &NameTable::instance() {
+  static NameTable table;
+  return table;
+}
+
+NameTable::NameTable() {
+  const char *interned_name = nullptr;
+  intern_slow("", &interned_name);
+}
+
+uint32_t NameTable::intern_slow(const char *name, const char **interned_name) {
+  std::lock_guard<std::mutex> lock(_mutex);
+
+  auto iter = _ids.find(name);
+  if (iter == _ids.end()) {
+    auto id = _size.load(std::memory_order_relaxed);
+    if (id == NAME_PAGE_SIZE * NAME_MAX_PAGES) {
+      LOG_INFO("name table is full, %s is not interned", name);
+      *interned_name = "";
+      return NAME_ID_NULL;
+    }
+    iter = _ids.emplace(name, id).first;
+
+    auto page = id / NAME_PAGE_SIZE;
+    if (_pages[page].load(std::memory_order_relaxed) == nullptr) {
+      _pages[page].store(new const char *[NAME_PAGE_SIZE], std::memory_order_relaxed);
+    }
+    _pages[page].load(std::memory_order_relaxed)[id % NAME_PAGE_SIZE] = iter->first.c_str();
+    // Publish the name before the new size
+    _size.store(id + 1, std::memory_order_release);
+  }
+
+  *interned_name = iter->first.c_str();
+  return iter->second;
+}
+
+}  // namespace torch_monitor
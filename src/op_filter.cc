@@ -0,0 +1,101 @@
+#include "op_filter.h"
+
+#include "name_table.h"
+
+namespace torch_monitor {
+
+OpFilter &OpFilter::instance() {
+  static OpFilter filter;
+  return filter;
+}
+
+bool OpFilter::add(const char *pattern, torch_monitor_op_filter_mode_t mode) {
+  std::lock_guard<std::mutex> lock(_mutex);
+
+  if (_sealed || pattern == nullptr || pattern[0] == '\0') {
+    return false;
+  }
+  if (mode == TORCH_MONITOR_OP_FILTER_MODE_ALLOW) {
+    _allow_patterns.emplace_back(pattern);
+  } else {
+    _deny_patterns.emplace_back(pattern);
+  }
+  _enabled.store(true, std::memory_order_relaxed);
+  return true;
+}
+
+void OpFilter::seal() {
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _sealed = true;
+  }
+  if (is_enabled()) {
+    auto num_names = NameTable::instance().size();
+    for (uint32_t name_id = 0; name_id < num_names; ++name_id) {
+      pass(name_id);
+    }
+  }
+}
+
+// Greedy matching that backtracks to the last '*' only
+bool OpFilter::match(const char *pattern, const char *name) {
+  const char *star = nullptr;
+  const char *star_name = nullptr;
+  while (*name != '\0') {
+    if (*pattern == '*') {
+      star = pattern++;
+      star_name = name;
+    } else if (*pattern == '?' || *pattern == *name) {
+      ++pattern;
+      ++name;
+    } else if (star != nullptr) {
+      pattern = star + 1;
+      name = ++star_name;
+    } else {
+      return false;
+    }
+  }
+  while (*pattern == '*') {
+    ++pattern;
+  }
+  return *pattern == '\0';
+}
+
+bool OpFilter::pass_slow(uint32_t name_id) {
+  if (name_id >= OP_FILTER_PAGE_SIZE * OP_FILTER_MAX_PAGES) {
+    return true;
+  }
+
+  std::lock_guard<std::mutex> lock(_mutex);
+
+  auto &page = _pages[name_id / OP_FILTER_PAGE_SIZE];
+  if (page.load(std::memory_order_relaxed) == nullptr) {
+    // Value-initialized to VERDICT_UNKNOWN
+    page.store(new std::atomic<uint8_t>[OP_FILTER_PAGE_SIZE](), std::memory_order_release);
+  }
+
+  const char *name = NameTable::instance().lookup(name_id);
+  if (name == nullptr) {
+    name = "";
+  }
+  bool allowed = _allow_patterns.empty();
+  for (auto &pattern : _allow_patterns) {
+    if (match(pattern.c_str(), name)) {
+      allowed = true;
+      break;
+    }
+  }
+  if (allowed) {
+    for (auto &pattern : _deny_patterns) {
+      if (match(pattern.c_str(), name)) {
+        allowed = false;
+        break;
+      }
+    }
+  }
+  page.load(std::memory_order_relaxed)[name_id % OP_FILTER_PAGE_SIZE].store(
+      allowed ? VERDICT_PASS : VERDICT_FILTER, std::memory_order_relaxed);
+  return allowed;
+}
+
+}  // namespace torch_monitor
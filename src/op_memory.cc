@@ -0,0 +1,71 @@
+#include "op_memory.h"
+
+#include "name_table.h"
+
+namespace torch_monitor {
+
+OpMemoryEngine &OpMemoryEngine::instance() {
+  static OpMemoryEngine engine;
+  return engine;
+}
+
+OpMemoryEngine::OpMemoryTable *OpMemoryEngine::register_thread_table() {
+  _thread_table = std::make_shared<OpMemoryTable>();
+
+  std::lock_guard<std::mutex> lock(_mutex);
+  _tables.push_back(_thread_table);
+  return _thread_table.get();
+}
+
+void OpMemoryEngine::merge() {
+  std::lock_guard<std::mutex> lock(_mutex);
+
+  for (auto &table : _tables) {
+    if (table->size() > _merged_table.size()) {
+      _merged_table.resize(table->size());
+    }
+    for (size_t name_id = 0; name_id < table->size(); ++name_id) {
+      _merged_table[name_id].innermost.merge((*table)[name_id].innermost);
+      _merged_table[name_id].master.merge((*table)[name_id].master);
+    }
+    table->clear();
+  }
+  _merged = true;
+}
+
+static void copy_memory_counters(const OpMemoryCounters &counters,
+                                 torch_monitor_memory_counters_t &result) {
+  result.alloc_count = counters.alloc_count;
+  result.alloc_bytes = counters.alloc_bytes;
+  result.free_count = counters.free_count;
+  result.free_bytes = counters.free_bytes;
+  result.transient_count = counters.transient_count;
+  result.transient_bytes = counters.transient_bytes;
+  result.net_bytes =
+      static_cast<int64_t>(counters.alloc_bytes) - static_cast<int64_t>(counters.free_bytes);
+}
+
+size_t OpMemoryEngine::get(size_t max_num_results, torch_monitor_op_memory_t *results) {
+  std::lock_guard<std::mutex> lock(_mutex);
+
+  auto &name_table = NameTable::instance();
+  size_t num_results = 0;
+  for (size_t name_id = 0; name_id < _merged_table.size() && num_results < max_num_results;
+       ++name_id) {
+    auto &memory = _merged_table[name_id];
+    if (memory.innermost.alloc_count + memory.innermost.free_count +
+            memory.innermost.transient_count + memory.master.alloc_count +
+            memory.master.free_count + memory.master.transient_count ==
+        0) {
+      continue;
+    }
+    auto &result = results[num_results++];
+    result.name_id = name_id;
+    result.name = name_table.lookup(name_id);
+    copy_memory_counters(memory.innermost, result.innermost);
+    copy_memory_counters(memory.master, result.master);
+  }
+  return num_results;
+}
+
+}  // namespace torch_monitor
@@ -0,0 +1,102 @@
+#include "op_stats.h"
+
+#include "name_table.h"
+#include "timer.h"
+
+namespace torch_monitor {
+
+uint64_t LatencyHistogram::quantile(double q, uint64_t count) const {
+  if (count == 0) {
+    return 0;
+  }
+  // The rank of the quantile, starting from 1
+  auto rank = static_cast<uint64_t>(q * (count - 1)) + 1;
+  uint64_t seen = 0;
+  for (size_t i = 0; i < LATENCY_NUM_BUCKETS; ++i) {
+    seen += _counts[i];
+    if (seen >= rank) {
+      if (i < LATENCY_SUB_BUCKETS) {
+        return i;
+      }
+      size_t exponent = i / LATENCY_SUB_BUCKETS + LATENCY_SUB_BITS - 1;
+      uint64_t width = 1ull << (exponent - LATENCY_SUB_BITS);
+      uint64_t lower = (LATENCY_SUB_BUCKETS + i % LATENCY_SUB_BUCKETS) * width;
+      return lower + width / 2;
+    }
+  }
+  return 0;
+}
+
+OpStatsEngine &OpStatsEngine::instance() {
+  static OpStatsEngine engine;
+  return engine;
+}
+
+OpStatsEngine::OpLatencyTable *OpStatsEngine::register_thread_table() {
+  _thread_table = std::make_shared<OpLatencyTable>();
+
+  std::lock_guard<std::mutex> lock(_mutex);
+  _tables.push_back(_thread_table);
+  return _thread_table.get();
+}
+
+void OpStatsEngine::merge() {
+  std::lock_guard<std::mutex> lock(_mutex);
+
+  for (auto &table : _tables) {
+    if (table->size() > _merged_table.size()) {
+      _merged_table.resize(table->size());
+    }
+    for (size_t name_id = 0; name_id < table->size(); ++name_id) {
+      auto &latency = (*table)[name_id];
+      if (latency == nullptr) {
+        continue;
+      }
+      auto &merged_latency = _merged_table[name_id];
+      if (merged_latency == nullptr) {
+        merged_latency = std::move(latency);
+      } else {
+        merged_latency->count += latency->count;
+        merged_latency->inclusive.merge(latency->inclusive);
+        merged_latency->self.merge(latency->self);
+      }
+    }
+    table->clear();
+  }
+  _merged = true;
+}
+
+// Durations are recorded in timer ticks and reported in nanoseconds
+void copy_latency_stats(const OpLatency::Distribution &distribution, uint64_t count,
+                        torch_monitor_latency_stats_t &stats) {
+  auto &timer = Timer::instance();
+  stats.total = timer.duration_to_ns(distribution.total);
+  stats.min = timer.duration_to_ns(distribution.min);
+  stats.max = timer.duration_to_ns(distribution.max);
+  stats.p50 = timer.duration_to_ns(distribution.histogram.quantile(0.5, count));
+  stats.p90 = timer.duration_to_ns(distribution.histogram.quantile(0.9, count));
+  stats.p99 = timer.duration_to_ns(distribution.histogram.quantile(0.99, count));
+}
+
+size_t OpStatsEngine::get(size_t max_num_stats, torch_monitor_op_stats_t *stats) {
+  std::lock_guard<std::mutex> lock(_mutex);
+
+  auto &name_table = NameTable::instance();
+  size_t num_stats = 0;
+  for (size_t name_id = 0; name_id < _merged_table.size() && num_stats < max_num_stats;
+       ++name_id) {
+    auto &latency = _merged_table[name_id];
+    if (latency == nullptr || latency->count == 0) {
+      continue;
+    }
+    auto &op_stats = stats[num_stats++];
+    op_stats.name_id = name_id;
+    op_stats.name = name_table.lookup(name_id);
+    op_stats.count = latency->count;
+    copy_latency_stats(latency->inclusive, latency->count, op_stats.inclusive);
+    copy_latency_stats(latency->self, latency->count, op_stats.self);
+  }
+  return num_stats;
+}
+
+}  // namespace torch_monitor
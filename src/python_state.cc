@@ -3,6 +3,9 @@
 #include <Python.h>
 #include <pybind11/pybind11.h>
 
+#include <algorithm>
+#include <optional>
+
 #include "utils.h"
 
 namespace torch_monitor {
@@ -12,6 +15,11 @@ PythonStateMonitor& PythonStateMonitor::instance() {
   return monitor;
 }
 
+PythonStateMonitor::PythonStateMonitor() {
+  // The root node does not have a frame
+  _nodes.push_back(CallPathNode{CALLPATH_ID_NULL, nullptr, 0});
+}
+
 // Take from PyTorch::THPUtils_unpackStringView
 std::string PythonStateMonitor::unpack_pyobject(PyObject* obj) {
   if (PyBytes_Check(obj)) {
@@ -33,26 +41,125 @@ std::string PythonStateMonitor::unpack_pyobject(PyObject* obj) {
   return "";
 }
 
-std::vector<PythonState>& PythonStateMonitor::get_states(bool cached) {
-  if (cached) {
-    return _states;
+const PythonStateMonitor::CodeInfo* PythonStateMonitor::intern_code(PyCodeObject* code) {
+  auto iter = _code_infos.find(code);
+  if (iter == _code_infos.end()) {
+    // Keep the code object alive so that its address identifies it for the whole run
+    Py_INCREF(reinterpret_cast<PyObject*>(code));
+    auto code_info = std::make_unique<CodeInfo>();
+    code_info->file_name = unpack_pyobject(code->co_filename);
+    code_info->function_name = unpack_pyobject(code->co_name);
+    code_info->function_first_lineno = code->co_firstlineno;
+    iter = _code_infos.emplace(code, std::move(code_info)).first;
+  }
+  return iter->second.get();
+}
+
+bool PythonStateMonitor::match_cache(PyFrameObject* frame, size_t max_depth) {
+  if (!_cache.valid || _cache.max_depth != max_depth) {
+    return false;
+  }
+
+  // Code objects of _frames are interned, so their addresses are not reused
+  for (auto& cached_frame : _frames) {
+    if (frame == nullptr || frame->f_code != cached_frame.code ||
+        static_cast<size_t>(PyFrame_GetLineNumber(frame)) != cached_frame.lineno) {
+      return false;
+    }
+    frame = frame->f_back;
   }
 
-  // GIL lock is required
-  pybind11::gil_scoped_acquire gil;
+  return _frames.size() == max_depth || frame == nullptr;
+}
+
+uint64_t PythonStateMonitor::get_callpath_id(size_t max_depth) {
+  // GIL lock is required.
+  // Inside an aten op called from python, the thread usually holds the GIL already.
+  std::optional<pybind11::gil_scoped_acquire> gil;
+  if (!PyGILState_Check()) {
+    gil.emplace();
+  }
 
   PyFrameObject* frame = PyEval_GetFrame();
-  _states.clear();
+  if (match_cache(frame, max_depth)) {
+    return _cache.callpath_id;
+  }
 
-  while (nullptr != frame) {
-    size_t lineno = PyFrame_GetLineNumber(frame);
-    size_t co_firstlineno = frame->f_code->co_firstlineno;
-    std::string file_name = unpack_pyobject(frame->f_code->co_filename);
-    std::string function_name = unpack_pyobject(frame->f_code->co_name);
-    _states.emplace_back(PythonState{file_name, function_name, co_firstlineno, lineno});
+  _frames.clear();
+  while (nullptr != frame && _frames.size() < max_depth) {
+    _frames.push_back(Frame{frame->f_code, static_cast<size_t>(PyFrame_GetLineNumber(frame))});
     frame = frame->f_back;
   }
+
+  _cache.valid = true;
+  _cache.max_depth = max_depth;
+
+  std::lock_guard<std::mutex> lock(_mutex);
+
+  // Insert from the outermost frame
+  uint64_t callpath_id = CALLPATH_ID_NULL;
+  for (auto iter = _frames.rbegin(); iter != _frames.rend(); ++iter) {
+    CallPathKey key{callpath_id, iter->code, iter->lineno};
+    auto child_iter = _children.find(key);
+    if (child_iter == _children.end()) {
+      _nodes.push_back(CallPathNode{callpath_id, intern_code(iter->code), iter->lineno});
+      child_iter = _children.emplace(key, _nodes.size() - 1).first;
+    }
+    callpath_id = child_iter->second;
+  }
+
+  _cache.callpath_id = callpath_id;
+  return callpath_id;
+}
+
+bool PythonStateMonitor::has_callpath(uint64_t callpath_id) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  return callpath_id < _nodes.size();
+}
+
+size_t PythonStateMonitor::expand_callpath(uint64_t callpath_id, size_t max_num_states,
+                                          torch_monitor_python_state_t* states) {
+  std::lock_guard<std::mutex> lock(_mutex);
+
+  if (callpath_id >= _nodes.size()) {
+    return 0;
+  }
+
+  size_t num_states = 0;
+  while (callpath_id != CALLPATH_ID_NULL && num_states < max_num_states) {
+    auto& node = _nodes[callpath_id];
+    states[num_states].file_name = node.code_info->file_name.c_str();
+    states[num_states].function_name = node.code_info->function_name.c_str();
+    states[num_states].function_first_lineno = node.code_info->function_first_lineno;
+    states[num_states].lineno = node.lineno;
+    ++num_states;
+    callpath_id = node.parent;
+  }
+  return num_states;
+}
+
+std::vector<PythonState>& PythonStateMonitor::get_states(bool cached, size_t max_depth) {
+  if (cached) {
+    return _states;
+  }
+
+  auto callpath_id = get_callpath_id(max_depth);
+  if (callpath_id == _states_callpath_id) {
+    return _states;
+  }
+  _states.clear();
+  _states_callpath_id = callpath_id;
+
+  std::lock_guard<std::mutex> lock(_mutex);
+
+  while (callpath_id != CALLPATH_ID_NULL) {
+    auto& node = _nodes[callpath_id];
+    _states.emplace_back(node.code_info->file_name.c_str(),
+                         node.code_info->function_name.c_str(),
+                         node.code_info->function_first_lineno, node.lineno);
+    callpath_id = node.parent;
+  }
   return _states;
 }
 
-}  // namespace torch_monitor
\ No newline at end of file
+}  // namespace torch_monitor
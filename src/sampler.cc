@@ -0,0 +1,29 @@
+#include "sampler.h"
+
+namespace torch_monitor {
+
+DomainSampler &DomainSampler::instance() {
+  static DomainSampler sampler;
+  return sampler;
+}
+
+DomainSampler::DomainSampler() {
+  for (auto &rate : _rates) {
+    rate.store(1.0, std::memory_order_relaxed);
+  }
+}
+
+AdaptiveSampler &AdaptiveSampler::instance() {
+  static AdaptiveSampler sampler;
+  return sampler;
+}
+
+bool DomainSampler::set_rate(torch_monitor_domain_t domain, double rate) {
+  if (!(rate > 0.0 && rate <= 1.0)) {
+    return false;
+  }
+  _rates[domain].store(rate, std::memory_order_relaxed);
+  return true;
+}
+
+}  // namespace torch_monitor
@@ -0,0 +1,224 @@
+#include "signature_table.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+namespace torch_monitor {
+
+// Each input starts with a header word:
+// bits 0-7 input type, bits 8-15 dtype, bits 16-23 flags, bits 32-63 dim.
+// Tensors are followed by dim sizes and dim strides if strided,
+// int lists by dim values, other inputs including undefined tensors by one value.
+const static uint64_t SIGNATURE_FLAG_STRIDED = 0x1;
+
+static uint64_t signature_header(torch_monitor_input_type_t type, int8_t dtype, uint64_t flags,
+                                 uint32_t dim) {
+  return static_cast<uint64_t>(type) | (static_cast<uint64_t>(static_cast<uint8_t>(dtype)) << 8) |
+         (flags << 16) | (static_cast<uint64_t>(dim) << 32);
+}
+
+static uint64_t signature_hash(const uint64_t *words, size_t num_words) {
+  uint64_t hash = num_words;
+  for (size_t i = 0; i < num_words; ++i) {
+    hash = (hash ^ words[i]) * 0x9e3779b97f4a7c15ull;
+    hash ^= hash >> 32;
+  }
+  return hash;
+}
+
+SignatureTable &SignatureTable::instance() {
+  static SignatureTable table;
+  return table;
+}
+
+SignatureTable::SignatureTable() {
+  // SIGNATURE_ID_NULL is a signature without inputs
+  uint64_t words[1] = {0};
+  intern_slow(words, 1, signature_hash(words, 1));
+}
+
+size_t SignatureTable::encode(const at::RecordFunction &fn) {
+  auto *words = _scratch;
+  size_t num_words = 1;
+  uint64_t num_inputs = 0;
+
+  for (const auto &input : fn.inputs()) {
+    if (input.isTensor()) {
+      const auto &tensor = input.toTensor();
+      if (!tensor.defined()) {
+        if (num_words + 2 > SIGNATURE_MAX_WORDS) {
+          break;
+        }
+        words[num_words++] = signature_header(TORCH_MONITOR_INPUT_TYPE_NONE, 0, 0, 0);
+        words[num_words++] = 0;
+      } else {
+        auto sizes = tensor.sizes();
+        bool strided = tensor.layout() == c10::kStrided;
+        size_t dim = sizes.size();
+        if (num_words + 1 + dim * (strided ? 2 : 1) > SIGNATURE_MAX_WORDS) {
+          break;
+        }
+        words[num_words++] = signature_header(
+            TORCH_MONITOR_INPUT_TYPE_TENSOR, static_cast<int8_t>(tensor.scalar_type()),
+            strided ? SIGNATURE_FLAG_STRIDED : 0, static_cast<uint32_t>(dim));
+        for (auto size : sizes) {
+          words[num_words++] = static_cast<uint64_t>(size);
+        }
+        if (strided) {
+          for (auto stride : tensor.strides()) {
+            words[num_words++] = static_cast<uint64_t>(stride);
+          }
+        }
+      }
+    } else if (input.isIntList()) {
+      // c10::List shares the storage of the IValue, unlike toIntVector
+      auto list = input.toIntList();
+      if (num_words + 1 + list.size() > SIGNATURE_MAX_WORDS) {
+        break;
+      }
+      words[num_words++] = signature_header(TORCH_MONITOR_INPUT_TYPE_INT_LIST, 0, 0,
+                                            static_cast<uint32_t>(list.size()));
+      for (size_t i = 0; i < list.size(); ++i) {
+        words[num_words++] = static_cast<uint64_t>(list.get(i));
+      }
+    } else {
+      if (num_words + 2 > SIGNATURE_MAX_WORDS) {
+        break;
+      }
+      uint64_t value = 0;
+      torch_monitor_input_type_t type;
+      if (input.isInt()) {
+        type = TORCH_MONITOR_INPUT_TYPE_INT;
+        value = static_cast<uint64_t>(input.toInt());
+      } else if (input.isDouble()) {
+        type = TORCH_MONITOR_INPUT_TYPE_DOUBLE;
+        auto double_value = input.toDouble();
+        memcpy(&value, &double_value, sizeof(value));
+      } else if (input.isBool()) {
+        type = TORCH_MONITOR_INPUT_TYPE_BOOL;
+        value = input.toBool();
+      } else if (input.isNone()) {
+        type = TORCH_MONITOR_INPUT_TYPE_NONE;
+      } else {
+        // Strings, tensor lists and other IValues only record their presence
+        type = TORCH_MONITOR_INPUT_TYPE_OTHER;
+      }
+      words[num_words++] = signature_header(type, 0, 0, 0);
+      words[num_words++] = value;
+    }
+    ++num_inputs;
+  }
+
+  words[0] = num_inputs;
+  return num_words;
+}
+
+uint32_t SignatureTable::intern(const at::RecordFunction &fn) {
+  auto num_words = encode(fn);
+  auto hash = signature_hash(_scratch, num_words);
+
+  auto &entry = _cache[hash & (SIGNATURE_CACHE_SIZE - 1)];
+  // Hashes can collide, so cached signatures are verified word by word.
+  // An empty entry refers to SIGNATURE_ID_NULL, which is also verified.
+  if (entry.hash == hash && match(record(entry.id), _scratch, num_words)) {
+    return entry.id;
+  }
+  entry.id = intern_slow(_scratch, num_words, hash);
+  entry.hash = hash;
+  return entry.id;
+}
+
+const uint64_t *SignatureTable::allocate_record(const uint64_t *words, size_t num_words) {
+  auto record_words = num_words + 1;
+  if (_arena.chunk == nullptr || _arena.used + record_words > _arena.capacity) {
+    size_t capacity = SIGNATURE_ARENA_CHUNK_WORDS;
+    if (record_words > capacity) {
+      capacity = record_words;
+    }
+    auto *chunk = static_cast<uint64_t *>(malloc(capacity * sizeof(uint64_t)));
+    if (chunk == nullptr) {
+      return nullptr;
+    }
+    // The rest of the previous chunk is abandoned
+    _arena.chunk = chunk;
+    _arena.used = 0;
+    _arena.capacity = capacity;
+  }
+
+  auto *record = _arena.chunk + _arena.used;
+  _arena.used += record_words;
+  record[0] = num_words;
+  memcpy(record + 1, words, num_words * sizeof(uint64_t));
+  return record;
+}
+
+uint32_t SignatureTable::intern_slow(const uint64_t *words, size_t num_words, uint64_t hash) {
+  std::lock_guard<std::mutex> lock(_mutex);
+
+  auto range = _ids.equal_range(hash);
+  for (auto iter = range.first; iter != range.second; ++iter) {
+    if (match(record(iter->second), words, num_words)) {
+      return iter->second;
+    }
+  }
+
+  auto id = _size.load(std::memory_order_relaxed);
+  if (id == SIGNATURE_PAGE_SIZE * SIGNATURE_MAX_PAGES) {
+    LOG_INFO("signature table is full");
+    return SIGNATURE_ID_NULL;
+  }
+  auto *record = allocate_record(words, num_words);
+  if (record == nullptr) {
+    return SIGNATURE_ID_NULL;
+  }
+  _ids.emplace(hash, id);
+
+  auto page = id / SIGNATURE_PAGE_SIZE;
+  if (_pages[page].load(std::memory_order_relaxed) == nullptr) {
+    _pages[page].store(new const uint64_t *[SIGNATURE_PAGE_SIZE], std::memory_order_relaxed);
+  }
+  _pages[page].load(std::memory_order_relaxed)[id % SIGNATURE_PAGE_SIZE] = record;
+  // Publish the record before the new size
+  _size.store(id + 1, std::memory_order_release);
+  return id;
+}
+
+bool SignatureTable::lookup(uint32_t signature_id, size_t max_num_inputs,
+                            torch_monitor_input_t *inputs, size_t *num_inputs) const {
+  if (signature_id >= size()) {
+    return false;
+  }
+
+  auto *words = record(signature_id) + 1;
+  auto total_inputs = static_cast<size_t>(words[0]);
+  size_t offset = 1;
+  size_t i = 0;
+  for (; i < total_inputs && i < max_num_inputs; ++i) {
+    auto header = words[offset++];
+    auto &input = inputs[i];
+    input.type = static_cast<torch_monitor_input_type_t>(header & 0xff);
+    input.dtype = static_cast<int8_t>((header >> 8) & 0xff);
+    input.dim = static_cast<uint32_t>(header >> 32);
+    input.sizes = nullptr;
+    input.strides = nullptr;
+    input.value.int_value = 0;
+    if (input.type == TORCH_MONITOR_INPUT_TYPE_TENSOR) {
+      input.sizes = reinterpret_cast<const int64_t *>(words + offset);
+      offset += input.dim;
+      if ((header >> 16) & SIGNATURE_FLAG_STRIDED) {
+        input.strides = reinterpret_cast<const int64_t *>(words + offset);
+        offset += input.dim;
+      }
+    } else if (input.type == TORCH_MONITOR_INPUT_TYPE_INT_LIST) {
+      input.sizes = reinterpret_cast<const int64_t *>(words + offset);
+      offset += input.dim;
+    } else {
+      memcpy(&input.value, words + offset, sizeof(input.value));
+      offset += 1;
+    }
+  }
+  *num_inputs = i;
+  return true;
+}
+
+}  // namespace torch_monitor
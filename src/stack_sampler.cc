@@ -0,0 +1,216 @@
+#include "stack_sampler.h"
+
+#include <sys/time.h>
+
+#include <chrono>
+
+#include "python_state.h"
+#include "utils.h"
+
+namespace torch_monitor {
+
+// Rings hold 25.6ms of samples at the maximum frequency, so the drainer never lets them fill
+static const auto STACK_SAMPLE_DRAIN_INTERVAL = std::chrono::milliseconds(5);
+
+StackSampler &StackSampler::instance() {
+  static StackSampler sampler;
+  return sampler;
+}
+
+StackSampler::~StackSampler() {
+  if (_drainer.joinable()) {
+    _running.store(false, std::memory_order_relaxed);
+    _drainer.join();
+  }
+}
+
+StackSampler::ThreadSamples *StackSampler::register_thread(OpStack &op_stack) {
+  auto samples = std::make_shared<ThreadSamples>();
+  samples->op_stack = &op_stack;
+
+  std::lock_guard<std::mutex> lock(_mutex);
+  _threads.push_back(samples);
+  // Published after the ring is initialized
+  std::atomic_signal_fence(std::memory_order_release);
+  _thread_samples = samples.get();
+  return _thread_samples;
+}
+
+void StackSampler::enter(OpStack &op_stack, uint32_t name_id) {
+  auto *samples = _thread_samples;
+  if (samples == nullptr) {
+    samples = register_thread(op_stack);
+  } else {
+    try_drain(*samples);
+  }
+
+  auto callpath_id = PythonStateMonitor::CALLPATH_ID_NULL;
+  if (_max_num_states != 0 && op_stack.depth() == 0) {
+    callpath_id = PythonStateMonitor::instance().get_callpath_id(_max_num_states);
+  }
+  op_stack.push(name_id, callpath_id);
+}
+
+void StackSampler::exit(OpStack &op_stack) {
+  op_stack.pop();
+  if (auto *samples = _thread_samples) {
+    try_drain(*samples);
+  }
+}
+
+void StackSampler::try_drain(ThreadSamples &samples) {
+  if (samples.head.load(std::memory_order_acquire) -
+          samples.tail.load(std::memory_order_relaxed) <
+      STACK_SAMPLE_RING_SIZE / 2) {
+    return;
+  }
+  std::unique_lock<std::mutex> lock(samples.mutex, std::try_to_lock);
+  if (lock.owns_lock()) {
+    drain(samples);
+  }
+}
+
+void StackSampler::run_drainer() {
+  while (_running.load(std::memory_order_relaxed)) {
+    std::this_thread::sleep_for(STACK_SAMPLE_DRAIN_INTERVAL);
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (auto &samples : _threads) {
+      std::lock_guard<std::mutex> samples_lock(samples->mutex);
+      drain(*samples);
+    }
+  }
+}
+
+void StackSampler::drain(ThreadSamples &samples) {
+  auto head = samples.head.load(std::memory_order_acquire);
+  auto tail = samples.tail.load(std::memory_order_relaxed);
+  StackKey key;
+  for (; tail != head; ++tail) {
+    auto &sample = samples.ring[tail & (STACK_SAMPLE_RING_SIZE - 1)];
+    key.assign({static_cast<uint32_t>(sample.callpath_id),
+                static_cast<uint32_t>(sample.callpath_id >> 32)});
+    key.insert(key.end(), sample.name_ids, sample.name_ids + sample.depth);
+    ++samples.table[key];
+  }
+  // Release the slots to the signal handler
+  samples.tail.store(tail, std::memory_order_release);
+}
+
+// Only async-signal-safe operations: lock-free atomics and plain memory accesses
+void StackSampler::signal_handler(int signo, siginfo_t *info, void *context) {
+  auto &sampler = StackSampler::instance();
+  if (!sampler._running.load(std::memory_order_relaxed)) {
+    return;
+  }
+
+  auto *samples = _thread_samples;
+  if (samples == nullptr) {
+    sampler._num_unattributed.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  auto head = samples->head.load(std::memory_order_relaxed);
+  if (head - samples->tail.load(std::memory_order_acquire) == STACK_SAMPLE_RING_SIZE) {
+    sampler._num_dropped.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+
+  auto &sample = samples->ring[head & (STACK_SAMPLE_RING_SIZE - 1)];
+  auto &op_stack = *samples->op_stack;
+  auto depth = op_stack.depth();
+  std::atomic_signal_fence(std::memory_order_acquire);
+  // Keep the outermost frames of deep stacks
+  sample.depth = depth;
+  if (sample.depth > OpStack::OP_STACK_MAX_DEPTH) {
+    sample.depth = OpStack::OP_STACK_MAX_DEPTH;
+  }
+  if (sample.depth > STACK_SAMPLE_MAX_DEPTH) {
+    sample.depth = STACK_SAMPLE_MAX_DEPTH;
+  }
+  for (uint32_t level = 0; level < sample.depth; ++level) {
+    sample.name_ids[level] = op_stack.frame(level).name_id;
+  }
+  sample.callpath_id =
+      depth != 0 ? op_stack.frame(0).callpath_id : PythonStateMonitor::CALLPATH_ID_NULL;
+  samples->head.store(head + 1, std::memory_order_release);
+}
+
+bool StackSampler::start() {
+  if (!_signal_installed) {
+    struct sigaction action = {};
+    action.sa_sigaction = signal_handler;
+    action.sa_flags = SA_SIGINFO | SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    if (sigaction(SIGPROF, &action, nullptr) != 0) {
+      LOG_INFO("cannot install the SIGPROF handler");
+      return false;
+    }
+    _signal_installed = true;
+  }
+
+  _running.store(true, std::memory_order_relaxed);
+  uint64_t interval = 1000000 / _frequency;
+  if (interval == 0) {
+    interval = 1;
+  }
+  struct itimerval timer = {};
+  timer.it_interval.tv_sec = interval / 1000000;
+  timer.it_interval.tv_usec = interval % 1000000;
+  timer.it_value = timer.it_interval;
+  if (setitimer(ITIMER_PROF, &timer, nullptr) != 0) {
+    LOG_INFO("cannot start the profiling timer");
+    _running.store(false, std::memory_order_relaxed);
+    return false;
+  }
+  _drainer = std::thread(&StackSampler::run_drainer, this);
+  return true;
+}
+
+void StackSampler::stop() {
+  struct itimerval timer = {};
+  setitimer(ITIMER_PROF, &timer, nullptr);
+  // A signal already raised still runs the handler, which then returns immediately
+  _running.store(false, std::memory_order_relaxed);
+  if (_drainer.joinable()) {
+    _drainer.join();
+  }
+}
+
+void StackSampler::merge() {
+  std::lock_guard<std::mutex> lock(_mutex);
+
+  for (auto &samples : _threads) {
+    std::lock_guard<std::mutex> samples_lock(samples->mutex);
+    drain(*samples);
+    for (auto &iter : samples->table) {
+      _merged_table[iter.first] += iter.second;
+    }
+    samples->table.clear();
+  }
+  // Samples outside any op
+  auto num_unattributed = _num_unattributed.exchange(0, std::memory_order_relaxed);
+  if (num_unattributed != 0) {
+    _merged_table[StackKey(2, 0)] += num_unattributed;
+  }
+  LOG_INFO("stack samples dropped: %llu", _num_dropped.load(std::memory_order_relaxed));
+  _merged = true;
+}
+
+size_t StackSampler::get(size_t max_num_samples, torch_monitor_stack_sample_t *samples) {
+  std::lock_guard<std::mutex> lock(_mutex);
+
+  size_t num_samples = 0;
+  for (auto &iter : _merged_table) {
+    if (num_samples == max_num_samples) {
+      break;
+    }
+    auto &key = iter.first;
+    auto &sample = samples[num_samples++];
+    sample.callpath_id = static_cast<uint64_t>(key[0]) | (static_cast<uint64_t>(key[1]) << 32);
+    sample.depth = static_cast<uint32_t>(key.size() - 2);
+    sample.name_ids = key.data() + 2;
+    sample.count = iter.second;
+  }
+  return num_samples;
+}
+
+}  // namespace torch_monitor
@@ -0,0 +1,16 @@
+#include "step_window.h"
+
+#include "op_filter.h"
+
+namespace torch_monitor {
+
+StepWindow &StepWindow::instance() {
+  static StepWindow window;
+  return window;
+}
+
+bool StepWindow::is_marker(const char *name) const {
+  return !_marker.empty() && OpFilter::match(_marker.c_str(), name);
+}
+
+}  // namespace torch_monitor
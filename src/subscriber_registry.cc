@@ -0,0 +1,64 @@
+#include "subscriber_registry.h"
+
+#include <algorithm>
+
+namespace torch_monitor {
+
+SubscriberRegistry &SubscriberRegistry::instance() {
+  static SubscriberRegistry registry;
+  return registry;
+}
+
+SubscriberRegistry::SubscriberRegistry() {
+  std::lock_guard<std::mutex> lock(_mutex);
+  publish({});
+}
+
+void SubscriberRegistry::publish(std::vector<Subscriber> &&subscribers) {
+  auto snapshot = std::make_unique<Snapshot>();
+  snapshot->subscribers = std::move(subscribers);
+  for (auto &subscriber : snapshot->subscribers) {
+    for (int domain = 0; domain < TORCH_MONITOR_DOMAIN_COUNT; ++domain) {
+      if (subscriber.domain_mask & TORCH_MONITOR_DOMAIN_MASK(domain)) {
+        snapshot->domain_subscribers[domain].push_back(subscriber.func);
+      }
+    }
+  }
+  _snapshot.store(snapshot.get(), std::memory_order_release);
+  _snapshots.push_back(std::move(snapshot));
+}
+
+bool SubscriberRegistry::subscribe(torch_monitor_callback_func_t func, uint64_t domain_mask) {
+  std::lock_guard<std::mutex> lock(_mutex);
+
+  auto subscribers = _snapshot.load(std::memory_order_relaxed)->subscribers;
+  auto iter = std::find_if(subscribers.begin(), subscribers.end(),
+                           [func](const Subscriber &subscriber) { return subscriber.func == func; });
+  if (iter != subscribers.end()) {
+    return false;
+  }
+  subscribers.push_back(Subscriber{func, domain_mask});
+  publish(std::move(subscribers));
+  return true;
+}
+
+bool SubscriberRegistry::unsubscribe(torch_monitor_callback_func_t func) {
+  std::lock_guard<std::mutex> lock(_mutex);
+
+  auto subscribers = _snapshot.load(std::memory_order_relaxed)->subscribers;
+  auto iter = std::find_if(subscribers.begin(), subscribers.end(),
+                           [func](const Subscriber &subscriber) { return subscriber.func == func; });
+  if (iter == subscribers.end()) {
+    return false;
+  }
+  subscribers.erase(iter);
+  publish(std::move(subscribers));
+  return true;
+}
+
+void SubscriberRegistry::clear() {
+  std::lock_guard<std::mutex> lock(_mutex);
+  publish({});
+}
+
+}  // namespace torch_monitor
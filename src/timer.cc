@@ -0,0 +1,54 @@
+#include "timer.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+#include "utils.h"
+
+namespace torch_monitor {
+
+Timer &Timer::instance() {
+  static Timer timer;
+  return timer;
+}
+
+bool Timer::has_invariant_tsc() {
+#if defined(__x86_64__) || defined(__i386__)
+  unsigned int eax, ebx, ecx, edx;
+  if (__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx)) {
+    return (edx & (1u << 8)) != 0;
+  }
+#endif
+  return false;
+}
+
+Timer::Timer() {
+#if defined(__x86_64__) || defined(__i386__)
+  if (!has_invariant_tsc()) {
+    LOG_INFO("invariant TSC not found, use clock_gettime");
+    return;
+  }
+
+  auto start_ns = monotonic_timestamp();
+  auto start_ticks = __rdtsc();
+  auto end_ns = start_ns;
+  while (end_ns - start_ns < TIMER_CALIBRATION_NS) {
+    end_ns = monotonic_timestamp();
+  }
+  auto end_ticks = __rdtsc();
+
+  if (end_ticks <= start_ticks) {
+    LOG_INFO("TSC is not monotonic, use clock_gettime");
+    return;
+  }
+
+  _ns_per_tick = static_cast<double>(end_ns - start_ns) / (end_ticks - start_ticks);
+  _base_ticks = end_ticks;
+  _base_ns = end_ns;
+  _use_tsc = true;
+  LOG_INFO("TSC calibrated, %f ns per tick", _ns_per_tick);
+#endif
+}
+
+}  // namespace torch_monitor
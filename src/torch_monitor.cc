@@ -1,6 +1,22 @@
 #include "torch_monitor.h"
 
+#include "allocation_table.h"
+#include "correlation_table.h"
+#include "cost_model.h"
+#include "event_batcher.h"
+#include "event_buffer.h"
+#include "flame_graph.h"
+#include "memory_analyzer.h"
+#include "memory_coalescer.h"
+#include "name_table.h"
+#include "op_filter.h"
+#include "op_memory.h"
+#include "op_stats.h"
 #include "python_state.h"
+#include "sampler.h"
+#include "signature_table.h"
+#include "stack_sampler.h"
+#include "timer.h"
 #include "torch_profiler.h"
 #include "utils.h"
 
@@ -8,6 +24,11 @@ namespace torch_monitor {
 
 EXTERNC torch_monitor_status_t
 torch_monitor_callback_subscribe(torch_monitor_callback_func_t func) {
+  return torch_monitor_callback_subscribe_domains(func, TORCH_MONITOR_DOMAIN_MASK_ALL);
+}
+
+EXTERNC torch_monitor_status_t torch_monitor_callback_subscribe_domains(
+    torch_monitor_callback_func_t func, uint64_t domain_mask) {
   LOG_INFO("Enter torch_monitor_callback_subscribe");
 
   torch_monitor_status_t status;
@@ -15,7 +36,7 @@ torch_monitor_callback_subscribe(torch_monitor_callback_func_t func) {
   auto &profiler = TorchProfiler::instance();
 
   if (func) {
-    if (profiler.register_callback(func)) {
+    if (profiler.register_callback(func, domain_mask)) {
       status = TORCH_MONITOR_STATUS_SUCCESS;
     } else {
       status = TORCH_MONITOR_STATUS_SUBSCRIBE_EXIST;
@@ -28,6 +49,69 @@ torch_monitor_callback_subscribe(torch_monitor_callback_func_t func) {
   return status;
 }
 
+EXTERNC torch_monitor_status_t
+torch_monitor_callback_unsubscribe(torch_monitor_callback_func_t func) {
+  LOG_INFO("Enter torch_monitor_callback_unsubscribe");
+
+  torch_monitor_status_t status;
+
+  auto &profiler = TorchProfiler::instance();
+
+  if (profiler.unregister_callback(func)) {
+    status = TORCH_MONITOR_STATUS_SUCCESS;
+  } else {
+    status = TORCH_MONITOR_STATUS_UNSUBSCRIBE_NOT_EXIST;
+  }
+
+  LOG_INFO("Exit torch_monitor_callback_unsubscribe");
+  return status;
+}
+
+EXTERNC torch_monitor_status_t torch_monitor_batch_subscribe(
+    torch_monitor_batch_callback_func_t func, uint64_t domain_mask, size_t batch_size) {
+  LOG_INFO("Enter torch_monitor_batch_subscribe");
+
+  torch_monitor_status_t status;
+
+  if (func == nullptr) {
+    status = TORCH_MONITOR_STATUS_SUBSCRIBE_SUBSCRIBER_NULL;
+  } else if (batch_size == 0) {
+    status = TORCH_MONITOR_STATUS_BATCH_SIZE_INVALID;
+  } else if (EventBatcher::instance().subscribe(func, domain_mask, batch_size)) {
+    status = TORCH_MONITOR_STATUS_SUCCESS;
+  } else {
+    status = TORCH_MONITOR_STATUS_BATCH_SUBSCRIBE_FAIL;
+  }
+
+  LOG_INFO("Exit torch_monitor_batch_subscribe");
+  return status;
+}
+
+EXTERNC torch_monitor_status_t
+torch_monitor_batch_unsubscribe(torch_monitor_batch_callback_func_t func) {
+  LOG_INFO("Enter torch_monitor_batch_unsubscribe");
+
+  torch_monitor_status_t status;
+
+  if (EventBatcher::instance().unsubscribe(func)) {
+    status = TORCH_MONITOR_STATUS_SUCCESS;
+  } else {
+    status = TORCH_MONITOR_STATUS_UNSUBSCRIBE_NOT_EXIST;
+  }
+
+  LOG_INFO("Exit torch_monitor_batch_unsubscribe");
+  return status;
+}
+
+EXTERNC torch_monitor_status_t torch_monitor_batch_flush() {
+  LOG_INFO("Enter torch_monitor_batch_flush");
+
+  EventBatcher::instance().flush();
+
+  LOG_INFO("Exit torch_monitor_batch_flush");
+  return TORCH_MONITOR_STATUS_SUCCESS;
+}
+
 EXTERNC torch_monitor_status_t torch_monitor_domain_enable(torch_monitor_domain_t domain) {
   LOG_INFO("Enter torch_monitor_domain_enable");
 
@@ -45,11 +129,472 @@ EXTERNC torch_monitor_status_t torch_monitor_domain_enable(torch_monitor_domain_
   return status;
 }
 
+EXTERNC torch_monitor_status_t torch_monitor_domain_disable(torch_monitor_domain_t domain) {
+  LOG_INFO("Enter torch_monitor_domain_disable");
+
+  torch_monitor_status_t status;
+
+  auto &profiler = TorchProfiler::instance();
+
+  if (domain < TORCH_MONITOR_DOMAIN_COUNT && profiler.unregister_domain(domain)) {
+    status = TORCH_MONITOR_STATUS_SUCCESS;
+  } else {
+    status = TORCH_MONITOR_STATUS_ENABLE_DOMAIN_OUT_RANGE;
+  }
+
+  LOG_INFO("Exit torch_monitor_domain_disable");
+  return status;
+}
+
+EXTERNC torch_monitor_status_t torch_monitor_domain_sample_rate(torch_monitor_domain_t domain,
+                                                                double rate) {
+  LOG_INFO("Enter torch_monitor_domain_sample_rate");
+
+  torch_monitor_status_t status;
+
+  if (domain >= TORCH_MONITOR_DOMAIN_COUNT) {
+    status = TORCH_MONITOR_STATUS_ENABLE_DOMAIN_OUT_RANGE;
+  } else if (DomainSampler::instance().set_rate(domain, rate)) {
+    status = TORCH_MONITOR_STATUS_SUCCESS;
+  } else {
+    status = TORCH_MONITOR_STATUS_SAMPLE_RATE_INVALID;
+  }
+
+  LOG_INFO("Exit torch_monitor_domain_sample_rate");
+  return status;
+}
+
+EXTERNC torch_monitor_status_t torch_monitor_adaptive_sampling_enable(uint64_t threshold) {
+  LOG_INFO("Enter torch_monitor_adaptive_sampling_enable");
+
+  torch_monitor_status_t status;
+
+  if (AdaptiveSampler::instance().enable(threshold)) {
+    status = TORCH_MONITOR_STATUS_SUCCESS;
+  } else {
+    status = TORCH_MONITOR_STATUS_ADAPTIVE_THRESHOLD_INVALID;
+  }
+
+  LOG_INFO("Exit torch_monitor_adaptive_sampling_enable");
+  return status;
+}
+
+EXTERNC torch_monitor_status_t torch_monitor_record_mode_set(torch_monitor_record_mode_t mode,
+                                                             size_t buffer_size) {
+  LOG_INFO("Enter torch_monitor_record_mode_set");
+
+  torch_monitor_status_t status;
+
+  auto &profiler = TorchProfiler::instance();
+
+  if (mode < TORCH_MONITOR_RECORD_MODE_COUNT && profiler.set_record_mode(mode, buffer_size)) {
+    status = TORCH_MONITOR_STATUS_SUCCESS;
+  } else {
+    status = TORCH_MONITOR_STATUS_RECORD_MODE_INVALID;
+  }
+
+  LOG_INFO("Exit torch_monitor_record_mode_set");
+  return status;
+}
+
+EXTERNC torch_monitor_status_t torch_monitor_dropped_events_get(size_t *num_dropped) {
+  LOG_INFO("Enter torch_monitor_dropped_events_get");
+
+  *num_dropped = EventBufferManager::instance().dropped();
+
+  LOG_INFO("Exit torch_monitor_dropped_events_get");
+  return TORCH_MONITOR_STATUS_SUCCESS;
+}
+
+EXTERNC torch_monitor_status_t torch_monitor_trace_enable(const char *path) {
+  LOG_INFO("Enter torch_monitor_trace_enable");
+
+  torch_monitor_status_t status;
+
+  auto &profiler = TorchProfiler::instance();
+
+  if (path != nullptr && profiler.enable_trace(path)) {
+    status = TORCH_MONITOR_STATUS_SUCCESS;
+  } else {
+    status = TORCH_MONITOR_STATUS_TRACE_OPEN_FAIL;
+  }
+
+  LOG_INFO("Exit torch_monitor_trace_enable");
+  return status;
+}
+
+EXTERNC torch_monitor_status_t torch_monitor_trace_dedup_enable() {
+  LOG_INFO("Enter torch_monitor_trace_dedup_enable");
+
+  torch_monitor_status_t status;
+
+  auto &profiler = TorchProfiler::instance();
+
+  if (profiler.enable_trace_dedup()) {
+    status = TORCH_MONITOR_STATUS_SUCCESS;
+  } else {
+    status = TORCH_MONITOR_STATUS_TRACE_DEDUP_INVALID;
+  }
+
+  LOG_INFO("Exit torch_monitor_trace_dedup_enable");
+  return status;
+}
+
+EXTERNC torch_monitor_status_t torch_monitor_op_name_lookup(uint32_t name_id, const char **name) {
+  LOG_INFO("Enter torch_monitor_op_name_lookup");
+
+  torch_monitor_status_t status;
+
+  *name = NameTable::instance().lookup(name_id);
+
+  if (*name != nullptr) {
+    status = TORCH_MONITOR_STATUS_SUCCESS;
+  } else {
+    status = TORCH_MONITOR_STATUS_NAME_ID_INVALID;
+  }
+
+  LOG_INFO("Exit torch_monitor_op_name_lookup");
+  return status;
+}
+
+EXTERNC torch_monitor_status_t torch_monitor_op_name_count(uint32_t *num_names) {
+  LOG_INFO("Enter torch_monitor_op_name_count");
+
+  *num_names = NameTable::instance().size();
+
+  LOG_INFO("Exit torch_monitor_op_name_count");
+  return TORCH_MONITOR_STATUS_SUCCESS;
+}
+
+EXTERNC torch_monitor_status_t torch_monitor_op_memory_enable() {
+  LOG_INFO("Enter torch_monitor_op_memory_enable");
+
+  OpMemoryEngine::instance().enable();
+
+  LOG_INFO("Exit torch_monitor_op_memory_enable");
+  return TORCH_MONITOR_STATUS_SUCCESS;
+}
+
+EXTERNC torch_monitor_status_t torch_monitor_stack_sampling_enable(uint64_t frequency,
+                                                                   size_t max_num_states) {
+  LOG_INFO("Enter torch_monitor_stack_sampling_enable");
+
+  torch_monitor_status_t status;
+
+  auto &profiler = TorchProfiler::instance();
+
+  if (frequency == 0 || frequency > StackSampler::STACK_SAMPLE_MAX_FREQUENCY) {
+    status = TORCH_MONITOR_STATUS_SAMPLE_FREQUENCY_INVALID;
+  } else if (profiler.enable_stack_sampling(frequency, max_num_states)) {
+    status = TORCH_MONITOR_STATUS_SUCCESS;
+  } else {
+    status = TORCH_MONITOR_STATUS_STACK_SAMPLING_INVALID;
+  }
+
+  LOG_INFO("Exit torch_monitor_stack_sampling_enable");
+  return status;
+}
+
+EXTERNC torch_monitor_status_t torch_monitor_flame_graph_enable(
+    const char *path, torch_monitor_flame_graph_metric_t metric, size_t max_num_states) {
+  LOG_INFO("Enter torch_monitor_flame_graph_enable");
+
+  torch_monitor_status_t status;
+
+  if (metric >= TORCH_MONITOR_FLAME_GRAPH_METRIC_COUNT) {
+    status = TORCH_MONITOR_STATUS_FLAME_GRAPH_METRIC_INVALID;
+  } else if (!TorchProfiler::instance().enable_flame_graph(path, metric, max_num_states)) {
+    status = TORCH_MONITOR_STATUS_FLAME_GRAPH_OPEN_FAIL;
+  } else {
+    status = TORCH_MONITOR_STATUS_SUCCESS;
+  }
+
+  LOG_INFO("Exit torch_monitor_flame_graph_enable");
+  return status;
+}
+
+EXTERNC torch_monitor_status_t torch_monitor_memory_analyzer_enable() {
+  LOG_INFO("Enter torch_monitor_memory_analyzer_enable");
+
+  MemoryAnalyzer::instance().enable();
+
+  LOG_INFO("Exit torch_monitor_memory_analyzer_enable");
+  return TORCH_MONITOR_STATUS_SUCCESS;
+}
+
+EXTERNC torch_monitor_status_t torch_monitor_memory_coalesce_enable() {
+  LOG_INFO("Enter torch_monitor_memory_coalesce_enable");
+
+  // Transient counters are reported with op memory counters
+  OpMemoryEngine::instance().enable();
+  MemoryCoalescer::instance().enable();
+
+  LOG_INFO("Exit torch_monitor_memory_coalesce_enable");
+  return TORCH_MONITOR_STATUS_SUCCESS;
+}
+
+EXTERNC torch_monitor_status_t torch_monitor_op_filter_add(const char *pattern,
+                                                           torch_monitor_op_filter_mode_t mode) {
+  LOG_INFO("Enter torch_monitor_op_filter_add");
+
+  torch_monitor_status_t status;
+
+  if (mode < TORCH_MONITOR_OP_FILTER_MODE_COUNT && OpFilter::instance().add(pattern, mode)) {
+    status = TORCH_MONITOR_STATUS_SUCCESS;
+  } else {
+    status = TORCH_MONITOR_STATUS_OP_FILTER_INVALID;
+  }
+
+  LOG_INFO("Exit torch_monitor_op_filter_add");
+  return status;
+}
+
+EXTERNC torch_monitor_status_t torch_monitor_op_stats_enable() {
+  LOG_INFO("Enter torch_monitor_op_stats_enable");
+
+  torch_monitor_status_t status;
+
+  auto &profiler = TorchProfiler::instance();
+
+  if (profiler.enable_op_stats()) {
+    status = TORCH_MONITOR_STATUS_SUCCESS;
+  } else {
+    status = TORCH_MONITOR_STATUS_OP_STATS_INVALID;
+  }
+
+  LOG_INFO("Exit torch_monitor_op_stats_enable");
+  return status;
+}
+
+EXTERNC torch_monitor_status_t torch_monitor_input_capture_enable() {
+  LOG_INFO("Enter torch_monitor_input_capture_enable");
+
+  torch_monitor_status_t status;
+
+  auto &profiler = TorchProfiler::instance();
+
+  if (profiler.enable_input_capture()) {
+    status = TORCH_MONITOR_STATUS_SUCCESS;
+  } else {
+    status = TORCH_MONITOR_STATUS_INPUT_CAPTURE_INVALID;
+  }
+
+  LOG_INFO("Exit torch_monitor_input_capture_enable");
+  return status;
+}
+
+EXTERNC torch_monitor_status_t torch_monitor_op_signature_lookup(uint32_t signature_id,
+                                                                 size_t max_num_inputs,
+                                                                 torch_monitor_input_t *inputs,
+                                                                 size_t *num_inputs) {
+  LOG_INFO("Enter torch_monitor_op_signature_lookup");
+
+  torch_monitor_status_t status;
+
+  if (SignatureTable::instance().lookup(signature_id, max_num_inputs, inputs, num_inputs)) {
+    status = TORCH_MONITOR_STATUS_SUCCESS;
+  } else {
+    status = TORCH_MONITOR_STATUS_SIGNATURE_ID_INVALID;
+  }
+
+  LOG_INFO("Exit torch_monitor_op_signature_lookup");
+  return status;
+}
+
+EXTERNC torch_monitor_status_t torch_monitor_cost_model_enable(size_t max_num_states) {
+  LOG_INFO("Enter torch_monitor_cost_model_enable");
+
+  torch_monitor_status_t status;
+
+  auto &profiler = TorchProfiler::instance();
+
+  // The cost model estimates ops from their inputs
+  if (profiler.enable_input_capture()) {
+    CostModel::instance().enable(max_num_states);
+    status = TORCH_MONITOR_STATUS_SUCCESS;
+  } else {
+    status = TORCH_MONITOR_STATUS_INPUT_CAPTURE_INVALID;
+  }
+
+  LOG_INFO("Exit torch_monitor_cost_model_enable");
+  return status;
+}
+
+EXTERNC torch_monitor_status_t torch_monitor_op_throughput_get(
+    size_t max_num_results, torch_monitor_op_throughput_t *results, size_t *num_results) {
+  LOG_INFO("Enter torch_monitor_op_throughput_get");
+
+  torch_monitor_status_t status;
+
+  auto &cost_model = CostModel::instance();
+
+  if (cost_model.is_merged()) {
+    *num_results = cost_model.get(max_num_results, results);
+    status = TORCH_MONITOR_STATUS_SUCCESS;
+  } else {
+    status = TORCH_MONITOR_STATUS_COST_MODEL_NOT_FINALIZE;
+  }
+
+  LOG_INFO("Exit torch_monitor_op_throughput_get");
+  return status;
+}
+
+EXTERNC torch_monitor_status_t torch_monitor_allocation_tracking_enable(size_t max_num_states) {
+  LOG_INFO("Enter torch_monitor_allocation_tracking_enable");
+
+  AllocationTable::instance().enable(max_num_states);
+
+  LOG_INFO("Exit torch_monitor_allocation_tracking_enable");
+  return TORCH_MONITOR_STATUS_SUCCESS;
+}
+
+EXTERNC torch_monitor_status_t torch_monitor_peak_allocations_get(
+    torch_monitor_device_type_t device_type, size_t max_num_allocations,
+    torch_monitor_allocation_t *allocations, size_t *num_allocations, int64_t *peak_size) {
+  LOG_INFO("Enter torch_monitor_peak_allocations_get");
+
+  torch_monitor_status_t status;
+
+  if (device_type < TORCH_MONITOR_DEVICE_TYPE_COUNT) {
+    auto &allocation_table = AllocationTable::instance();
+    // Peaks without following frees are only snapshotted on demand
+    allocation_table.flush();
+    *num_allocations =
+        allocation_table.peak(device_type, max_num_allocations, allocations, peak_size);
+    status = TORCH_MONITOR_STATUS_SUCCESS;
+  } else {
+    status = TORCH_MONITOR_STATUS_DEVICE_TYPE_INVALID;
+  }
+
+  LOG_INFO("Exit torch_monitor_peak_allocations_get");
+  return status;
+}
+
+EXTERNC torch_monitor_status_t torch_monitor_correlation_enable(size_t max_num_states) {
+  LOG_INFO("Enter torch_monitor_correlation_enable");
+
+  CorrelationTable::instance().enable(max_num_states);
+
+  LOG_INFO("Exit torch_monitor_correlation_enable");
+  return TORCH_MONITOR_STATUS_SUCCESS;
+}
+
+EXTERNC torch_monitor_status_t torch_monitor_op_stats_get(size_t max_num_stats,
+                                                          torch_monitor_op_stats_t *stats,
+                                                          size_t *num_stats) {
+  LOG_INFO("Enter torch_monitor_op_stats_get");
+
+  torch_monitor_status_t status;
+
+  auto &op_stats_engine = OpStatsEngine::instance();
+
+  if (op_stats_engine.is_merged()) {
+    status = TORCH_MONITOR_STATUS_SUCCESS;
+    *num_stats = op_stats_engine.get(max_num_stats, stats);
+  } else {
+    status = TORCH_MONITOR_STATUS_OP_STATS_NOT_FINALIZE;
+    *num_stats = 0;
+  }
+
+  LOG_INFO("Exit torch_monitor_op_stats_get");
+  return status;
+}
+
+EXTERNC torch_monitor_status_t torch_monitor_op_memory_get(size_t max_num_results,
+                                                           torch_monitor_op_memory_t *results,
+                                                           size_t *num_results) {
+  LOG_INFO("Enter torch_monitor_op_memory_get");
+
+  torch_monitor_status_t status;
+
+  auto &op_memory_engine = OpMemoryEngine::instance();
+
+  if (op_memory_engine.is_merged()) {
+    status = TORCH_MONITOR_STATUS_SUCCESS;
+    *num_results = op_memory_engine.get(max_num_results, results);
+  } else {
+    status = TORCH_MONITOR_STATUS_OP_MEMORY_NOT_FINALIZE;
+    *num_results = 0;
+  }
+
+  LOG_INFO("Exit torch_monitor_op_memory_get");
+  return status;
+}
+
+EXTERNC torch_monitor_status_t torch_monitor_memory_summary_get(
+    torch_monitor_device_type_t device_type, torch_monitor_memory_summary_t *summary) {
+  LOG_INFO("Enter torch_monitor_memory_summary_get");
+
+  torch_monitor_status_t status;
+
+  if (device_type < TORCH_MONITOR_DEVICE_TYPE_COUNT) {
+    MemoryAnalyzer::instance().summary(device_type, summary);
+    status = TORCH_MONITOR_STATUS_SUCCESS;
+  } else {
+    status = TORCH_MONITOR_STATUS_DEVICE_TYPE_INVALID;
+  }
+
+  LOG_INFO("Exit torch_monitor_memory_summary_get");
+  return status;
+}
+
+EXTERNC torch_monitor_status_t torch_monitor_memory_timeline_get(
+    torch_monitor_device_type_t device_type, size_t max_num_samples,
+    torch_monitor_memory_sample_t *samples, size_t *num_samples) {
+  LOG_INFO("Enter torch_monitor_memory_timeline_get");
+
+  torch_monitor_status_t status;
+
+  if (device_type < TORCH_MONITOR_DEVICE_TYPE_COUNT) {
+    *num_samples = MemoryAnalyzer::instance().timeline(device_type, max_num_samples, samples);
+    status = TORCH_MONITOR_STATUS_SUCCESS;
+  } else {
+    *num_samples = 0;
+    status = TORCH_MONITOR_STATUS_DEVICE_TYPE_INVALID;
+  }
+
+  LOG_INFO("Exit torch_monitor_memory_timeline_get");
+  return status;
+}
+
+EXTERNC torch_monitor_status_t torch_monitor_stack_samples_get(size_t max_num_samples,
+                                                               torch_monitor_stack_sample_t *samples,
+                                                               size_t *num_samples) {
+  LOG_INFO("Enter torch_monitor_stack_samples_get");
+
+  torch_monitor_status_t status;
+
+  auto &stack_sampler = StackSampler::instance();
+
+  if (stack_sampler.is_merged()) {
+    status = TORCH_MONITOR_STATUS_SUCCESS;
+    *num_samples = stack_sampler.get(max_num_samples, samples);
+  } else {
+    status = TORCH_MONITOR_STATUS_STACK_SAMPLING_NOT_FINALIZE;
+    *num_samples = 0;
+  }
+
+  LOG_INFO("Exit torch_monitor_stack_samples_get");
+  return status;
+}
+
+EXTERNC torch_monitor_status_t torch_monitor_timestamp_to_ns(uint64_t timestamp, uint64_t *ns) {
+  LOG_INFO("Enter torch_monitor_timestamp_to_ns");
+
+  *ns = Timer::instance().to_ns(timestamp);
+
+  LOG_INFO("Exit torch_monitor_timestamp_to_ns");
+  return TORCH_MONITOR_STATUS_SUCCESS;
+}
+
 EXTERNC torch_monitor_status_t torch_monitor_init() {
   LOG_INFO("Enter torch_monitor_init");
 
   torch_monitor_status_t status;
 
+  // Calibrate the TSC before the first callback
+  Timer::instance();
+
   auto &profiler = TorchProfiler::instance();
 
   if (profiler.start_profiling()) {
@@ -64,6 +609,76 @@ EXTERNC torch_monitor_status_t torch_monitor_init() {
   return status;
 }
 
+EXTERNC torch_monitor_status_t torch_monitor_pause() {
+  LOG_INFO("Enter torch_monitor_pause");
+
+  torch_monitor_status_t status;
+
+  auto &profiler = TorchProfiler::instance();
+
+  if (profiler.pause_profiling()) {
+    status = TORCH_MONITOR_STATUS_SUCCESS;
+  } else {
+    status = TORCH_MONITOR_STATUS_PAUSE_NOT_INIT;
+  }
+
+  LOG_INFO("Exit torch_monitor_pause");
+  return status;
+}
+
+EXTERNC torch_monitor_status_t torch_monitor_resume() {
+  LOG_INFO("Enter torch_monitor_resume");
+
+  torch_monitor_status_t status;
+
+  auto &profiler = TorchProfiler::instance();
+
+  if (profiler.resume_profiling()) {
+    status = TORCH_MONITOR_STATUS_SUCCESS;
+  } else {
+    status = TORCH_MONITOR_STATUS_RESUME_NOT_INIT;
+  }
+
+  LOG_INFO("Exit torch_monitor_resume");
+  return status;
+}
+
+EXTERNC torch_monitor_status_t torch_monitor_step_window_set(uint64_t skip_steps,
+                                                             uint64_t record_steps,
+                                                             const char *marker) {
+  LOG_INFO("Enter torch_monitor_step_window_set");
+
+  torch_monitor_status_t status;
+
+  auto &profiler = TorchProfiler::instance();
+
+  if (profiler.set_step_window(skip_steps, record_steps, marker)) {
+    status = TORCH_MONITOR_STATUS_SUCCESS;
+  } else {
+    status = TORCH_MONITOR_STATUS_STEP_WINDOW_INVALID;
+  }
+
+  LOG_INFO("Exit torch_monitor_step_window_set");
+  return status;
+}
+
+EXTERNC torch_monitor_status_t torch_monitor_step() {
+  LOG_INFO("Enter torch_monitor_step");
+
+  torch_monitor_status_t status;
+
+  auto &profiler = TorchProfiler::instance();
+
+  if (profiler.step()) {
+    status = TORCH_MONITOR_STATUS_SUCCESS;
+  } else {
+    status = TORCH_MONITOR_STATUS_STEP_NOT_INIT;
+  }
+
+  LOG_INFO("Exit torch_monitor_step");
+  return status;
+}
+
 EXTERNC torch_monitor_status_t torch_monitor_thread_init() {
   LOG_INFO("Enter torch_monitor_thread_init");
 
@@ -105,6 +720,8 @@ EXTERNC torch_monitor_status_t torch_monitor_thread_finalize() {
 
   auto &profiler = TorchProfiler::instance();
 
+  EventBatcher::instance().flush();
+
   if (profiler.stop_memory_profiling()) {
     status = TORCH_MONITOR_STATUS_SUCCESS;
   } else {
@@ -125,19 +742,25 @@ EXTERNC torch_monitor_status_t torch_monitor_python_state_get(size_t max_num_sta
 
   auto &python_state_monitor = PythonStateMonitor::instance();
 
-  auto &python_states = python_state_monitor.get_states();
-
-  if (python_states.empty()) {
+  if (max_num_states == 0) {
+    // No frame is requested, skip the GIL
     status = TORCH_MONITOR_STATUS_PYTHON_STATES_NULL;
   } else {
-    status = TORCH_MONITOR_STATUS_SUCCESS;
+    // Stop walking frames at the requested depth
+    auto &python_states = python_state_monitor.get_states(false, max_num_states);
+
+    if (python_states.empty()) {
+      status = TORCH_MONITOR_STATUS_PYTHON_STATES_NULL;
+    } else {
+      status = TORCH_MONITOR_STATUS_SUCCESS;
 
-    *num_states = std::min(python_states.size(), max_num_states);
-    for (size_t i = 0; i < *num_states; ++i) {
-      states[i].file_name = python_states[i].file_name.c_str();
-      states[i].function_name = python_states[i].function_name.c_str();
-      states[i].function_first_lineno = python_states[i].function_first_lineno;
-      states[i].lineno = python_states[i].lineno;
+      *num_states = std::min(python_states.size(), max_num_states);
+      for (size_t i = 0; i < *num_states; ++i) {
+        states[i].file_name = python_states[i].file_name;
+        states[i].function_name = python_states[i].function_name;
+        states[i].function_first_lineno = python_states[i].function_first_lineno;
+        states[i].lineno = python_states[i].lineno;
+      }
     }
   }
 
@@ -146,4 +769,46 @@ EXTERNC torch_monitor_status_t torch_monitor_python_state_get(size_t max_num_sta
   return status;
 }
 
-}  // namespace torch_monitor
\ No newline at end of file
+EXTERNC torch_monitor_status_t torch_monitor_python_callpath_get(size_t max_num_states,
+                                                                 uint64_t *callpath_id) {
+  LOG_INFO("Enter torch_monitor_python_callpath_get");
+
+  torch_monitor_status_t status;
+
+  // No frame is requested without the GIL
+  *callpath_id = max_num_states == 0
+                     ? PythonStateMonitor::CALLPATH_ID_NULL
+                     : PythonStateMonitor::instance().get_callpath_id(max_num_states);
+
+  if (*callpath_id == PythonStateMonitor::CALLPATH_ID_NULL) {
+    status = TORCH_MONITOR_STATUS_PYTHON_STATES_NULL;
+  } else {
+    status = TORCH_MONITOR_STATUS_SUCCESS;
+  }
+
+  LOG_INFO("Exit torch_monitor_python_callpath_get");
+  return status;
+}
+
+EXTERNC torch_monitor_status_t torch_monitor_python_callpath_expand(
+    uint64_t callpath_id, size_t max_num_states, torch_monitor_python_state_t *states,
+    size_t *num_states) {
+  LOG_INFO("Enter torch_monitor_python_callpath_expand");
+
+  torch_monitor_status_t status;
+
+  auto &python_state_monitor = PythonStateMonitor::instance();
+
+  if (python_state_monitor.has_callpath(callpath_id)) {
+    status = TORCH_MONITOR_STATUS_SUCCESS;
+    *num_states = python_state_monitor.expand_callpath(callpath_id, max_num_states, states);
+  } else {
+    status = TORCH_MONITOR_STATUS_CALLPATH_ID_INVALID;
+    *num_states = 0;
+  }
+
+  LOG_INFO("Exit torch_monitor_python_callpath_expand");
+  return status;
+}
+
+}  // namespace torch_monitor
@@ -1,5 +1,30 @@
 #include "torch_profiler.h"
 
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+#include "allocation_table.h"
+#include "correlation_table.h"
+#include "cost_model.h"
+#include "event_batcher.h"
+#include "event_buffer.h"
+#include "flame_graph.h"
+#include "memory_analyzer.h"
+#include "memory_coalescer.h"
+#include "name_table.h"
+#include "op_filter.h"
+#include "op_memory.h"
+#include "op_stack.h"
+#include "op_stats.h"
+#include "python_state.h"
+#include "sampler.h"
+#include "signature_table.h"
+#include "stack_sampler.h"
+#include "step_window.h"
+#include "subscriber_registry.h"
+#include "timer.h"
+#include "trace_writer.h"
 #include "utils.h"
 
 namespace torch_monitor {
@@ -12,14 +37,57 @@ struct TorchProfilerState {
 
   at::CallbackHandle handle = TorchProfiler::TORCH_PROFILER_HANDLE_NULL;
 
-  torch_monitor_callback_func_t callback = nullptr;
+  // Callback of step markers, attached until the step window closes
+  at::CallbackHandle marker_handle = TorchProfiler::TORCH_PROFILER_HANDLE_NULL;
+
+  torch_monitor_record_mode_t record_mode = TORCH_MONITOR_RECORD_MODE_SYNC;
+
+  // If callbacks are written to the binary trace
+  bool trace_enabled = false;
+
+  // torch_monitor_init has been called
+  bool started = false;
+
+  // The callback is detached by torch_monitor_pause
+  bool paused = false;
+
+  // The gate checked first in every callback
+  std::atomic<bool> active{false};
+
+  // Op and memory callbacks that passed the gate and have not returned
+  std::atomic<uint64_t> in_flight{0};
+
+  // Delivered domains, updated when domains are toggled at runtime
+  std::atomic<uint64_t> domain_mask{0};
+
+  // Bumped when the callback is re-attached so that threads discard op stacks
+  // whose exit callbacks may have been missed while detached
+  std::atomic<uint32_t> epoch{0};
+
+  // Serializes init, finalize, pause, resume, and domain toggles
+  std::mutex mutex;
 
   void clear() {
-    callback = nullptr;
+    SubscriberRegistry::instance().clear();
+    EventBatcher::instance().clear();
+    trace_enabled = false;
+    started = false;
+    paused = false;
+    active.store(false, std::memory_order_relaxed);
+    domain_mask.store(0, std::memory_order_relaxed);
+    record_mode = TORCH_MONITOR_RECORD_MODE_SYNC;
     handle = TorchProfiler::TORCH_PROFILER_HANDLE_NULL;
+    marker_handle = TorchProfiler::TORCH_PROFILER_HANDLE_NULL;
     this->scopes.clear();
   }
 
+  // Wait for callbacks that passed the gate before it was closed with a seq_cst store
+  void quiesce() {
+    while (in_flight.load(std::memory_order_seq_cst) != 0) {
+      std::this_thread::yield();
+    }
+  }
+
   static TorchProfilerState& instance() {
     static TorchProfilerState state;
     return state;
@@ -29,6 +97,24 @@ struct TorchProfilerState {
   TorchProfilerState() {}
 };
 
+// Counts a callback as in flight for its whole duration, so that finalize can wait for it
+// before merging and clearing tables the callback may write
+class CallbackGuard {
+ public:
+  explicit CallbackGuard(TorchProfilerState& instance) : _instance(instance) {
+    instance.in_flight.fetch_add(1, std::memory_order_seq_cst);
+    _active = instance.active.load(std::memory_order_seq_cst);
+  }
+
+  ~CallbackGuard() { _instance.in_flight.fetch_sub(1, std::memory_order_release); }
+
+  bool active() const { return _active; }
+
+ private:
+  TorchProfilerState& _instance;
+  bool _active;
+};
+
 void TorchProfiler::MemoryState::reportMemoryUsage(void* ptr, int64_t alloc_size,
                                                    size_t total_allocated, size_t total_reserved,
                                                    c10::Device device) {
@@ -37,27 +123,246 @@ void TorchProfiler::MemoryState::reportMemoryUsage(void* ptr, int64_t alloc_size
   LOG_INFO("total_allocated: %llu", total_allocated);
   LOG_INFO("total_reserved: %llu", total_reserved);
 
+  auto& instance = TorchProfilerState::instance();
+  CallbackGuard guard(instance);
+  if (!guard.active() ||
+      !(instance.domain_mask.load(std::memory_order_relaxed) &
+        TORCH_MONITOR_DOMAIN_MASK(TORCH_MONITOR_DOMAIN_MEMORY))) {
+    return;
+  }
+
+  auto timestamp = Timer::instance().now();
+  auto device_type = aten_device_type_match(device.type());
+  auto& op_stack = OpStack::current();
+  op_stack.sync(instance.epoch.load(std::memory_order_relaxed));
+
+  // Every event is attributed and tracked regardless of sampling
+  auto& op_memory_engine = OpMemoryEngine::instance();
+  if (op_memory_engine.is_enabled()) {
+    op_memory_engine.record(op_stack, alloc_size);
+  }
+
+  auto& memory_analyzer = MemoryAnalyzer::instance();
+  if (memory_analyzer.is_enabled()) {
+    memory_analyzer.record(device_type, ptr, alloc_size, static_cast<int64_t>(total_allocated),
+                           static_cast<int64_t>(total_reserved), timestamp);
+  }
+
+  auto& allocation_table = AllocationTable::instance();
+  if (allocation_table.is_enabled()) {
+    Allocation allocation;
+    allocation.ptr = ptr;
+    allocation.size = alloc_size;
+    allocation.device_type = device_type;
+    allocation.timestamp = timestamp;
+    allocation.name_id = NameTable::NAME_ID_NULL;
+    allocation.callpath_id = PythonStateMonitor::CALLPATH_ID_NULL;
+    if (alloc_size >= 0) {
+      if (auto* frame = op_stack.top()) {
+        allocation.name_id = frame->name_id;
+      }
+      // The allocator lock is held, acquiring the GIL here can deadlock with a python thread
+      // waiting for the allocator, so only threads already holding the GIL capture call paths
+      auto max_num_states = allocation_table.max_num_states();
+      if (max_num_states != 0 && PyGILState_Check()) {
+        allocation.callpath_id = PythonStateMonitor::instance().get_callpath_id(max_num_states);
+      }
+    }
+    allocation_table.record(allocation);
+  }
+
   torch_monitor_callback_data_t callback_data;
   callback_data.domain = TORCH_MONITOR_DOMAIN_MEMORY;
   callback_data.current_thread_id = at::RecordFunction::currentThreadId();
+  callback_data.timestamp = timestamp;
   callback_data.data.mem_data.type =
       alloc_size < 0 ? TORCH_MONITOR_MEM_DATA_FREE : TORCH_MONITOR_MEM_DATA_ALLOC;
-  callback_data.data.mem_data.device_type = aten_device_type_match(device.type());
+  callback_data.data.mem_data.device_type = device_type;
   callback_data.data.mem_data.ptr = ptr;
   callback_data.data.mem_data.size = alloc_size < 0 ? -alloc_size : alloc_size;
   callback_data.data.mem_data.total_allocated = total_allocated;
   callback_data.data.mem_data.total_reserved = total_reserved;
 
+  // Pairs are folded before sampling so that transient counters are exact
+  auto& memory_coalescer = MemoryCoalescer::instance();
+  if (memory_coalescer.is_enabled()) {
+    auto epoch = instance.epoch.load(std::memory_order_relaxed);
+    memory_coalescer.sync(epoch, [](PendingAllocation& allocation) {
+      dispatch_memory_callback(&allocation.callback_data);
+    });
+    if (alloc_size >= 0) {
+      if (memory_coalescer.defer(callback_data, op_stack, epoch)) {
+        return;
+      }
+    } else {
+      PendingAllocation allocation;
+      if (memory_coalescer.fold(ptr, allocation)) {
+        op_memory_engine.record_transient(allocation.name_id, allocation.master_name_id,
+                                          allocation.callback_data.data.mem_data.size);
+        return;
+      }
+    }
+  }
+
+  dispatch_memory_callback(&callback_data);
+}
+
+void TorchProfiler::dispatch_memory_callback(torch_monitor_callback_data_t* callback_data) {
+  double weight;
+  if (!DomainSampler::instance().sample(TORCH_MONITOR_DOMAIN_MEMORY, weight)) {
+    return;
+  }
+  callback_data->weight = weight;
+
+  dispatch_callback(TORCH_MONITOR_CALLBACK_ENTER, callback_data);
+}
+
+void TorchProfiler::escape_memory_callbacks(uint32_t nested_level) {
+  auto& memory_coalescer = MemoryCoalescer::instance();
+  if (!memory_coalescer.is_enabled()) {
+    return;
+  }
+  auto deliver = [](PendingAllocation& allocation) {
+    dispatch_memory_callback(&allocation.callback_data);
+  };
+  auto epoch = TorchProfilerState::instance().epoch.load(std::memory_order_relaxed);
+  memory_coalescer.sync(epoch, deliver);
+  memory_coalescer.escape(nested_level, deliver);
+}
+
+void TorchProfiler::deliver_callback(torch_monitor_callback_site_t callback_site,
+                                     torch_monitor_callback_data_t* callback_data,
+                                     uint64_t step) {
   auto& instance = TorchProfilerState::instance();
-  instance.callback(TORCH_MONITOR_CALLBACK_ENTER, &callback_data);
+  if (instance.trace_enabled) {
+    TraceWriter::instance().write(callback_site, callback_data, step);
+  }
+  SubscriberRegistry::instance().dispatch(callback_site, callback_data);
+  auto& event_batcher = EventBatcher::instance();
+  if (event_batcher.has_subscriber(callback_data->domain)) {
+    event_batcher.append(callback_site, callback_data);
+  }
+}
+
+void TorchProfiler::dispatch_callback(torch_monitor_callback_site_t callback_site,
+                                      torch_monitor_callback_data_t* callback_data) {
+  auto& instance = TorchProfilerState::instance();
+  if (!instance.trace_enabled &&
+      !SubscriberRegistry::instance().has_subscriber(callback_data->domain) &&
+      !EventBatcher::instance().has_subscriber(callback_data->domain)) {
+    return;
+  }
+
+  // Iterations of the deduplicated trace end at the step the event is recorded in
+  auto step = instance.trace_enabled ? TraceWriter::instance().current_step() : 0;
+  if (instance.record_mode == TORCH_MONITOR_RECORD_MODE_ASYNC) {
+    // Never block the op, the record is counted as dropped if the buffer is full
+    EventBufferManager::instance().record(callback_site, *callback_data, step);
+  } else {
+    deliver_callback(callback_site, callback_data, step);
+  }
+}
+
+uint32_t TorchProfiler::intern_name(const at::RecordFunction& fn) {
+#if TORCH_VERSION_MAJOR <= 1 && TORCH_VERSION_MINOR < 11
+  return NameTable::instance().intern(fn.name().str());
+#else
+  return NameTable::instance().intern(fn.name());
+#endif
 }
 
 bool TorchProfiler::init_callback_data(torch_monitor_callback_site_t callback_site,
-                                       const at::RecordFunction& fn,
+                                       const at::RecordFunction& fn, uint32_t name_id,
+                                       uint64_t timestamp,
                                        torch_monitor_callback_data_t& callback_data) {
-  static thread_local uint32_t nested_level = 0;
-  if (callback_site == TORCH_MONITOR_CALLBACK_EXIT) {
-    --nested_level;
+  auto domain = aten_scope_match(fn.scope());
+  if (domain == TORCH_MONITOR_DOMAIN_COUNT) {
+    return false;
+  }
+
+  auto& instance = TorchProfilerState::instance();
+
+  // The sampling decision of an op is made at enter and reused at exit
+  auto& op_stack = OpStack::current();
+  op_stack.sync(instance.epoch.load(std::memory_order_relaxed));
+  uint32_t nested_level;
+  OpFrame* frame;
+  auto& op_stats_engine = OpStatsEngine::instance();
+  auto& flame_graph = FlameGraph::instance();
+  auto& cost_model = CostModel::instance();
+  // Op stats and the flame graph share inclusive and self times
+  bool timed = op_stats_engine.is_enabled() || flame_graph.is_enabled();
+  if (callback_site == TORCH_MONITOR_CALLBACK_ENTER) {
+    nested_level = op_stack.depth();
+    frame = op_stack.push();
+    if (frame != nullptr) {
+      frame->name_id = name_id;
+      // Ops of domains disabled at runtime can still arrive from in-flight RecordFunctions
+      frame->sampled = (instance.domain_mask.load(std::memory_order_relaxed) &
+                        TORCH_MONITOR_DOMAIN_MASK(domain)) &&
+                       DomainSampler::instance().sample(domain, frame->weight);
+      // Hot <op, level> pairs are thinned further, a sample stands for both periods
+      auto& adaptive_sampler = AdaptiveSampler::instance();
+      double adaptive_weight;
+      if (frame->sampled && adaptive_sampler.is_enabled()) {
+        frame->sampled = adaptive_sampler.sample(name_id, nested_level, adaptive_weight);
+        frame->weight *= adaptive_weight;
+      }
+      // Inputs of an op are only available at enter
+      auto& signature_table = SignatureTable::instance();
+      frame->signature_id =
+          (frame->sampled || cost_model.is_enabled()) && signature_table.is_enabled()
+              ? signature_table.intern(fn)
+              : SignatureTable::SIGNATURE_ID_NULL;
+      if (timed) {
+        frame->timestamp = timestamp;
+        frame->children_time = 0;
+      }
+      if (flame_graph.is_enabled()) {
+        flame_graph.enter(*frame, op_stack.parent());
+      } else {
+        frame->flame_node = FlameGraph::FLAME_NODE_NULL;
+      }
+      if (cost_model.is_enabled()) {
+        frame->timestamp = timestamp;
+        frame->callpath_id = PythonStateMonitor::CALLPATH_ID_NULL;
+        // Python frames do not change inside an op, so only modeled ops of nested level 0
+        // walk them and nested modeled ops share their call paths
+        auto max_num_states = cost_model.max_num_states();
+        OpCost cost;
+        if (max_num_states != 0 && cost_model.estimate(name_id, frame->signature_id, cost)) {
+          frame->callpath_id =
+              nested_level == 0 ? PythonStateMonitor::instance().get_callpath_id(max_num_states)
+                                : op_stack.bottom()->callpath_id;
+        }
+      }
+      // Correlation does not depend on sampling, sampled backward ops may follow unsampled forward ops
+      if (CorrelationTable::instance().is_enabled()) {
+        correlate(domain, fn, timestamp, *frame, op_stack.parent());
+      }
+    }
+  } else {
+    frame = op_stack.pop();
+    nested_level = op_stack.depth();
+    // Allocations not freed by the op are delivered before its exit
+    escape_memory_callbacks(nested_level);
+    // Latencies are aggregated for every op regardless of sampling
+    if (frame != nullptr && timed) {
+      auto inclusive = timestamp - frame->timestamp;
+      auto self = inclusive > frame->children_time ? inclusive - frame->children_time : 0;
+      if (auto* parent = op_stack.top()) {
+        parent->children_time += inclusive;
+      }
+      if (op_stats_engine.is_enabled()) {
+        op_stats_engine.record(frame->name_id, inclusive, self);
+      }
+      if (flame_graph.is_enabled()) {
+        flame_graph.record(*frame, self);
+      }
+    }
+    if (frame != nullptr && cost_model.is_enabled()) {
+      cost_model.record(*frame, timestamp - frame->timestamp);
+    }
   }
 
   LOG_INFO("thread_id: %llu", fn.threadId());
@@ -68,24 +373,21 @@ bool TorchProfiler::init_callback_data(torch_monitor_callback_site_t callback_si
   LOG_INFO("sequence_number: %lld", fn.seqNr());
   LOG_INFO("logical_thread_id: %llu", at::RecordFunction::currentThreadId());
   LOG_INFO("level: %u", nested_level);
-#if TORCH_VERSION_MAJOR <= 1 && TORCH_VERSION_MINOR < 11
-  callback_data.data.op_data.name = fn.name().str();
-#else
-  callback_data.data.op_data.name = fn.name();
-#endif
 
   // seqNr == TORCH_PROFILER_SEQUENCE_NUMBER_NULL means this op is not associated with a backprop op
   // if (fn.seqNr() == TORCH_PROFILER_SEQUENCE_NUMBER_NULL) {
   //   return false;
   // }
 
-  auto domain = aten_scope_match(fn.scope());
-  if (domain == TORCH_MONITOR_DOMAIN_COUNT) {
+  // Ops deeper than OP_STACK_MAX_DEPTH are not delivered
+  if (frame == nullptr || !frame->sampled) {
     return false;
   }
 
   callback_data.domain = domain;
   callback_data.current_thread_id = at::RecordFunction::currentThreadId();
+  callback_data.weight = frame->weight;
+  callback_data.timestamp = timestamp;
   callback_data.data.op_data.forward_thread_id = fn.forwardThreadId();
   callback_data.data.op_data.sequence_number = fn.seqNr();
   callback_data.data.op_data.nested_level = nested_level;
@@ -94,12 +396,47 @@ bool TorchProfiler::init_callback_data(torch_monitor_callback_site_t callback_si
 #else
   callback_data.data.op_data.name = fn.name();
 #endif
+  callback_data.data.op_data.name_id = frame->name_id;
+  callback_data.data.op_data.signature_id = frame->signature_id;
+  callback_data.data.op_data.forward_op = frame->forward_op;
 
-  if (callback_site == TORCH_MONITOR_CALLBACK_ENTER) {
-    ++nested_level;
+  return true;
+}
+
+void TorchProfiler::correlate(torch_monitor_domain_t domain, const at::RecordFunction& fn,
+                              uint64_t timestamp, OpFrame& frame, const OpFrame* parent) {
+  // Torch only sets the forward thread id of backward ops, forward ops are keyed by the
+  // thread recording them, which autograd later reports as the forward thread id
+  frame.forward_thread_id = domain == TORCH_MONITOR_DOMAIN_BACKWARD_FUNCTION
+                                ? fn.forwardThreadId()
+                                : at::RecordFunction::currentThreadId();
+  frame.sequence_number = fn.seqNr();
+  frame.forward_op = {};
+
+  if (frame.sequence_number < 0) {
+    return;
   }
 
-  return true;
+  // Nested ops with the same key belong to the master frame
+  if (parent != nullptr && parent->forward_thread_id == frame.forward_thread_id &&
+      parent->sequence_number == frame.sequence_number) {
+    frame.forward_op = parent->forward_op;
+    return;
+  }
+
+  auto& correlation_table = CorrelationTable::instance();
+  if (domain == TORCH_MONITOR_DOMAIN_FUNCTION) {
+    frame.forward_op.name_id = frame.name_id;
+    frame.forward_op.timestamp = timestamp;
+    auto max_num_states = correlation_table.max_num_states();
+    if (max_num_states != 0) {
+      frame.forward_op.callpath_id =
+          PythonStateMonitor::instance().get_callpath_id(max_num_states);
+    }
+    correlation_table.insert(frame.forward_thread_id, frame.sequence_number, frame.forward_op);
+  } else if (domain == TORCH_MONITOR_DOMAIN_BACKWARD_FUNCTION) {
+    correlation_table.consume(frame.forward_thread_id, frame.sequence_number, frame.forward_op);
+  }
 }
 
 TorchProfiler& TorchProfiler::instance() {
@@ -125,60 +462,244 @@ bool TorchProfiler::has_domain(torch_monitor_domain_t domain) {
 // True: register success
 // False: register fail
 bool TorchProfiler::register_domain(torch_monitor_domain_t domain) {
+  auto& instance = TorchProfilerState::instance();
+  std::lock_guard<std::mutex> lock(instance.mutex);
+
   if (domain == TORCH_MONITOR_DOMAIN_MEMORY) {
+    // Memory states of threads are installed by torch_monitor_thread_init
     enable_memory_profiling();
-    return true;
   } else {
     at::RecordScope scope = torch_monitor_domain_match(domain);
     if (scope == at::RecordScope::NUM_SCOPES) {
       return false;
     }
-    TorchProfilerState::instance().scopes.insert(scope);
-    return true;
+    if (instance.scopes.insert(scope).second && instance.started && !instance.paused) {
+      // Re-attach the callback with the new scopes
+      detach_callback();
+      attach_callback();
+    }
   }
+  instance.domain_mask.fetch_or(TORCH_MONITOR_DOMAIN_MASK(domain));
+  return true;
+}
+
+// True: unregister success
+// False: unregister fail
+bool TorchProfiler::unregister_domain(torch_monitor_domain_t domain) {
+  auto& instance = TorchProfilerState::instance();
+  std::lock_guard<std::mutex> lock(instance.mutex);
+
+  if (domain != TORCH_MONITOR_DOMAIN_MEMORY) {
+    at::RecordScope scope = torch_monitor_domain_match(domain);
+    if (scope == at::RecordScope::NUM_SCOPES) {
+      return false;
+    }
+    if (instance.scopes.erase(scope) != 0 && instance.started && !instance.paused) {
+      detach_callback();
+      attach_callback();
+    }
+  }
+  instance.domain_mask.fetch_and(~TORCH_MONITOR_DOMAIN_MASK(domain));
+  return true;
 }
 
 // True: register success
-// False: register fail
-bool TorchProfiler::register_callback(torch_monitor_callback_func_t callback) {
+// False: callback has been registered
+bool TorchProfiler::register_callback(torch_monitor_callback_func_t callback,
+                                      uint64_t domain_mask) {
+  return SubscriberRegistry::instance().subscribe(callback, domain_mask);
+}
+
+// True: unregister success
+// False: callback has not been registered
+bool TorchProfiler::unregister_callback(torch_monitor_callback_func_t callback) {
+  return SubscriberRegistry::instance().unsubscribe(callback);
+}
+
+// True: set success
+// False: set fail
+bool TorchProfiler::set_record_mode(torch_monitor_record_mode_t record_mode, size_t buffer_size) {
   auto& instance = TorchProfilerState::instance();
-  if (instance.callback == nullptr) {
-    instance.callback = callback;
-    return true;
+  if (instance.started) {
+    return false;
   }
-  return false;
+  if (record_mode == TORCH_MONITOR_RECORD_MODE_ASYNC && buffer_size != 0 &&
+      !EventBufferManager::instance().set_capacity(buffer_size)) {
+    return false;
+  }
+  instance.record_mode = record_mode;
+  return true;
 }
 
-bool TorchProfiler::start_profiling() {
+// True: trace file opened
+// False: profiling has started or the trace file cannot be opened
+bool TorchProfiler::enable_trace(const std::string& path) {
+  auto& instance = TorchProfilerState::instance();
+  if (instance.started || instance.trace_enabled) {
+    return false;
+  }
+  if (!TraceWriter::instance().open(path)) {
+    return false;
+  }
+  instance.trace_enabled = true;
+  return true;
+}
+
+// True: trace deduplication enabled
+// False: profiling has started or the trace is not enabled
+bool TorchProfiler::enable_trace_dedup() {
+  auto& instance = TorchProfilerState::instance();
+  if (instance.started || !instance.trace_enabled) {
+    return false;
+  }
+  TraceWriter::instance().enable_dedup();
+  return true;
+}
+
+// True: op stats enabled
+// False: profiling has started
+bool TorchProfiler::enable_op_stats() {
+  auto& instance = TorchProfilerState::instance();
+  std::lock_guard<std::mutex> lock(instance.mutex);
+
+  // Ops entered before enabling have no enter timestamp
+  if (instance.started) {
+    return false;
+  }
+  OpStatsEngine::instance().enable();
+  return true;
+}
+
+// True: stack sampling enabled
+// False: profiling has started
+bool TorchProfiler::enable_stack_sampling(uint64_t frequency, size_t max_num_states) {
+  auto& instance = TorchProfilerState::instance();
+  std::lock_guard<std::mutex> lock(instance.mutex);
+
+  // The timer is not armed and ops entered before enabling are not on the sampler path
+  if (instance.started) {
+    return false;
+  }
+  StackSampler::instance().enable(frequency, max_num_states);
+  return true;
+}
+
+// True: flame graph file opened
+// False: profiling has started or the flame graph file cannot be opened
+bool TorchProfiler::enable_flame_graph(const char* path, torch_monitor_flame_graph_metric_t metric,
+                                       size_t max_num_states) {
+  auto& instance = TorchProfilerState::instance();
+  std::lock_guard<std::mutex> lock(instance.mutex);
+
+  // Ops entered before enabling have no trie node
+  if (instance.started) {
+    return false;
+  }
+  return FlameGraph::instance().enable(path, metric, max_num_states);
+}
+
+// True: input capture enabled
+// False: profiling has started
+bool TorchProfiler::enable_input_capture() {
   auto& instance = TorchProfilerState::instance();
-  if (instance.callback == nullptr || instance.scopes.empty()) {
+  std::lock_guard<std::mutex> lock(instance.mutex);
+
+  if (instance.started) {
     return false;
   }
+  SignatureTable::instance().enable();
+  return true;
+}
+
+torch_monitor_record_mode_t TorchProfiler::record_mode() {
+  return TorchProfilerState::instance().record_mode;
+}
+
+bool TorchProfiler::attach_callback() {
+  auto& instance = TorchProfilerState::instance();
+  if (instance.scopes.empty()) {
+    // Only the memory domain is enabled
+    return true;
+  }
+
+  // Exit callbacks of ops in flight may be missed while the callback is detached
+  instance.epoch.fetch_add(1, std::memory_order_relaxed);
 
   auto handle = at::addGlobalCallback(
       at::RecordFunctionCallback(
           [](const at::RecordFunction& fn) -> std::unique_ptr<at::ObserverContext> {
+            auto& instance = TorchProfilerState::instance();
+            CallbackGuard guard(instance);
+            if (!guard.active()) {
+              return nullptr;
+            }
+
+            // Filtered ops never reach the op stack, so exits stay paired with enters
+            auto name_id = intern_name(fn);
+            auto& op_filter = OpFilter::instance();
+            if (op_filter.is_enabled() && !op_filter.pass(name_id)) {
+              return nullptr;
+            }
+
+            // The stack sampler only needs the op name on the shadow stack
+            auto& stack_sampler = StackSampler::instance();
+            if (stack_sampler.is_enabled()) {
+              auto& op_stack = OpStack::current();
+              op_stack.sync(instance.epoch.load(std::memory_order_relaxed));
+              stack_sampler.enter(op_stack, name_id);
+              return nullptr;
+            }
+
+            auto timestamp = Timer::instance().now();
+
             LOG_INFO("Enter function");
 
             torch_monitor_callback_data_t callback_data = {};
-            if (init_callback_data(TORCH_MONITOR_CALLBACK_ENTER, fn, callback_data)) {
-              TorchProfilerState::instance().callback(TORCH_MONITOR_CALLBACK_ENTER, &callback_data);
+            if (init_callback_data(TORCH_MONITOR_CALLBACK_ENTER, fn, name_id, timestamp,
+                                   callback_data)) {
+              dispatch_callback(TORCH_MONITOR_CALLBACK_ENTER, &callback_data);
             }
 
             return nullptr;
           },
           [](const at::RecordFunction& fn, at::ObserverContext* ctx_ptr) {
+            // Frames of ops entered before a pause are discarded at resume
+            auto& instance = TorchProfilerState::instance();
+            CallbackGuard guard(instance);
+            if (!guard.active()) {
+              return;
+            }
+
+            // Verdicts never change after start, so the enter of this op was filtered too
+            auto& op_filter = OpFilter::instance();
+            if (op_filter.is_enabled() && !op_filter.pass(intern_name(fn))) {
+              return;
+            }
+
+            auto& stack_sampler = StackSampler::instance();
+            if (stack_sampler.is_enabled()) {
+              auto& op_stack = OpStack::current();
+              op_stack.sync(instance.epoch.load(std::memory_order_relaxed));
+              stack_sampler.exit(op_stack);
+              // Sampled ops still scope the allocations deferred by the memory coalescer
+              escape_memory_callbacks(op_stack.depth());
+              return;
+            }
+
+            auto timestamp = Timer::instance().now();
+
             torch_monitor_callback_data_t callback_data = {};
-            if (init_callback_data(TORCH_MONITOR_CALLBACK_EXIT, fn, callback_data)) {
-              TorchProfilerState::instance().callback(TORCH_MONITOR_CALLBACK_EXIT, &callback_data);
+            if (init_callback_data(TORCH_MONITOR_CALLBACK_EXIT, fn, NameTable::NAME_ID_NULL,
+                                   timestamp, callback_data)) {
+              dispatch_callback(TORCH_MONITOR_CALLBACK_EXIT, &callback_data);
             }
 
             LOG_INFO("Exit function");
             return;
           })
-          .needsInputs(false)   // TODO(Keren): monitor inputs if needed?
+          .needsInputs(SignatureTable::instance().is_enabled())
           .needsOutputs(false)  // TODO(Keren): monitor outputs if needed?
-          .scopes(TorchProfilerState::instance().scopes));
+          .scopes(instance.scopes));
 
   if (handle != TORCH_PROFILER_HANDLE_NULL) {
     instance.handle = handle;
@@ -188,8 +709,234 @@ bool TorchProfiler::start_profiling() {
   return false;
 }
 
+void TorchProfiler::detach_callback() {
+  auto& instance = TorchProfilerState::instance();
+  if (instance.handle != TORCH_PROFILER_HANDLE_NULL) {
+    at::removeCallback(instance.handle);
+    instance.handle = TORCH_PROFILER_HANDLE_NULL;
+  }
+}
+
+bool TorchProfiler::attach_marker_callback() {
+  auto& instance = TorchProfilerState::instance();
+
+  auto handle = at::addGlobalCallback(
+      at::RecordFunctionCallback(
+          [](const at::RecordFunction& fn) -> std::unique_ptr<at::ObserverContext> {
+            return nullptr;
+          },
+          [](const at::RecordFunction& fn, at::ObserverContext* ctx_ptr) {
+            // A step ends after its marker op, e.g., after the optimizer updates parameters
+#if TORCH_VERSION_MAJOR <= 1 && TORCH_VERSION_MINOR < 11
+            bool marker = StepWindow::instance().is_marker(fn.name().str());
+#else
+            bool marker = StepWindow::instance().is_marker(fn.name());
+#endif
+            if (marker) {
+              TorchProfiler::instance().step();
+            }
+          })
+          .needsInputs(false)
+          .needsOutputs(false)
+          .scopes({at::RecordScope::USER_SCOPE}));
+
+  if (handle != TORCH_PROFILER_HANDLE_NULL) {
+    instance.marker_handle = handle;
+    return true;
+  }
+
+  return false;
+}
+
+void TorchProfiler::detach_marker_callback() {
+  auto& instance = TorchProfilerState::instance();
+  if (instance.marker_handle != TORCH_PROFILER_HANDLE_NULL) {
+    at::removeCallback(instance.marker_handle);
+    instance.marker_handle = TORCH_PROFILER_HANDLE_NULL;
+  }
+}
+
+// True: set success
+// False: profiling has started
+bool TorchProfiler::set_step_window(uint64_t skip_steps, uint64_t record_steps,
+                                    const char* marker) {
+  auto& instance = TorchProfilerState::instance();
+  std::lock_guard<std::mutex> lock(instance.mutex);
+
+  if (instance.started) {
+    return false;
+  }
+  StepWindow::instance().set(skip_steps, record_steps, marker);
+  return true;
+}
+
+bool TorchProfiler::step() {
+  auto& instance = TorchProfilerState::instance();
+  StepWindow::Transition transition;
+  {
+    std::lock_guard<std::mutex> lock(instance.mutex);
+
+    if (!instance.started) {
+      return false;
+    }
+    if (instance.trace_enabled) {
+      TraceWriter::instance().step();
+    }
+    transition = StepWindow::instance().step();
+    if (transition == StepWindow::TRANSITION_CLOSE) {
+      // No step can change the window anymore
+      detach_marker_callback();
+    }
+  }
+
+  if (transition == StepWindow::TRANSITION_OPEN) {
+    return resume_profiling();
+  } else if (transition == StepWindow::TRANSITION_CLOSE) {
+    return pause_profiling();
+  }
+  return true;
+}
+
+bool TorchProfiler::start_profiling() {
+  auto& instance = TorchProfilerState::instance();
+  std::lock_guard<std::mutex> lock(instance.mutex);
+
+  auto& stack_sampler = StackSampler::instance();
+  if ((SubscriberRegistry::instance().empty() && EventBatcher::instance().empty() &&
+       !instance.trace_enabled && !stack_sampler.is_enabled()) ||
+      (instance.scopes.empty() && !is_memory_profiling_enabled()) || instance.started) {
+    return false;
+  }
+
+  OpFilter::instance().seal();
+
+  auto& step_window = StepWindow::instance();
+  if (step_window.has_marker() && !attach_marker_callback()) {
+    return false;
+  }
+  if (!step_window.is_open_at_start()) {
+    // Ops are not seen until the step window opens
+    if (instance.record_mode == TORCH_MONITOR_RECORD_MODE_ASYNC) {
+      EventBufferManager::instance().start();
+    }
+    instance.started = true;
+    instance.paused = true;
+    return true;
+  }
+
+  // Open the gate first so that no op can see an exit callback without its enter callback
+  instance.active.store(true, std::memory_order_release);
+  if (!attach_callback()) {
+    instance.active.store(false, std::memory_order_release);
+    detach_marker_callback();
+    return false;
+  }
+  if (stack_sampler.is_enabled() && !stack_sampler.start()) {
+    instance.active.store(false, std::memory_order_release);
+    detach_callback();
+    detach_marker_callback();
+    return false;
+  }
+
+  // Started last so that no failure leaves the consumer running, records pushed before
+  // are drained by its first round
+  if (instance.record_mode == TORCH_MONITOR_RECORD_MODE_ASYNC) {
+    EventBufferManager::instance().start();
+  }
+  instance.started = true;
+  return true;
+}
+
 bool TorchProfiler::stop_profiling() {
-  TorchProfilerState::instance().clear();
+  auto& instance = TorchProfilerState::instance();
+  std::lock_guard<std::mutex> lock(instance.mutex);
+
+  instance.active.store(false, std::memory_order_seq_cst);
+  detach_callback();
+  detach_marker_callback();
+  // Tables below are merged and cleared, callbacks on other threads must not write them
+  instance.quiesce();
+  // Allocations of ops that never exited are delivered while subscribers are still set
+  auto& memory_coalescer = MemoryCoalescer::instance();
+  if (memory_coalescer.is_enabled()) {
+    memory_coalescer.flush([](PendingAllocation& allocation) {
+      dispatch_memory_callback(&allocation.callback_data);
+    });
+  }
+  auto& stack_sampler = StackSampler::instance();
+  if (stack_sampler.is_enabled()) {
+    stack_sampler.stop();
+    stack_sampler.merge();
+  }
+
+  if (instance.record_mode == TORCH_MONITOR_RECORD_MODE_ASYNC) {
+    // Deliver pending records before the subscriber is cleared
+    EventBufferManager::instance().stop();
+  }
+  if (instance.trace_enabled) {
+    TraceWriter::instance().close();
+  }
+  // Deliver partial batches before the batch subscribers are cleared
+  EventBatcher::instance().flush_all();
+  CorrelationTable::instance().clear();
+  if (OpStatsEngine::instance().is_enabled()) {
+    OpStatsEngine::instance().merge();
+  }
+  if (FlameGraph::instance().is_enabled()) {
+    FlameGraph::instance().write();
+  }
+  if (CostModel::instance().is_enabled()) {
+    CostModel::instance().merge();
+  }
+  if (OpMemoryEngine::instance().is_enabled()) {
+    OpMemoryEngine::instance().merge();
+  }
+  if (AllocationTable::instance().is_enabled()) {
+    AllocationTable::instance().flush();
+  }
+  instance.clear();
+  return true;
+}
+
+bool TorchProfiler::pause_profiling() {
+  auto& instance = TorchProfilerState::instance();
+  std::lock_guard<std::mutex> lock(instance.mutex);
+
+  if (!instance.started) {
+    return false;
+  }
+  if (!instance.paused) {
+    instance.active.store(false, std::memory_order_release);
+    detach_callback();
+    // Stacks are not maintained while paused
+    if (StackSampler::instance().is_enabled()) {
+      StackSampler::instance().stop();
+    }
+    instance.paused = true;
+  }
+  return true;
+}
+
+bool TorchProfiler::resume_profiling() {
+  auto& instance = TorchProfilerState::instance();
+  std::lock_guard<std::mutex> lock(instance.mutex);
+
+  if (!instance.started) {
+    return false;
+  }
+  if (instance.paused) {
+    instance.active.store(true, std::memory_order_release);
+    if (!attach_callback()) {
+      instance.active.store(false, std::memory_order_release);
+      return false;
+    }
+    if (StackSampler::instance().is_enabled() && !StackSampler::instance().start()) {
+      instance.active.store(false, std::memory_order_release);
+      detach_callback();
+      return false;
+    }
+    instance.paused = false;
+  }
   return true;
 }
 
@@ -0,0 +1,429 @@
+#include "trace_writer.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include "name_table.h"
+#include "timer.h"
+#include "utils.h"
+
+namespace torch_monitor {
+
+static void trace_record_fill(TraceRecord &record, torch_monitor_callback_site_t callback_site,
+                              const torch_monitor_callback_data_t *callback_data) {
+  record.domain = callback_data->domain;
+  record.callback_site = callback_site;
+  record.thread_id = callback_data->current_thread_id;
+  record.timestamp = Timer::instance().to_ns(callback_data->timestamp);
+  record.weight = callback_data->weight;
+  if (callback_data->domain == TORCH_MONITOR_DOMAIN_MEMORY) {
+    auto &mem_data = callback_data->data.mem_data;
+    record.mem_type = mem_data.type;
+    record.device_type = mem_data.device_type;
+    record.nested_level = 0;
+    record.name_id = NameTable::NAME_ID_NULL;
+    record.data.mem.ptr = reinterpret_cast<uint64_t>(mem_data.ptr);
+    record.data.mem.size = mem_data.size;
+    record.data.mem.total_allocated = mem_data.total_allocated;
+    record.data.mem.total_reserved = mem_data.total_reserved;
+  } else {
+    auto &op_data = callback_data->data.op_data;
+    record.mem_type = 0;
+    record.device_type = 0;
+    record.nested_level = op_data.nested_level;
+    record.name_id = op_data.name_id;
+    record.data.mem = {};
+    record.data.op.forward_thread_id = op_data.forward_thread_id;
+    record.data.op.sequence_number = op_data.sequence_number;
+    record.data.op.correlation_id = op_data.forward_op.correlation_id;
+  }
+}
+
+static uint64_t trace_mix(uint64_t hash, uint64_t value) {
+  hash = (hash ^ value) * 0x9e3779b97f4a7c15ull;
+  return hash ^ (hash >> 32);
+}
+
+// The fields that make two iterations identical
+static uint64_t trace_record_key(const TraceRecord &record,
+                                 const torch_monitor_callback_data_t *callback_data) {
+  uint32_t weight;
+  memcpy(&weight, &record.weight, sizeof(weight));
+  uint64_t key = trace_mix(0, static_cast<uint64_t>(record.domain) |
+                                  (static_cast<uint64_t>(record.callback_site) << 8) |
+                                  (static_cast<uint64_t>(record.mem_type) << 16) |
+                                  (static_cast<uint64_t>(record.device_type) << 24) |
+                                  (static_cast<uint64_t>(record.nested_level) << 32));
+  key = trace_mix(key, (static_cast<uint64_t>(record.name_id) << 32) | weight);
+  if (callback_data->domain == TORCH_MONITOR_DOMAIN_MEMORY) {
+    key = trace_mix(key, static_cast<uint64_t>(record.data.mem.size));
+  } else {
+    key = trace_mix(key, callback_data->data.op_data.signature_id);
+  }
+  return key;
+}
+
+static void trace_delta_append(std::vector<uint8_t> &deltas, int64_t delta) {
+  // Zigzag maps small negative deltas to small varints
+  auto value = (static_cast<uint64_t>(delta) << 1) ^ static_cast<uint64_t>(delta >> 63);
+  while (value >= 0x80) {
+    deltas.push_back(static_cast<uint8_t>(value) | 0x80);
+    value >>= 7;
+  }
+  deltas.push_back(static_cast<uint8_t>(value));
+}
+
+bool MappedFile::open(const std::string &path) {
+  _fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (_fd < 0) {
+    LOG_INFO("open %s fail", path.c_str());
+    return false;
+  }
+  _size = 0;
+  if (!map_chunk(0)) {
+    ::close(_fd);
+    _fd = -1;
+    return false;
+  }
+  return true;
+}
+
+bool MappedFile::map_chunk(uint64_t chunk_offset) {
+  if (ftruncate(_fd, chunk_offset + MAPPED_FILE_CHUNK_SIZE) != 0) {
+    LOG_INFO("ftruncate %lu fail", chunk_offset + MAPPED_FILE_CHUNK_SIZE);
+    return false;
+  }
+  void *chunk =
+      mmap(nullptr, MAPPED_FILE_CHUNK_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, chunk_offset);
+  if (chunk == MAP_FAILED) {
+    LOG_INFO("mmap %lu fail", chunk_offset);
+    return false;
+  }
+  _chunk = reinterpret_cast<char *>(chunk);
+  _chunk_offset = chunk_offset;
+  return true;
+}
+
+void MappedFile::unmap_chunk() {
+  if (_chunk != nullptr) {
+    munmap(_chunk, MAPPED_FILE_CHUNK_SIZE);
+    _chunk = nullptr;
+  }
+}
+
+uint64_t MappedFile::append(const void *data, size_t size) {
+  auto offset = _size;
+  auto *bytes = reinterpret_cast<const char *>(data);
+  while (size != 0) {
+    if (_chunk == nullptr) {
+      // A previous chunk could not be mapped, drop the rest of the trace
+      return offset;
+    }
+    auto chunk_pos = _size - _chunk_offset;
+    auto len = std::min(size, MAPPED_FILE_CHUNK_SIZE - chunk_pos);
+    memcpy(_chunk + chunk_pos, bytes, len);
+    _size += len;
+    bytes += len;
+    size -= len;
+    if (_size == _chunk_offset + MAPPED_FILE_CHUNK_SIZE) {
+      // Retire the full chunk and extend the file by another one
+      unmap_chunk();
+      map_chunk(_size);
+    }
+  }
+  return offset;
+}
+
+bool MappedFile::overwrite(uint64_t offset, const void *data, size_t size) {
+  return pwrite(_fd, data, size, offset) == static_cast<ssize_t>(size);
+}
+
+bool MappedFile::close() {
+  if (_fd < 0) {
+    return false;
+  }
+  unmap_chunk();
+  // Drop the unused tail of the last chunk
+  bool success = ftruncate(_fd, _size) == 0;
+  ::close(_fd);
+  _fd = -1;
+  return success;
+}
+
+TraceWriter &TraceWriter::instance() {
+  static TraceWriter writer;
+  return writer;
+}
+
+bool TraceWriter::open(const std::string &path) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  if (_file.is_open() || !_file.open(path)) {
+    return false;
+  }
+
+  TraceFileHeader header = {};
+  header.magic = TRACE_FILE_MAGIC;
+  header.version = TRACE_FILE_VERSION;
+  header.record_size = sizeof(TraceRecord);
+  _file.append(&header, sizeof(header));
+  _num_records = 0;
+  return true;
+}
+
+TraceWriter::TraceBlock *TraceWriter::register_thread_block() {
+  _thread_block = std::make_shared<TraceBlock>();
+
+  std::lock_guard<std::mutex> lock(_mutex);
+  _blocks.push_back(_thread_block);
+  return _thread_block.get();
+}
+
+TraceWriter::TraceIteration *TraceWriter::find_iteration(uint64_t thread_id, uint64_t step) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  auto &iteration = _thread_iterations[thread_id];
+  if (iteration == nullptr) {
+    iteration = std::make_shared<TraceIteration>();
+    iteration->thread_id = thread_id;
+    iteration->step = step;
+  }
+  auto &entry = _iteration_cache[thread_id & (TRACE_DEDUP_ITERATION_CACHE_SIZE - 1)];
+  entry.thread_id = thread_id;
+  entry.iteration = iteration.get();
+  return entry.iteration;
+}
+
+uint64_t TraceWriter::append_records(const TraceRecord *records, size_t num_records,
+                                     uint64_t thread_id) {
+  TraceIndexEntry entry;
+  entry.offset = _file.append(records, num_records * sizeof(TraceRecord));
+  entry.num_records = num_records;
+  entry.thread_id = thread_id;
+  entry.min_timestamp = records[0].timestamp;
+  entry.max_timestamp = records[0].timestamp;
+  for (size_t i = 1; i < num_records; ++i) {
+    entry.min_timestamp = std::min(entry.min_timestamp, records[i].timestamp);
+    entry.max_timestamp = std::max(entry.max_timestamp, records[i].timestamp);
+  }
+  _index.push_back(entry);
+
+  _num_records += num_records;
+  return entry.offset;
+}
+
+void TraceWriter::flush_block(TraceBlock &block) {
+  if (block.num_records == 0) {
+    return;
+  }
+
+  append_records(block.records, block.num_records, block.thread_id);
+  block.num_records = 0;
+}
+
+void TraceWriter::flush_iteration(TraceIteration &iteration) {
+  auto &records = iteration.records;
+  auto &keys = iteration.keys;
+  auto num_records = records.size();
+  if (num_records == 0) {
+    return;
+  }
+
+  uint64_t hash = num_records;
+  auto &gaps = iteration.gaps;
+  gaps.resize(num_records);
+  for (size_t i = 0; i < num_records; ++i) {
+    hash = trace_mix(hash, keys[i]);
+    gaps[i] = i == 0 ? 0 : static_cast<int64_t>(records[i].timestamp - records[i - 1].timestamp);
+  }
+
+  TraceIterationEntry entry = {};
+  entry.thread_id = iteration.thread_id;
+  entry.step = iteration.step;
+  entry.base_timestamp = records[0].timestamp;
+  entry.num_records = num_records;
+  entry.kind = TRACE_ITERATION_REFERENCE;
+
+  // Look for a reference with the same sequence, otherwise diff against the most recent one
+  const TraceReference *reference = nullptr;
+  for (auto &candidate : iteration.references) {
+    if (candidate.hash == hash && candidate.keys == keys) {
+      reference = &candidate;
+      entry.kind = TRACE_ITERATION_REPEAT;
+      entry.prefix_records = num_records;
+      break;
+    }
+  }
+  if (reference == nullptr && !iteration.references.empty()) {
+    auto &candidate = iteration.references.back();
+    auto num_reference_records = candidate.keys.size();
+    auto max_shared = std::min(num_records, num_reference_records);
+    size_t prefix = 0;
+    while (prefix < max_shared && keys[prefix] == candidate.keys[prefix]) {
+      ++prefix;
+    }
+    size_t suffix = 0;
+    while (prefix + suffix < max_shared &&
+           keys[num_records - suffix - 1] == candidate.keys[num_reference_records - suffix - 1]) {
+      ++suffix;
+    }
+    // A diff storing most records is not worth the deltas, and a sequence diffed twice
+    // in a row is likely the steady state, which is cheaper to repeat as a reference
+    if (num_records - prefix - suffix <= num_records / 2 && hash != iteration.diff_hash) {
+      iteration.diff_hash = hash;
+      reference = &candidate;
+      entry.kind = TRACE_ITERATION_DIFF;
+      entry.prefix_records = prefix;
+      entry.suffix_records = suffix;
+    }
+  }
+
+  if (reference == nullptr) {
+    entry.reference = _iterations.size();
+    entry.records_offset = append_records(records.data(), num_records, iteration.thread_id);
+
+    TraceReference new_reference;
+    new_reference.entry = entry.reference;
+    new_reference.hash = hash;
+    new_reference.keys = keys;
+    new_reference.gaps = gaps;
+    iteration.references.push_back(std::move(new_reference));
+    if (iteration.references.size() > TRACE_DEDUP_MAX_REFERENCES) {
+      iteration.references.pop_front();
+    }
+  } else {
+    entry.reference = reference->entry;
+    auto num_reference_records = reference->keys.size();
+    auto &deltas = iteration.deltas;
+    deltas.clear();
+    for (size_t i = 0; i < entry.prefix_records; ++i) {
+      trace_delta_append(deltas, gaps[i] - reference->gaps[i]);
+    }
+    for (size_t i = num_records - entry.suffix_records; i < num_records; ++i) {
+      trace_delta_append(deltas, gaps[i] - reference->gaps[num_reference_records - num_records + i]);
+    }
+    entry.deltas_offset = _file.append(deltas.data(), deltas.size());
+    entry.deltas_size = deltas.size();
+    auto num_stored = num_records - entry.prefix_records - entry.suffix_records;
+    if (num_stored != 0) {
+      entry.records_offset = append_records(records.data() + entry.prefix_records, num_stored,
+                                            iteration.thread_id);
+    }
+  }
+  _iterations.push_back(entry);
+
+  records.clear();
+  keys.clear();
+}
+
+void TraceWriter::write_dedup(torch_monitor_callback_site_t callback_site,
+                              const torch_monitor_callback_data_t *callback_data, uint64_t step) {
+  auto thread_id = callback_data->current_thread_id;
+  auto &entry = _iteration_cache[thread_id & (TRACE_DEDUP_ITERATION_CACHE_SIZE - 1)];
+  auto *iteration = entry.iteration;
+  if (iteration == nullptr || entry.thread_id != thread_id) {
+    iteration = find_iteration(thread_id, step);
+  }
+
+  if (iteration->step != step || iteration->records.size() == TRACE_DEDUP_MAX_RECORDS) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    flush_iteration(*iteration);
+    iteration->step = step;
+  }
+
+  iteration->records.emplace_back();
+  auto &record = iteration->records.back();
+  trace_record_fill(record, callback_site, callback_data);
+  iteration->keys.push_back(trace_record_key(record, callback_data));
+}
+
+void TraceWriter::write(torch_monitor_callback_site_t callback_site,
+                        const torch_monitor_callback_data_t *callback_data, uint64_t step) {
+  if (_dedup_enabled) {
+    write_dedup(callback_site, callback_data, step);
+    return;
+  }
+
+  auto *block = _thread_block.get();
+  if (block == nullptr) {
+    block = register_thread_block();
+  }
+
+  trace_record_fill(block->records[block->num_records], callback_site, callback_data);
+
+  auto thread_id = callback_data->current_thread_id;
+  if (block->num_records == 0) {
+    block->thread_id = thread_id;
+  } else if (block->thread_id != thread_id) {
+    block->thread_id = TRACE_THREAD_ID_MIXED;
+  }
+  if (++block->num_records == TRACE_BLOCK_NUM_RECORDS) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    flush_block(*block);
+  }
+}
+
+bool TraceWriter::close() {
+  std::lock_guard<std::mutex> lock(_mutex);
+  if (!_file.is_open()) {
+    return false;
+  }
+
+  for (auto &block : _blocks) {
+    flush_block(*block);
+  }
+  _blocks.clear();
+  // Iterations stay registered because threads cache pointers to them,
+  // a reopened trace starts without references
+  for (auto &iter : _thread_iterations) {
+    auto &iteration = *iter.second;
+    flush_iteration(iteration);
+    iteration.references.clear();
+    iteration.diff_hash = 0;
+  }
+
+  auto &name_table = NameTable::instance();
+  TraceFileTrailer trailer = {};
+  trailer.name_table_offset = _file.size();
+  trailer.num_names = name_table.size();
+  for (uint32_t i = 0; i < trailer.num_names; ++i) {
+    auto *name = name_table.lookup(i);
+    TraceNameEntry entry;
+    entry.name_id = i;
+    entry.length = strlen(name);
+    _file.append(&entry, sizeof(entry));
+    _file.append(name, entry.length);
+  }
+  trailer.index_offset = _file.size();
+  trailer.num_index_entries = _index.size();
+  if (!_index.empty()) {
+    _file.append(_index.data(), _index.size() * sizeof(TraceIndexEntry));
+  }
+  if (_dedup_enabled) {
+    TraceIterationTrailer iteration_trailer;
+    iteration_trailer.iteration_offset = _file.size();
+    iteration_trailer.num_iterations = _iterations.size();
+    if (!_iterations.empty()) {
+      _file.append(_iterations.data(), _iterations.size() * sizeof(TraceIterationEntry));
+    }
+    _file.append(&iteration_trailer, sizeof(iteration_trailer));
+  }
+  trailer.magic = TRACE_FILE_TRAILER_MAGIC;
+  auto trailer_offset = _file.append(&trailer, sizeof(trailer));
+
+  TraceFileHeader header = {};
+  header.magic = TRACE_FILE_MAGIC;
+  header.version = _dedup_enabled ? TRACE_FILE_VERSION_DEDUP : TRACE_FILE_VERSION;
+  header.record_size = sizeof(TraceRecord);
+  header.num_records = _num_records;
+  header.trailer_offset = trailer_offset;
+  bool success = _file.overwrite(0, &header, sizeof(header));
+
+  _index.clear();
+  _iterations.clear();
+  return _file.close() && success;
+}
+
+}  // namespace torch_monitor
@@ -1,5 +1,7 @@
 #include "utils.h"
 
+#include <ctime>
+
 #include "torch_monitor.h"
 
 namespace torch_monitor {
@@ -40,4 +42,10 @@ torch_monitor_device_type_t aten_device_type_match(at::DeviceType device_type) {
   }
 }
 
+uint64_t monotonic_timestamp() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+}
+
 }  // namespace torch_monitor
\ No newline at end of file
@@ -0,0 +1,21 @@
+import ctypes
+import torch
+import sys
+
+# torch_monitor is preloaded by the driver
+monitor = ctypes.CDLL(None)
+
+device = str(sys.argv[1])
+device = torch.device(device)
+left = torch.zeros(100, device=device, requires_grad=True)
+right = torch.zeros(100, device=device, requires_grad=True)
+grad = torch.zeros(100, device=device)
+
+# Ops of even iterations are not delivered
+for i in range(10):
+    if i % 2 == 0:
+        assert monitor.torch_monitor_pause() == 0
+    else:
+        assert monitor.torch_monitor_resume() == 0
+    output = torch.add(left, right)
+    output.backward(grad)
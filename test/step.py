@@ -0,0 +1,16 @@
+import torch
+import sys
+
+device = str(sys.argv[1])
+device = torch.device(device)
+left = torch.zeros(100, device=device, requires_grad=True)
+right = torch.zeros(100, device=device, requires_grad=True)
+grad = torch.zeros(100, device=device)
+optimizer = torch.optim.SGD([left, right], lr=0.1)
+
+# Each iteration ends at Optimizer.step
+for _ in range(10):
+    optimizer.zero_grad()
+    output = torch.add(left, right)
+    output.backward(grad)
+    optimizer.step()
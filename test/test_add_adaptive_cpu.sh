@@ -0,0 +1,24 @@
+#!/bin/bash
+
+# Unit test of adaptive sampling
+
+LD_PRELOAD=$(pwd)/../driver/driver.so TORCH_MONITOR_ADAPTIVE_THRESHOLD=5 python ./add.py cpu > ./log
+
+ret=$?
+if [ $ret -eq 0 ]; then
+    # Ten aten::add ops at one level: five in full, then periods of two ops ending at
+    # the window end, so fewer ops are delivered and their weights add up to ten
+    count=$(grep -c "^Name: aten::add$" ./log)
+    total=$(awk '/^Domain: /{weight = 1} /^Weight: /{weight = $2} /^Name: aten::add$/{total += weight} END{print total}' ./log)
+    if [ "$count" -ge 10 ] || [ "$total" != "10" ]; then
+        ret=1
+    fi
+fi
+rm ./log
+
+if [ $ret -ne 0 ]; then
+    echo "Error"
+    exit 1
+fi
+
+echo "Success"
@@ -0,0 +1,28 @@
+#!/bin/bash
+
+# Unit test of op and mem information delivered by the async record mode
+
+LD_PRELOAD=$(pwd)/../driver/driver.so TORCH_MONITOR_ASYNC_ENABLE=1 TORCH_MONITOR_TIMESTAMP_ENABLE=1 python ./add.py cpu > ./log
+
+ret=$?
+if [ $ret -eq 0 ]; then
+    # Every aten::add is delivered by the consumer thread
+    count=$(grep -c "^Name: aten::add$" ./log)
+    if [ "$count" -ne 10 ]; then
+        ret=1
+    fi
+    # Enters and exits are delivered in pairs
+    enters=$(grep -c "^Enter level: " ./log)
+    exits=$(grep -c "^Exit level: " ./log)
+    if [ "$enters" -lt 10 ] || [ "$enters" -ne "$exits" ]; then
+        ret=1
+    fi
+fi
+rm ./log
+
+if [ $ret -ne 0 ]; then
+    echo "Error"
+    exit 1
+fi
+
+echo "Success"
@@ -0,0 +1,22 @@
+#!/bin/bash
+
+# Unit test of columnar batches delivered to batch subscribers
+
+LD_PRELOAD=$(pwd)/../driver/driver.so TORCH_MONITOR_BATCH_SIZE=64 python ./add.py cpu > ./log
+
+ret=$?
+if [ $ret -eq 0 ]; then
+    # Full batches during the run and the partial batch at finalize
+    count=$(grep -c "Batch: " ./log)
+    if [ "$count" -lt 1 ]; then
+        ret=1
+    fi
+fi
+rm ./log
+
+if [ $ret -ne 0 ]; then
+    echo "Error"
+    exit 1
+fi
+
+echo "Success"
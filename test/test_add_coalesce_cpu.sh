@@ -0,0 +1,33 @@
+#!/bin/bash
+
+# Unit test of transient allocations folded by the memory coalescer
+
+LD_PRELOAD=$(pwd)/../driver/driver.so python ./add.py cpu > ./log_full
+ret=$?
+
+if [ $ret -eq 0 ]; then
+    LD_PRELOAD=$(pwd)/../driver/driver.so TORCH_MONITOR_MEMORY_COALESCE_ENABLE=1 python ./add.py cpu > ./log
+    ret=$?
+fi
+
+if [ $ret -eq 0 ]; then
+    # Coalescing never delivers more memory events
+    full=$(grep -c -E "^(Allocate|Free) ptr" ./log_full)
+    coalesced=$(grep -c -E "^(Allocate|Free) ptr" ./log)
+    if [ "$coalesced" -gt "$full" ]; then
+        ret=1
+    fi
+    # Every folded pair is a delivered event pair less
+    transient=$(grep "Innermost transient count/bytes:" ./log | cut -d ":" -f 2 | cut -d "/" -f 1 | awk '{ sum += $1 } END { print sum + 0 }')
+    if [ "$((full - coalesced))" -ne "$((2 * transient))" ]; then
+        ret=1
+    fi
+fi
+rm -f ./log ./log_full
+
+if [ $ret -ne 0 ]; then
+    echo "Error"
+    exit 1
+fi
+
+echo "Success"
@@ -0,0 +1,22 @@
+#!/bin/bash
+
+# Unit test of attributing backward ops to forward ops
+
+LD_PRELOAD=$(pwd)/../driver/driver.so TORCH_MONITOR_CORRELATION_ENABLE=1 python ./add.py cpu > ./log
+
+ret=$?
+if [ $ret -eq 0 ]; then
+    # Every iteration attributes AddBackward0 to aten::add
+    count=$(grep -A1 "Name: .*AddBackward0" ./log | grep -c "Forward op: [0-9]* aten::add")
+    if [ "$count" -lt 10 ]; then
+        ret=1
+    fi
+fi
+rm ./log
+
+if [ $ret -ne 0 ]; then
+    echo "Error"
+    exit 1
+fi
+
+echo "Success"
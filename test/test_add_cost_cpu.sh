@@ -0,0 +1,22 @@
+#!/bin/bash
+
+# Unit test of achieved throughput estimated by the cost model
+
+LD_PRELOAD=$(pwd)/../driver/driver.so TORCH_MONITOR_COST_MODEL_ENABLE=1 TORCH_MONITOR_VERBOSE_DISABLE=1 python ./add.py cpu > ./log
+
+ret=$?
+if [ $ret -eq 0 ]; then
+    # aten::add is an elementwise op of the model
+    count=$(grep -A2 "Throughput: aten::add$" ./log | grep -c "Count: [1-9]")
+    if [ "$count" -lt 1 ]; then
+        ret=1
+    fi
+fi
+rm ./log
+
+if [ $ret -ne 0 ]; then
+    echo "Error"
+    exit 1
+fi
+
+echo "Success"
@@ -0,0 +1,26 @@
+#!/bin/bash
+
+# Unit test of op name filters
+
+LD_PRELOAD=$(pwd)/../driver/driver.so TORCH_MONITOR_OP_DENY="aten::add,aten::*_like" python ./add.py cpu > ./log
+
+ret=$?
+if [ $ret -eq 0 ]; then
+    count=$(grep -c -E "^Name: (aten::add|aten::.*_like)$" ./log)
+    if [ "$count" -ne 0 ]; then
+        ret=1
+    fi
+    # Other ops are still delivered
+    count=$(grep -c "^Name: aten::zeros$" ./log)
+    if [ "$count" -lt 1 ]; then
+        ret=1
+    fi
+fi
+rm ./log
+
+if [ $ret -ne 0 ]; then
+    echo "Error"
+    exit 1
+fi
+
+echo "Success"
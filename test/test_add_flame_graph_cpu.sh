@@ -0,0 +1,26 @@
+#!/bin/bash
+
+# Unit test of collapsed stacks written by the flame graph
+
+LD_PRELOAD=$(pwd)/../driver/driver.so TORCH_MONITOR_FLAME_GRAPH_PATH=./add.folded TORCH_MONITOR_VERBOSE_DISABLE=1 python ./add.py cpu > ./log
+
+ret=$?
+if [ $ret -eq 0 ]; then
+    # Each stack is a single "frame;frame;... value" line
+    count=$(grep -c -E "^aten::add [0-9]+$" ./add.folded)
+    if [ "$count" -ne 1 ]; then
+        ret=1
+    fi
+    count=$(grep -c -v -E "^.+ [0-9]+$" ./add.folded)
+    if [ "$count" -ne 0 ]; then
+        ret=1
+    fi
+fi
+rm -f ./log ./add.folded
+
+if [ $ret -ne 0 ]; then
+    echo "Error"
+    exit 1
+fi
+
+echo "Success"
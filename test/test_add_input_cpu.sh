@@ -0,0 +1,22 @@
+#!/bin/bash
+
+# Unit test of input shapes captured as signature ids
+
+LD_PRELOAD=$(pwd)/../driver/driver.so TORCH_MONITOR_INPUT_CAPTURE_ENABLE=1 python ./add.py cpu > ./log
+
+ret=$?
+if [ $ret -eq 0 ]; then
+    # Both inputs of every aten::add are 100-element tensors
+    count=$(grep -A2 "Name: aten::add$" ./log | grep -c "Input: tensor dtype [0-9]* \[100\]")
+    if [ "$count" -lt 20 ]; then
+        ret=1
+    fi
+fi
+rm ./log
+
+if [ $ret -ne 0 ]; then
+    echo "Error"
+    exit 1
+fi
+
+echo "Success"
@@ -0,0 +1,26 @@
+#!/bin/bash
+
+# Unit test of the allocator summary and timeline
+
+LD_PRELOAD=$(pwd)/../driver/driver.so TORCH_MONITOR_MEMORY_ANALYZER_ENABLE=1 TORCH_MONITOR_VERBOSE_DISABLE=1 python ./add.py cpu > ./log
+
+ret=$?
+if [ $ret -eq 0 ]; then
+    # Tensors of 100 floats fall into the size class of 256 bytes
+    count=$(grep -c "Size class 256 count/bytes: [1-9]" ./log)
+    if [ "$count" -lt 1 ]; then
+        ret=1
+    fi
+    count=$(grep -c "Memory sample:" ./log)
+    if [ "$count" -lt 1 ] || [ "$count" -gt 1024 ]; then
+        ret=1
+    fi
+fi
+rm ./log
+
+if [ $ret -ne 0 ]; then
+    echo "Error"
+    exit 1
+fi
+
+echo "Success"
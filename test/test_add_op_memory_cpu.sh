@@ -0,0 +1,22 @@
+#!/bin/bash
+
+# Unit test of memory events attributed to ops
+
+LD_PRELOAD=$(pwd)/../driver/driver.so TORCH_MONITOR_OP_MEMORY_ENABLE=1 TORCH_MONITOR_VERBOSE_DISABLE=1 python ./add.py cpu > ./log
+
+ret=$?
+if [ $ret -eq 0 ]; then
+    # The output of aten::add is allocated under aten::add as the master op
+    count=$(grep -A4 "Op memory: aten::add$" ./log | grep -c "Master alloc count/bytes: [1-9]")
+    if [ "$count" -lt 1 ]; then
+        ret=1
+    fi
+fi
+rm ./log
+
+if [ $ret -ne 0 ]; then
+    echo "Error"
+    exit 1
+fi
+
+echo "Success"
@@ -0,0 +1,26 @@
+#!/bin/bash
+
+# Unit test of allocations live at the peak memory
+
+LD_PRELOAD=$(pwd)/../driver/driver.so TORCH_MONITOR_ALLOCATION_TRACKING_ENABLE=1 TORCH_MONITOR_VERBOSE_DISABLE=1 python ./add.py cpu > ./log
+
+ret=$?
+if [ $ret -eq 0 ]; then
+    # add.py keeps its tensors alive, so the peak is not empty
+    count=$(grep -c "Peak size: [1-9]" ./log)
+    if [ "$count" -lt 1 ]; then
+        ret=1
+    fi
+    count=$(grep -A1 "Peak allocation:" ./log | grep -c "Size: [1-9]")
+    if [ "$count" -lt 1 ]; then
+        ret=1
+    fi
+fi
+rm ./log
+
+if [ $ret -ne 0 ]; then
+    echo "Error"
+    exit 1
+fi
+
+echo "Success"
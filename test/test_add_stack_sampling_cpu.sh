@@ -0,0 +1,27 @@
+#!/bin/bash
+
+# Unit test of the statistical op profiler
+
+LD_PRELOAD=$(pwd)/../driver/driver.so TORCH_MONITOR_STACK_SAMPLING_FREQUENCY=1000 python ./add.py cpu > ./log
+
+ret=$?
+if [ $ret -eq 0 ]; then
+    # Op callbacks are not delivered in sampling mode
+    count=$(grep -c -E "^Domain: (0|1)$" ./log)
+    if [ "$count" -ne 0 ]; then
+        ret=1
+    fi
+    # At least the CPU time outside ops is sampled
+    count=$(grep -c "Stack sample: [1-9]" ./log)
+    if [ "$count" -lt 1 ]; then
+        ret=1
+    fi
+fi
+rm ./log
+
+if [ $ret -ne 0 ]; then
+    echo "Error"
+    exit 1
+fi
+
+echo "Success"
@@ -0,0 +1,19 @@
+#!/bin/bash
+
+# Unit test of the binary trace sink
+
+LD_PRELOAD=$(pwd)/../driver/driver.so TORCH_MONITOR_VERBOSE_DISABLE=1 TORCH_MONITOR_TRACE_PATH=./trace python ./add.py cpu > ./log
+
+ret=$?
+if [ $ret -eq 0 ]; then
+    python ./trace_check.py ./trace
+    ret=$?
+fi
+rm -f ./log ./trace
+
+if [ $ret -ne 0 ]; then
+    echo "Error"
+    exit 1
+fi
+
+echo "Success"
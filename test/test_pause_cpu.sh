@@ -0,0 +1,26 @@
+#!/bin/bash
+
+# Unit test of pausing and resuming monitoring
+
+LD_PRELOAD=$(pwd)/../driver/driver.so python ./pause.py cpu > ./log
+
+ret=$?
+if [ $ret -eq 0 ]; then
+    # Only the five resumed iterations are delivered
+    count=$(grep -c "^Name: aten::add$" ./log)
+    if [ "$count" -ne 5 ]; then
+        ret=1
+    fi
+    count=$(grep -c "^Name: .*AddBackward0$" ./log)
+    if [ "$count" -ne 5 ]; then
+        ret=1
+    fi
+fi
+rm ./log
+
+if [ $ret -ne 0 ]; then
+    echo "Error"
+    exit 1
+fi
+
+echo "Success"
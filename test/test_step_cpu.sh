@@ -0,0 +1,22 @@
+#!/bin/bash
+
+# Unit test of the step window
+
+LD_PRELOAD=$(pwd)/../driver/driver.so TORCH_MONITOR_STEP_SKIP=2 TORCH_MONITOR_STEP_RECORD=3 python ./step.py cpu > ./log
+
+ret=$?
+if [ $ret -eq 0 ]; then
+    # Only the third to the fifth iterations are delivered
+    count=$(grep -c "^Name: aten::add$" ./log)
+    if [ "$count" -ne 3 ]; then
+        ret=1
+    fi
+fi
+rm ./log
+
+if [ $ret -ne 0 ]; then
+    echo "Error"
+    exit 1
+fi
+
+echo "Success"
@@ -0,0 +1,26 @@
+#!/bin/bash
+
+# Unit test of the deduplicated binary trace
+
+LD_PRELOAD=$(pwd)/../driver/driver.so TORCH_MONITOR_VERBOSE_DISABLE=1 TORCH_MONITOR_TRACE_PATH=./trace TORCH_MONITOR_TRACE_DEDUP=1 python ./step.py cpu > ./log
+
+ret=$?
+if [ $ret -eq 0 ]; then
+    python ./trace_check.py ./trace > ./check_log
+    ret=$?
+fi
+if [ $ret -eq 0 ]; then
+    # Steady-state iterations repeat earlier ones
+    repeats=$(grep -o -E "repeats: [0-9]+" ./check_log | cut -d " " -f 2)
+    if [ -z "$repeats" ] || [ "$repeats" -lt 1 ]; then
+        ret=1
+    fi
+fi
+rm -f ./log ./check_log ./trace
+
+if [ $ret -ne 0 ]; then
+    echo "Error"
+    exit 1
+fi
+
+echo "Success"
@@ -0,0 +1,94 @@
+import struct
+import sys
+
+# Validate a binary trace written by torch_monitor_trace_enable
+HEADER = struct.Struct('<QIIQQ')
+RECORD_SIZE = 64
+NAME_ENTRY = struct.Struct('<II')
+INDEX_ENTRY = struct.Struct('<QQQQQ')
+TRAILER = struct.Struct('<QQQQQ')
+ITERATION_ENTRY = struct.Struct('<QQQQQQQQQQII')
+ITERATION_TRAILER = struct.Struct('<QQ')
+TRACE_FILE_MAGIC = 0x3145434152544d54
+TRACE_FILE_TRAILER_MAGIC = 0x314c494152544d54
+TRACE_FILE_VERSION_DEDUP = 2
+TRACE_THREAD_ID_MIXED = 0xffffffffffffffff
+TRACE_ITERATION_REFERENCE = 0
+TRACE_ITERATION_REPEAT = 1
+TRACE_ITERATION_DIFF = 2
+
+
+def num_varints(data):
+    return sum(1 for byte in data if byte < 0x80)
+
+
+with open(sys.argv[1], 'rb') as f:
+    data = f.read()
+
+magic, version, record_size, num_records, trailer_offset = HEADER.unpack_from(data, 0)
+assert magic == TRACE_FILE_MAGIC, 'bad header magic'
+assert record_size == RECORD_SIZE, 'bad record size'
+assert trailer_offset + TRAILER.size == len(data), 'bad trailer offset'
+
+name_table_offset, num_names, index_offset, num_index_entries, trailer_magic = \
+    TRAILER.unpack_from(data, trailer_offset)
+assert trailer_magic == TRACE_FILE_TRAILER_MAGIC, 'bad trailer magic'
+
+names = {}
+offset = name_table_offset
+for _ in range(num_names):
+    name_id, length = NAME_ENTRY.unpack_from(data, offset)
+    offset += NAME_ENTRY.size
+    names[name_id] = data[offset:offset + length].decode()
+    offset += length
+assert offset == index_offset, 'bad name table'
+
+indexed_records = 0
+for i in range(num_index_entries):
+    block_offset, block_records, thread_id, _, _ = INDEX_ENTRY.unpack_from(data, index_offset + i * INDEX_ENTRY.size)
+    assert block_offset + block_records * RECORD_SIZE <= name_table_offset, 'bad block index'
+    # Blocks of a single thread are marked with its id, mixed blocks with the sentinel
+    if thread_id != TRACE_THREAD_ID_MIXED:
+        for j in range(block_records):
+            record_thread_id, = struct.unpack_from('<Q', data, block_offset + j * RECORD_SIZE + 8)
+            assert record_thread_id == thread_id, 'bad block thread id'
+    indexed_records += block_records
+assert indexed_records == num_records, 'bad record count'
+
+print('records: {} names: {} blocks: {}'.format(num_records, num_names, num_index_entries))
+
+if version == TRACE_FILE_VERSION_DEDUP:
+    # The iteration trailer right before the trailer locates the iteration table
+    iteration_offset, num_iterations = ITERATION_TRAILER.unpack_from(
+        data, trailer_offset - ITERATION_TRAILER.size)
+    assert iteration_offset == index_offset + num_index_entries * INDEX_ENTRY.size, \
+        'bad iteration table'
+    assert iteration_offset + num_iterations * ITERATION_ENTRY.size + ITERATION_TRAILER.size == \
+        trailer_offset, 'bad iteration table'
+    iterations = []
+    counts = [0, 0, 0]
+    total_records = 0
+    for i in range(num_iterations):
+        (_, _, _, reference, iteration_records, prefix, suffix, records_offset, deltas_offset,
+         deltas_size, kind, _) = ITERATION_ENTRY.unpack_from(data, iteration_offset + i * ITERATION_ENTRY.size)
+        if kind == TRACE_ITERATION_REFERENCE:
+            assert reference == i and prefix == 0 and suffix == 0, 'bad reference'
+        else:
+            assert kind in (TRACE_ITERATION_REPEAT, TRACE_ITERATION_DIFF), 'bad iteration kind'
+            assert reference < i and iterations[reference][0] == TRACE_ITERATION_REFERENCE, \
+                'bad iteration reference'
+            assert prefix + suffix <= min(iteration_records, iterations[reference][1]), 'bad diff'
+            assert deltas_offset + deltas_size <= name_table_offset, 'bad deltas'
+            deltas = data[deltas_offset:deltas_offset + deltas_size]
+            assert num_varints(deltas) == prefix + suffix, 'bad deltas'
+        stored_records = iteration_records - prefix - suffix
+        if stored_records != 0:
+            assert records_offset + stored_records * RECORD_SIZE <= name_table_offset, 'bad records'
+        iterations.append((kind, iteration_records))
+        counts[kind] += 1
+        total_records += iteration_records
+    assert total_records >= num_records, 'bad iteration records'
+
+    print('iterations: {} references: {} repeats: {} diffs: {} records: {}'.format(
+        len(iterations), counts[TRACE_ITERATION_REFERENCE], counts[TRACE_ITERATION_REPEAT],
+        counts[TRACE_ITERATION_DIFF], total_records))